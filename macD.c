@@ -11,6 +11,7 @@
  *     is displayed.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -28,11 +29,26 @@
 #include <sys/socket.h>
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
 #include "macD.h"
 #include "macD_server.h"
-#define SERVER_PATH "macd.socket.server"
+#include "macD_sched.h"
+#include "macD_zygote.h"
+#include "macD_supervisor.h"
+#include "macD_reload.h"
+#include "macD_parse.h"
+#include "macD_stats.h"
+#include "macD_socket.h"
+#include "macD_shm.h"
+#include "macD_output.h"
+#include "macD_top.h"
+#include "macD_rules.h"
+#include "macD_group.h"
+#include "macD_deps.h"
+#include "macD_probe.h"
+#include "macD_journal.h"
+#include "macD_sample.h"
 
-int MAX_ARG_LENGTH = 1000;
 int MAX_PROCESSES = 10;
 int MAX_SEGMENT_LENGTH = 100;
 double TARGET_TIME = -1;
@@ -42,11 +58,22 @@ int SERVER_SOCK;
 int *CLIENTS;
 int CLIENT_LIST_SIZE;
 int MAX_CLIENTS = 10;
+int MAX_SPAWN_LENGTH = 65536;
 FILE *OUTPUT_FILE;
 int *PIDS;
-int WAITING_KILL = 0;
-pthread_mutex_t KILLLOCK;
+struct process_info *PROC_INFO;
+int NUM_PIDS = 0;
+int PIDS_CAPACITY = 0;
+int QUITE_MODE = 0;
+int SHUTTING_DOWN = 0;
+int START_CHECK_MS = 100;
+int GRACE_MS = 5000; //time the children are given to exit at shutdown before they are killed
+int KILL_WAIT_MS = 1000; //time the children that were killed are waited on
+int DELTA_THRESHOLD = -1; //threshold of the delta reports given with -d, -1 for normal reports only
+int KEYFRAME_REPORTS = 12; //with -d, one report in this many is a normal report
+char *SOCKET_PATH = DEFAULT_SOCKET_PATH;
 pthread_mutex_t PIDLOCK;
+pthread_cond_t STATECOND = PTHREAD_COND_INITIALIZER;
 
 
 /*
@@ -58,11 +85,15 @@ pthread_mutex_t PIDLOCK;
  *     argc: number of command line arguments
  *     argv: array of strings containing the command line arguments
  */
+#ifndef MACD_NO_MAIN //the benchmarks link macD.c with their own main
 int main(int argc, char *argv[])
 {
 	OUTPUT_FILE = stdout;
+	stats_thread("main");
+	supervisor_block_signals();
 	read_flags(argc, argv);
 }
+#endif
 
 /*
  * read_flags
@@ -77,7 +108,17 @@ void read_flags(int argc, char *argv[]){
 	int opt;
 	char *i = NULL;
 	int q = 0;
-	while ((opt = getopt(argc, argv, "i:qho:")) != -1) {
+	int z = 0;
+	int w = 0;
+	char *m = NULL;
+	int c = 0;
+	char *l = NULL;
+	int r = 65536;
+	char *R = NULL;
+	char *j = NULL;
+	int T = 0;
+	int I = 0;
+	while ((opt = getopt(argc, argv, "i:qho:a:zws:m:cl:r:R:g:j:Td:k:I")) != -1) {
 		if(opt == 'i'){
 			if (optarg == NULL) {
 				printf("option requires an argument --i");
@@ -97,9 +138,78 @@ void read_flags(int argc, char *argv[]){
 			}
 		} else if (opt == 'q') {
 			q = 1;
+		} else if (opt == 'a') {
+			if (sched_init(optarg) == -1) {
+				fprintf(stderr, "invalid placement policy %s\n", optarg);
+				exit(1);
+			}
+		} else if (opt == 'z') {
+			z = 1;
+		} else if (opt == 'w') {
+			w = 1;
+		} else if (opt == 's') {
+			SOCKET_PATH = optarg;
+		} else if (opt == 'm') {
+			m = optarg;
+		} else if (opt == 'c') {
+			c = 1;
+		} else if (opt == 'l') {
+			c = 1;
+			l = optarg;
+		} else if (opt == 'r') {
+			c = 1;
+			r = convert_str_to_int(optarg);
+		} else if (opt == 'R') {
+			R = optarg;
+		} else if (opt == 'g') {
+			GRACE_MS = convert_str_to_int(optarg);
+			if (GRACE_MS < 0) {
+				fprintf(stderr, "invalid grace period %s\n", optarg);
+				exit(1);
+			}
+		} else if (opt == 'j') {
+			j = optarg;
+		} else if (opt == 'T') {
+			T = 1;
+		} else if (opt == 'I') {
+			I = 1;
+		} else if (opt == 'd') {
+			DELTA_THRESHOLD = convert_str_to_int(optarg);
+			if (DELTA_THRESHOLD < 0 || optarg[0] == '\0') {
+				fprintf(stderr, "invalid delta threshold %s\n", optarg);
+				exit(1);
+			}
+		} else if (opt == 'k') {
+			KEYFRAME_REPORTS = convert_str_to_int(optarg);
+			if (KEYFRAME_REPORTS <= 0) {
+				fprintf(stderr, "invalid keyframe interval %s\n", optarg);
+				exit(1);
+			}
 		}
 	}
+	sample_init(T, I);
+	//a captured child writes to a pipe read by this macD, after a restart it would die of SIGPIPE.
+	if (j != NULL && c == 1) {
+		fprintf(stderr, "-j can't be used with -c, -l or -r\n");
+		exit(1);
+	}
+	if (j != NULL && journal_open(j) == -1) {
+		fprintf(stderr, "couldn't open journal %s\n", j);
+		exit(1);
+	}
+	if (R != NULL && rules_init(R) == -1)
+		exit(1);
+	if (m != NULL && shm_init(m) == -1)
+		exit(1);
+	if (c == 1 && output_init(r, l) == -1) {
+		fprintf(stderr, "couldn't capture the output of the processes\n");
+		exit(1);
+	}
+	if (z == 1 && zygote_start() == -1)
+		fprintf(stderr, "couldn't start zygote, spawning from macD\n");
 	if (i != NULL){
+		reload_init(i, w);
+		supervisor_start();
 		read_file(i, q);
 		if (PIDS == NULL){
 			exit(1);
@@ -124,17 +234,12 @@ void read_flags(int argc, char *argv[]){
 char *kill_process(int index){
 	//check if index is valid
 	int i = 0;
-	pthread_mutex_lock(&PIDLOCK);
+	stats_lock(&PIDLOCK);
 	while(PIDS[i] != -1){
 		if(i == index){
-			pid_t result = waitpid(PIDS[i], NULL, WNOHANG);
-			if(result == 0){ // kill process
-				kill(PIDS[i], SIGKILL);
-				pthread_mutex_unlock(&PIDLOCK);
-				return "SUCC";
-			}
+			int stopped = stop_process(i);
 			pthread_mutex_unlock(&PIDLOCK);
-			return "FAIL";
+			return stopped == 1 ? "SUCC" : "FAIL";
 		}
 		i++;
 	}
@@ -142,6 +247,36 @@ char *kill_process(int index){
 	return "FAIL";
 }
 
+/*
+ * stop_process
+ * description:
+ *    terminates the process at index on request, it won't be restarted.
+ *    a process waiting to be restarted or for its dependencies is never created.
+ * parameters:
+ *    index: the index of the process, which must be in the process table.
+ * pre-conditions:
+ *    PIDLOCK is held.
+ * returns:
+ *    1 if the process was terminated or its restart cancelled, 0 if it had already exited.
+ */
+int stop_process(int index){
+	int state = PROC_INFO[index].state;
+	if(PROC_INFO[index].stopped == 1 && state != PROC_BACKOFF && state != PROC_WAITING)
+		return 0; //already killed, the supervisor hasn't recorded its exit yet
+	if(state == PROC_RUNNING || state == PROC_READY || state == PROC_STARTING){ // kill process
+		PROC_INFO[index].stopped = 1;
+		kill(PIDS[index], SIGKILL);
+		return 1;
+	}
+	if(state == PROC_BACKOFF || state == PROC_WAITING){ // cancel the pending restart or start
+		PROC_INFO[index].stopped = 1;
+		PROC_INFO[index].state = PROC_EXITED;
+		pthread_cond_broadcast(&STATECOND);
+		return 1;
+	}
+	return 0;
+}
+
 /*
  * get_num_running
  * description:
@@ -150,13 +285,15 @@ char *kill_process(int index){
  *     pids: the array of child process id's
  * returns:
  *     number of processes in the given array that are running.
+ * pre-conditions:
+ *     PIDLOCK is held.
  */
 int get_num_running(int *pids){
 	int index = 0;
 	int return_value = 0;
 	while(pids[index]!=-1){
-		pid_t result = waitpid(pids[index], NULL, WNOHANG);
-		if(result == 0)
+		int state = PROC_INFO[index].state;
+		if(state == PROC_RUNNING || state == PROC_READY || state == PROC_STARTING)
 			return_value++;
 		index++;
 	}
@@ -174,7 +311,15 @@ int get_num_running(int *pids){
  */
 void add_client(int client_sock){
 	pthread_t new_thread;
-	pthread_create(&new_thread, NULL, server_mannager,(void*)&client_sock);
+	int *arg = malloc(sizeof(int)); //owned by the new thread, client_sock is gone once we return
+	*arg = client_sock;
+	if(pthread_create(&new_thread, NULL, server_mannager, arg) != 0){
+		fprintf(stderr, "couldn't serve client %s\n", strerror(errno));
+		close(client_sock);
+		free(arg);
+		return;
+	}
+	pthread_detach(new_thread);
 }
 
 /*
@@ -184,17 +329,27 @@ void add_client(int client_sock){
  *     if a new client is detected its socket is added to the client list.
  */
 void *server_listener(void* argvp){
+	stats_thread("listener");
 	while(1){
 		struct sockaddr_un client_address;
 		memset(&client_address, 0, sizeof(struct sockaddr_un));
-		unsigned int len;
+		unsigned int len = sizeof(client_address);
 		int client_sock, rc;
-		client_sock = accept(SERVER_SOCK, (struct sockaddr *) &client_address, &len);
+		client_sock = accept4(SERVER_SOCK, (struct sockaddr *) &client_address, &len, SOCK_CLOEXEC);
 		if(client_sock == -1){
+			if(errno == EINTR || errno == ECONNABORTED || errno == EMFILE || errno == ENFILE){
+				//too many clients at once, wait for some to leave instead of exiting.
+				if(errno == EMFILE || errno == ENFILE)
+					usleep(10000);
+				continue;
+			}
+			if(SHUTTING_DOWN == 1)
+				return NULL;
 			fprintf(stderr, "Acceptance error %s\n", strerror(errno));
 			close_server();
 			exit(1);
 		}
+		len = sizeof(client_address);
 		rc = getpeername(client_sock, (struct sockaddr *) &client_address, &len);
 		if (rc == -1){
 			fprintf(stderr, "Getpeername Error\n");
@@ -241,55 +396,265 @@ void str_lower(char *str){
  * description:
  *     a thread function that detects messages from the clients and sends
  *     the appropriate response to these clients.
+ *     returns when the client disconnects.
  */
 void *server_mannager(void* void_client){
-	int rc;
+	int rc = 0;
 	int client_sock = *(int*)void_client;
-	while(1){
-		char *buffer = malloc(5);
-		memset(buffer, 0, 4);
-		int rec = recv(client_sock, buffer, 4, 0);
-		if(rec == -1){
-			fprintf(stderr, "receive error %s\n",strerror(errno));
-			close_server();
-			exit(1);
-		}
+	int waiting_kill = 0; //1 if the next 4 bytes are the index of a kill command
+	free(void_client);
+	stats_thread("client");
+	while(rc != -1){
+		char buffer[5];
+		if(recv_all(client_sock, buffer, 4) == -1)
+			break; //the client disconnected
+		unsigned long received = stats_now();
 		buffer[4] = '\0';
-		str_lower(buffer);
-		pthread_mutex_lock(&KILLLOCK);
-		if(WAITING_KILL == 1){
-			pthread_mutex_unlock(&KILLLOCK);
+		if(waiting_kill == 1){
 			//parse buffer as integer
-			int value = *((int *)buffer);
+			int value;
+			memcpy(&value, buffer, sizeof(int));
 			char *response = kill_process(value);
-			rc = send(client_sock, response, 4, 0);
-			if(rc == -1){
-				fprintf(stderr, "Sending Error\n");
-				close_server();
-				exit(1);
-			}
-			pthread_mutex_lock(&KILLLOCK);
-			WAITING_KILL = 0;
-			pthread_mutex_unlock(&KILLLOCK);
-		} else if(strcmp(buffer, "stat") == 0){
-			pthread_mutex_unlock(&KILLLOCK);
-			pthread_mutex_lock(&PIDLOCK);
+			rc = send(client_sock, response, 4, MSG_NOSIGNAL);
+			waiting_kill = 0;
+			stats_record(STAT_REQUEST, stats_now() - received);
+			continue;
+		}
+		str_lower(buffer);
+		if(strcmp(buffer, "stat") == 0){
+			stats_lock(&PIDLOCK);
 			int results = get_num_running(PIDS);
 			pthread_mutex_unlock(&PIDLOCK);
-			rc = send(client_sock, &results, 4, 0);
-			if(rc == -1){
-				fprintf(stderr, "Sending Error\n");
-				close_server();
-				exit(1);
-			}
+			rc = send(client_sock, &results, 4, MSG_NOSIGNAL);
 		} else if(strcmp(buffer,"kill") == 0) {
-			WAITING_KILL = 1;
-			pthread_mutex_unlock(&KILLLOCK);
+			waiting_kill = 1;
+			continue; //timed once the index arrives
+		} else if(strcmp(buffer,"spwn") == 0) {
+			rc = spawn_request(client_sock);
+		} else if(strcmp(buffer,"perf") == 0) {
+			rc = send_text(client_sock, stats_text);
+		} else if(strcmp(buffer,"tail") == 0) {
+			rc = tail_request(client_sock);
+		} else if(strcmp(buffer,"thrd") == 0 || strcmp(buffer,"proc") == 0) {
+			rc = process_request(client_sock, buffer);
+		} else if(strcmp(buffer,"topk") == 0) {
+			rc = send_text(client_sock, top_text);
+		} else if(strcmp(buffer,"gsta") == 0 || strcmp(buffer,"gkil") == 0 || strcmp(buffer,"gtal") == 0) {
+			rc = group_request(client_sock, buffer);
 		} else {
-			pthread_mutex_unlock(&KILLLOCK);
+			continue; //unknown commands are ignored
+		}
+		stats_record(STAT_REQUEST, stats_now() - received);
+	}
+	close(client_sock);
+	return NULL;
+}
+
+/*
+ * send_text
+ * description:
+ *     sends a variable length reply: its length as an int followed by the text.
+ * parameters:
+ *     client_sock: the socket of the client.
+ *     render: function that renders the text and sets its length.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int send_text(int client_sock, char *(*render)(int *out_len)){
+	int len;
+	char *text = render(&len);
+	int rc = send(client_sock, &len, sizeof(int), MSG_NOSIGNAL);
+	if(rc != -1 && len > 0)
+		rc = send(client_sock, text, len, MSG_NOSIGNAL);
+	free(text);
+	return rc == -1 ? -1 : 0;
+}
+
+/*
+ * tail_request
+ * description:
+ *     reads the index of a tail command and replies with the output kept
+ *     for that process: its length as an int followed by the output,
+ *     or a length of -1 if output isn't captured or the index is invalid.
+ * parameters:
+ *     client_sock: the socket of the client that sent the tail command.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int tail_request(int client_sock){
+	int index;
+	int len = -1;
+	if(recv_all(client_sock, &index, sizeof(int)) == -1)
+		return -1;
+	char *text = output_tail(index, &len);
+	int rc = send(client_sock, &len, sizeof(int), MSG_NOSIGNAL);
+	if(rc != -1 && len > 0)
+		rc = send(client_sock, text, len, MSG_NOSIGNAL);
+	free(text);
+	return rc == -1 ? -1 : 0;
+}
+
+/*
+ * process_request
+ * description:
+ *     reads the index of a process command and replies with the length of
+ *     the text as an int followed by the text, or a length of -1 if the index is invalid:
+ *     thrd: the hottest threads of the process in the last report cycle, see sample_threads_text,
+ *     -1 if the process isn't sampled with @threads.
+ *     proc: the usage of the process in the last report cycle, see sample_metrics_text,
+ *     -1 if it isn't running.
+ * parameters:
+ *     client_sock: the socket of the client that sent the command.
+ *     command: the name of the command, thrd or proc.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int process_request(int client_sock, char *command){
+	int index;
+	int len = -1;
+	if(recv_all(client_sock, &index, sizeof(int)) == -1)
+		return -1;
+	stats_lock(&PIDLOCK);
+	char *text = strcmp(command, "thrd") == 0 ? sample_threads_text(index, &len) : sample_metrics_text(index, &len);
+	pthread_mutex_unlock(&PIDLOCK);
+	if(text == NULL)
+		len = -1;
+	int rc = send(client_sock, &len, sizeof(int), MSG_NOSIGNAL);
+	if(rc != -1 && len > 0)
+		rc = send(client_sock, text, len, MSG_NOSIGNAL);
+	free(text);
+	return rc == -1 ? -1 : 0;
+}
+
+/*
+ * group_request
+ * description:
+ *     reads the group name of a group command, the length of the name followed
+ *     by the name, and replies:
+ *     gkil: the number of processes terminated as an int, -1 if the group doesn't exist.
+ *     gsta: the length of the state of the group as an int followed by the text, see group_stat.
+ *     gtal: the length of the output of the group as an int followed by the output, see group_tail.
+ *     the text replies have a length of -1 if the group doesn't exist.
+ * parameters:
+ *     client_sock: the socket of the client that sent the command.
+ *     command: the name of the command, gsta, gkil or gtal.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int group_request(int client_sock, char *command){
+	int len;
+	int reply = -1;
+	char *text = NULL;
+	if(recv_all(client_sock, &len, sizeof(int)) == -1 || len < 0 || len > MAX_SPAWN_LENGTH)
+		return -1;
+	char *name = malloc(len+1);
+	if(recv_all(client_sock, name, len) == -1){
+		free(name);
+		return -1;
+	}
+	name[len] = '\0';
+	stats_lock(&PIDLOCK);
+	if(strlen(name) != len || len >= MAX_GROUP_LENGTH)
+		reply = -1; //no group has this name
+	else if(strcmp(command, "gkil") == 0)
+		reply = group_kill(name);
+	else if(strcmp(command, "gsta") == 0)
+		text = group_stat(name, &reply);
+	else
+		text = group_tail(name, &reply);
+	pthread_mutex_unlock(&PIDLOCK);
+	free(name);
+	if(text == NULL && strcmp(command, "gkil") != 0)
+		reply = -1;
+	int rc = send(client_sock, &reply, sizeof(int), MSG_NOSIGNAL);
+	if(rc != -1 && text != NULL && reply > 0)
+		rc = send(client_sock, text, reply, MSG_NOSIGNAL);
+	free(text);
+	return rc == -1 ? -1 : 0;
+}
+
+/*
+ * recv_all
+ * description:
+ *     receives exactly len bytes from the client.
+ * parameters:
+ *     client_sock: the socket to read from.
+ *     buffer: where to store the bytes read.
+ *     len: the number of bytes to read.
+ * returns:
+ *     0 if len bytes were read, -1 if the client disconnected or an error occured.
+ */
+int recv_all(int client_sock, void *buffer, int len){
+	char *ptr = buffer;
+	while(len > 0){
+		int rec = recv(client_sock, ptr, len, 0);
+		if(rec <= 0){
+			if(rec == -1 && errno == EINTR)
+				continue;
+			return -1;
+		}
+		ptr += rec;
+		len -= rec;
+	}
+	return 0;
+}
+
+/*
+ * spawn_request
+ * description:
+ *     reads a spawn request from the client, creates the process and adds it
+ *     to the process table. The request is the length of the line followed by
+ *     the line itself, which can start with directives just like a line of the
+ *     process list file. The reply is the index of the new process followed by its pid,
+ *     both -1 if the process failed to start.
+ *     a length that is negative or above MAX_SPAWN_LENGTH can't be skipped, the
+ *     connection is closed like for an invalid group command.
+ * parameters:
+ *     client_sock: the socket of the client that sent the spwn command.
+ * returns:
+ *     0 if the reply was sent, -1 if the connection must be closed.
+ */
+int spawn_request(int client_sock){
+	int reply[2] = { -1, -1 };
+	int len;
+	if(recv_all(client_sock, &len, sizeof(int)) == -1 || len < 0 || len > MAX_SPAWN_LENGTH)
+		return -1;
+	char *line = malloc(len+1);
+	if(recv_all(client_sock, line, len) == -1){
+		free(line);
+		return -1;
+	}
+	line[len] = '\0';
+	struct process_info info;
+	int argc;
+	char **argv = parse_line(line, &argc);
+	char **command = argc == -1 ? NULL : parse_directives(argv, &info);
+	if(command != NULL && command[0] != NULL){
+		//the line is kept so that a restarted macD can adopt the process from the journal.
+		info.source = argv[0];
+		info.source_len = args_length(argv, argc);
+		info.spawned = 1;
+		int index = add_process(command, &info);
+		stats_lock(&PIDLOCK);
+		if(index != -1 && wait_started(index) == 0){
+			reply[0] = index;
+			reply[1] = PIDS[index];
+		}else if(index != -1){
+			drop_process(index);
 		}
-		free(buffer);
+		pthread_mutex_unlock(&PIDLOCK);
+		if(reply[0] != -1)
+			fprintf(OUTPUT_FILE, "[%d] %s, spawned (pid: %d)\n", reply[0], command[0], reply[1]);
+		else
+			fprintf(OUTPUT_FILE, "[-] badprogram %s, failed to spawn\n", command[0]);
+	}
+	free(argv);
+	free(line);
+	if(send(client_sock, reply, sizeof(reply), MSG_NOSIGNAL) == -1){
+		fprintf(stderr, "Sending Error\n");
+		return -1;
 	}
+	return 0;
 }
 
 /*
@@ -306,26 +671,30 @@ void start_server()
 	int server_sock, rc;
 	struct sockaddr_un server_address;
 	memset(&server_address, 0, sizeof(struct sockaddr_un));
-	server_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	server_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
 	if(server_sock == -1){
 		fprintf(stderr, "Socket error\n");
 		exit(1);
 	}
 
-	//set up binding.
-	server_address.sun_family = AF_UNIX;
-	strncpy(server_address.sun_path, SERVER_PATH, 19);
-	unsigned int len = sizeof(server_address);
-	unlink(SERVER_PATH);
+	//set up binding, an abstract socket (@name) has no file to unlink.
+	int len = socket_address(SOCKET_PATH, &server_address);
+	if (len == -1) {
+		fprintf(stderr, "invalid socket path %s\n", SOCKET_PATH);
+		close(server_sock);
+		exit(1);
+	}
+	if (SOCKET_PATH[0] != '@')
+		unlink(SOCKET_PATH);
 	rc = bind(server_sock, (struct sockaddr *) &server_address, len);
 	if (rc == -1) {
-		fprintf(stderr, "binding error\n");
+		fprintf(stderr, "binding error %s: %s\n", SOCKET_PATH, strerror(errno));
 		close(server_sock);
 		exit(1);
 	}
 
 	//set up listening.
-	rc = listen(server_sock, 10);
+	rc = listen(server_sock, SOMAXCONN);
 	if (rc == -1){
 		fprintf(stderr, "listening error\n");
 		close(server_sock);
@@ -343,144 +712,434 @@ void start_server()
 }
 
 /*
- * get_num_args
+ * exec_process
  * description:
- *     counts the number of arguments in a given line of text
- *     assuming this line is from the process list file.
- *     counts the number of spaces in the line and uses this
- *     to determin the number of args.
+ *     replaces the calling process, a newly forked child, with the
+ *     process indicated by argv.
  * parameters:
- *     line: a string of the command to count the args of
- * pre-condition:
- *    line is initialized.
+ *     argv: arguments of the process to execute, terminated by NULL.
+ *     quite_mode: 1 if the output of the process should be muted
+ *     unit: placement unit to bind the process to, -1 to leave it unbound.
+ *     err_fd: file descriptor to write errno to if exec fails, -1 for none.
+ *     out_fd: file descriptor to use as stdout and stderr, -1 to keep macD's.
+ *     notify_fd: file descriptor to hand to the process as PROBE_NOTIFY_FD, -1 for none.
+ * pre-conditions:
+ *     argv is initialized.
+ * post-conditions:
+ *     this process is replaced, or exits if exec fails.
+ */
+void exec_process(char **argv, int quite_mode, int unit, int err_fd, int out_fd, int notify_fd)
+{
+	sigset_t mask;
+
+	if (argv[0] == NULL)
+		_exit(1);
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK, &mask, NULL);
+	if(out_fd >= 0){
+		dup2(out_fd, STDOUT_FILENO);
+		dup2(out_fd, STDERR_FILENO);
+	}else if(quite_mode == 1){
+		int output_file = open("/dev/null",O_RDWR);
+		if(output_file<0){
+			fprintf(stderr, "couldn't open file");
+			_exit(1);
+		}
+		dup2(output_file, STDOUT_FILENO);
+		dup2(output_file, STDERR_FILENO);
+		close(output_file);
+	}
+	//dup2 onto itself would leave close on exec set.
+	if (notify_fd == PROBE_NOTIFY_FD)
+		fcntl(notify_fd, F_SETFD, 0);
+	else if (notify_fd >= 0)
+		dup2(notify_fd, PROBE_NOTIFY_FD);
+	if (unit >= 0)
+		sched_bind(0, unit);
+	execvp(argv[0], argv);
+	int error = errno;
+
+	if (err_fd >= 0)
+		write(err_fd, &error, sizeof(int));
+	_exit(error);
+}
+
+/*
+ * create_process
+ * description:
+ *     creates a new process using the fork function, or through the
+ *     zygote if it is running.
+ *     changes the process to the process indicated by argv.
+ *     the new process is waited on by the supervisor.
+ * parameters:
+ *     argv: arguments of the process to create, packed with pack_args.
+ *     out_pid: pointer to store the pid of the new process to,
+ *              set to -1 if the process couldn't be created.
+ *     quite_mode: 1 if the output of the process should be muted
+ *     unit: placement unit to bind the process to, -1 to leave it unbound.
+ *     out_fd: file descriptor to use as stdout and stderr, -1 to keep macD's.
+ *     notify_fd: file descriptor to hand to the process as PROBE_NOTIFY_FD, -1 for none.
+ * pre-conditions:
+ *     argv is initialized.
+ */
+void create_process(char **argv, int *out_pid, int quite_mode, int unit, int out_fd, int notify_fd)
+{
+	int pid = -1;
+
+	if (zygote_enabled()) {
+		int error = 0;
+
+		pid = zygote_spawn(argv, quite_mode, unit, out_fd, notify_fd, &error);
+		if (pid != -1 && error != 0) { //exec failed, the supervisor reaps the child
+			*out_pid = -1;
+			return;
+		}
+	}
+	if (pid == -1) {
+		pid = fork();
+		if (pid == 0)
+			exec_process(argv, quite_mode, unit, -1, out_fd, notify_fd);
+	}
+	*out_pid = pid;
+}
+
+/*
+ * init_process_info
+ * description:
+ *     sets every field of info to its default value.
+ * parameters:
+ *     info: the process_info to initialize.
+ */
+void init_process_info(struct process_info *info)
+{
+	memset(info, 0, sizeof(struct process_info));
+	info->state = PROC_EXITED;
+	info->unit = -1;
+	info->cpu = -1;
+	info->group_id = -1;
+	info->restart = RESTART_NEVER;
+	info->backoff = 100;
+	info->max_restarts = 5;
+	info->probe_timeout = PROBE_TIMEOUT_MS;
+	info->stop_signal = SIGTERM;
+	info->shown_state = -1;
+}
+
+/*
+ * parse_directive
+ * description:
+ *     applies a single directive of the form key=value to info.
+ *     the directives are:
+ *         restart=never|on-failure|always
+ *         backoff=[ms], the delay before the first restart of a crash loop
+ *         max-restarts=[integer], quick restarts in a row before giving up
+ *         group=[name], the group the process belongs to
+ *         name=[name], the name other lines use to depend on the process
+ *         after=[name,...], processes that must be running or have exited before it starts
+ *         requires=[name,...], processes that must be running before it starts
+ *         ready=notify|tcp:[host:]port|unix:path|file:path|cmd:command, the readiness probe
+ *         ready-timeout=[ms], the time the probe may take
+ *         stop-signal=[name|number], the signal the process is stopped with at shutdown
+ *         threads=[count], the number of hottest threads reported, the threads are sampled
+ * parameters:
+ *     directive: the directive, without the leading '@'.
+ *     info: the process_info to apply the directive to.
  * returns:
- *     number of args in line.
+ *     0 if the directive is valid, -1 otherwise.
  */
-int get_num_args(char *line)
+int parse_directive(char *directive, struct process_info *info)
 {
-	int len = strlen(line);
-	int count = 0;
+	char *value = strchr(directive, '=');
 
-	for (int i = 0; i < len; i++) {
-		if (line[i] == ' ')
-			count++;
+	if (value == NULL)
+		return -1;
+	*value = '\0';
+	value++;
+	if (strcmp(directive, "restart") == 0) {
+		if (strcmp(value, "never") == 0)
+			info->restart = RESTART_NEVER;
+		else if (strcmp(value, "on-failure") == 0)
+			info->restart = RESTART_ON_FAILURE;
+		else if (strcmp(value, "always") == 0)
+			info->restart = RESTART_ALWAYS;
+		else
+			return -1;
+	} else if (strcmp(directive, "backoff") == 0) {
+		info->backoff = convert_str_to_int(value);
+		if (info->backoff <= 0)
+			return -1;
+	} else if (strcmp(directive, "group") == 0) {
+		if (value[0] == '\0' || strlen(value) >= MAX_GROUP_LENGTH)
+			return -1;
+		strcpy(info->group, value);
+	} else if (strcmp(directive, "name") == 0) {
+		if (value[0] == '\0' || strlen(value) >= MAX_NAME_LENGTH || strchr(value, ',') != NULL)
+			return -1;
+		strcpy(info->name, value);
+	} else if (strcmp(directive, "after") == 0 || strcmp(directive, "requires") == 0) {
+		char **list = directive[0] == 'a' ? &info->after : &info->requires;
+
+		if (value[0] == '\0')
+			return -1;
+		if (*list == NULL) {
+			*list = strdup(value);
+		} else { //the directive can be repeated
+			char *joined = malloc(strlen(*list) + strlen(value) + 2);
+
+			sprintf(joined, "%s,%s", *list, value);
+			free(*list);
+			*list = joined;
+		}
+	} else if (strcmp(directive, "ready") == 0) {
+		if (probe_valid(value) == -1)
+			return -1;
+		free(info->probe);
+		info->probe = strdup(value);
+	} else if (strcmp(directive, "ready-timeout") == 0) {
+		info->probe_timeout = convert_str_to_int(value);
+		if (info->probe_timeout <= 0)
+			return -1;
+	} else if (strcmp(directive, "stop-signal") == 0) {
+		info->stop_signal = parse_signal(value);
+		if (info->stop_signal == -1)
+			return -1;
+	} else if (strcmp(directive, "max-restarts") == 0) {
+		info->max_restarts = convert_str_to_int(value);
+		if (info->max_restarts < 0 || value[0] == '\0')
+			return -1;
+	} else if (strcmp(directive, "threads") == 0) {
+		info->hot_threads = convert_str_to_int(value);
+		if (info->hot_threads <= 0 || info->hot_threads > MAX_HOT_THREADS)
+			return -1;
+	} else {
+		return -1;
 	}
-	return count+1;
+	return 0;
 }
 
 /*
- * get_args
+ * free_directives
  * description:
- *     creates a list of strings containing the arguments
- *     of the given line, which represents a process from the process list file.
+ *     frees what the directives of info allocated.
  * parameters:
- *     line: a string of the command to get the args of
+ *     info: the process_info.
+ */
+void free_directives(struct process_info *info)
+{
+	deps_free(info);
+	free(info->probe);
+	info->probe = NULL;
+}
+
+/*
+ * parse_directives
+ * description:
+ *     reads the directives at the start of a line from the process list file.
+ *     directives are arguments starting with '@', ie "@restart=always ./worker".
+ * parameters:
+ *     argv: the arguments of the line, terminated by NULL.
+ *     info: the process_info to initialize and apply the directives to.
  * pre-condition:
- *     line is initialized.
+ *     argv is initialized.
  * returns:
- *     list of strings each element is an argument.
+ *     pointer to the arguments of the command that follow the directives,
+ *     or NULL if one of the directives is invalid or no command follows them.
  */
-char **get_args(char *line)
+char **parse_directives(char **argv, struct process_info *info)
 {
-	int args = get_num_args(line);
-	char **return_array = malloc(sizeof(char *)*args);
-	char *token = strtok(line, " ");
-	int index = 0;
-
-	while (token != NULL) {
-		return_array[index] = token;
-		token = strtok(NULL, " ");
-		index++;
+	init_process_info(info);
+	while (argv[0] != NULL && argv[0][0] == '@') {
+		char directive[256];
+
+		//directives are applied to a copy, argv is also the key used by reload.
+		if (strlen(argv[0]) >= sizeof(directive) || parse_directive(strcpy(directive, argv[0]+1), info) == -1) {
+			fprintf(stderr, "macD: invalid directive %s\n", argv[0]);
+			free_directives(info);
+			return NULL;
+		}
+		argv++;
+	}
+	if (argv[0] == NULL) {
+		free_directives(info);
+		return NULL;
 	}
-	return return_array;
+	return argv;
 }
 
 /*
- * create_process
+ * start_process
  * description:
- *     creates a new process using the fork function.
- *     changes the process to the process indicated by process_path.
- *     terminates any failed forks.
+ *     creates the process of the entry at index in the process table
+ *     and starts its start check. The supervisor moves it to PROC_RUNNING
+ *     if it is still alive after START_CHECK_MS, or to PROC_READY once its
+ *     readiness probe passes if it has one.
  * parameters:
- *     process_line: string containing path to the process to create.
- *     out_pid: pointer to store the pid of the new process to.
- *     quite_mode: 1 if the output of the process should be muted
+ *     index: index of the entry in PIDS and PROC_INFO.
  * pre-conditions:
- *     process_path is initialized.
+ *     PIDLOCK is held.
+ * returns:
+ *     0 if the process was created, -1 otherwise.
  */
-void create_process(char *process_line, int *out_pid, int quite_mode)
+int start_process(int index)
 {
-	int pid = fork();
+	struct process_info *info = &PROC_INFO[index];
+	int unit = sched_place();
+	int pid = -1;
 
-	if (pid == -1)
-		exit(1);
-	if (pid == 0) {
-		char **args = get_args(process_line);
+	clock_gettime(CLOCK_MONOTONIC, &info->started);
+	unsigned long before = stats_now();
 
-		if (args[0] == NULL)
-			exit(1);
-		if(quite_mode == 1){
-			int output_file = open("/dev/null",O_RDWR);
-			if(output_file<0){
-				fprintf(stderr, "couldn't open file");
-				exit(1);
-			}
-			dup2(output_file, STDOUT_FILENO);
-			close(output_file);
-		}
-		execvp(args[0], args);
-		*out_pid = -1;
-		exit(errno);
-	} else {
-		usleep(100000);
-		int result = waitpid(pid, NULL, WNOHANG);
+	int out_fd = output_attach(index);
+
+	int notify_fd = probe_prepare(index);
 
-		if (*out_pid != -1 && result == 0)
-			*out_pid = pid;
+	rules_reset(index);
+
+	create_process(info->argv, &pid, QUITE_MODE, unit, out_fd, notify_fd);
+	stats_record(STAT_SPAWN, stats_now() - before);
+	if (out_fd != -1)
+		close(out_fd); //only the child writes to the pipe, so it reaches EOF when the child exits
+	if (notify_fd != -1)
+		close(notify_fd);
+
+	if (pid == -1) {
+		probe_cancel(index);
+		sched_unplace(unit);
+		info->state = PROC_EXITED;
+		return -1;
 	}
+	PIDS[index] = pid;
+	info->unit = unit;
+	info->ticks = 0;
+	info->cpu = 0;
+	info->mem = 0;
+	info->state = PROC_STARTING;
+	if (info->probe != NULL)
+		probe_start(index);
+	else
+		set_deadline(&info->deadline, START_CHECK_MS);
+	journal_started(index);
+	supervisor_wake();
+	return 0;
 }
 
 /*
- * read_next_line
+ * add_entry
  * description:
- *     reads the next line in the given file object
+ *     appends a new entry to the process table without creating its process.
+ *     the entry takes over the dependency names of info.
  * parameters:
- *     fptr: pointer to the FILE object to read from.
+ *     argv: the arguments of the process, without directives.
+ *     info: the options of the process, read from its directives.
  * pre-conditions:
- *     fptr is initialized and is a valid FILE object
+ *     PIDLOCK is held.
+ *     argv is initialized.
  * returns:
- *     char array, string, containing the next line of the file.
+ *     the index of the new entry.
  */
-char *read_next_line(FILE *fptr)
+int add_entry(char **argv, struct process_info *info)
 {
-	char *scanner = malloc(1);
-	char *line = malloc(PATH_MAX+MAX_ARG_LENGTH);
-	int index = 0;
-	int extensions = 0;
-	int read_items = fread(scanner, 1, 1, fptr);
+	if (NUM_PIDS + 1 >= PIDS_CAPACITY) {
+		//increase size of pids
+		PIDS_CAPACITY = PIDS_CAPACITY*2;
+		PIDS = realloc(PIDS, sizeof(int)*PIDS_CAPACITY);
+		PROC_INFO = realloc(PROC_INFO, sizeof(struct process_info)*PIDS_CAPACITY);
+	}
+	int index = NUM_PIDS;
 
-	if (read_items != 1) {
-		free(scanner);
-		free(line);
-		return NULL;
+	PROC_INFO[index] = *info;
+	PROC_INFO[index].argv = pack_args(argv);
+	if (info->source != NULL) {
+		PROC_INFO[index].source = malloc(info->source_len);
+		memcpy(PROC_INFO[index].source, info->source, info->source_len);
 	}
-	while (*scanner != '\n' && read_items == 1) {
-		line[index] = *scanner;
-		index++;
-		if (index >= PATH_MAX + (MAX_ARG_LENGTH * (extensions+1))) {
-			//grow the array.
-			extensions++;
-			char *temp = line;
+	PIDS[index] = 0;
+	PIDS[index+1] = -1;
+	NUM_PIDS++;
+	group_join(index);
+	output_reset(index);
+	return index;
+}
 
-			line = malloc(PATH_MAX + (MAX_ARG_LENGTH*(extensions+1)));
-			strncpy(line, temp, PATH_MAX+MAX_ARG_LENGTH*(extensions)-1);
-			free(temp);
-		}
-		read_items = fread(scanner, 1, 1, fptr);
+/*
+ * add_process
+ * description:
+ *     appends a new entry to the process table and creates its process, or
+ *     leaves it waiting if its dependencies aren't up yet. The dependencies
+ *     must already be in the table, the supervisor creates the process once they are up.
+ * parameters:
+ *     argv: the arguments of the process, without directives.
+ *     info: the options of the process, read from its directives.
+ * pre-conditions:
+ *     argv is initialized.
+ * returns:
+ *     the index of the new entry, or -1 if the process couldn't be created,
+ *     one of its dependencies doesn't exist or has exited, or macD is shutting down.
+ */
+int add_process(char **argv, struct process_info *info)
+{
+	stats_lock(&PIDLOCK);
+	//terminate_program walks the table while it waits for the children, it must not grow.
+	if (SHUTTING_DOWN == 1) {
+		pthread_mutex_unlock(&PIDLOCK);
+		return -1;
+	}
+	int index = add_entry(argv, info);
+	int ready = deps_resolve(index) == -1 ? -1 : deps_ready(index);
+
+	if (ready == 0)
+		PROC_INFO[index].state = PROC_WAITING;
+	if (ready == -1 || (ready == 1 && start_process(index) == -1)) {
+		drop_process(index);
+		index = -1;
 	}
-	free(scanner);
-	line[index] = '\0';
-	return line;
+	pthread_mutex_unlock(&PIDLOCK);
+	return index;
+}
+
+/*
+ * drop_process
+ * description:
+ *     removes the entry at index from the process table if it is the last one,
+ *     so that processes which failed to start don't take an index.
+ *     the table is left as is once macD is shutting down.
+ * parameters:
+ *     index: index of the entry to remove.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the process at index is not running.
+ */
+void drop_process(int index)
+{
+	if (index != NUM_PIDS-1 || SHUTTING_DOWN == 1)
+		return;
+	group_leave(index);
+	free_directives(&PROC_INFO[index]);
+	free(PROC_INFO[index].argv);
+	free(PROC_INFO[index].source);
+	free(PROC_INFO[index].threads);
+	NUM_PIDS--;
+	PIDS[index] = -1;
+}
+
+/*
+ * wait_started
+ * description:
+ *     waits for the dependencies and the start check of the process at index to complete.
+ * parameters:
+ *     index: index of the process in PIDS.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     0 if the process passed its start check, -1 if it exited or was never created.
+ */
+int wait_started(int index)
+{
+	while (PROC_INFO[index].state == PROC_STARTING || PROC_INFO[index].state == PROC_WAITING)
+		pthread_cond_wait(&STATECOND, &PIDLOCK);
+	if (PROC_INFO[index].state == PROC_EXITED)
+		return -1;
+	return 0;
 }
 
 /*
@@ -553,24 +1212,19 @@ int convert_str_to_int(char *str)
  *     if the line is in the form "timelimit [integer]" then
  *     [integer] is returned.
  * parameters:
- *     line: line to check if its a timer.
+ *     argv: the arguments of the line to check, terminated by NULL.
  * returns:
  *     the value of the time limit if the given line is a timer.
  *     -1 otherwise.
  */
-int read_timer(char *line)
+int read_timer(char **argv)
 {
-	if (line == NULL)
-		return -1;
-	if (line[0] == '\0')
+	if (argv == NULL || argv[0] == NULL)
 		return -1;
-	char *token = strtok(line, " ");
-
-	if (strcmp(token, "timelimit") == 0) {
-		token = strtok(NULL, " ");
-		if (token == NULL)
+	if (strcmp(argv[0], "timelimit") == 0) {
+		if (argv[1] == NULL)
 			return -1;
-		int timer = convert_str_to_int(token);
+		int timer = convert_str_to_int(argv[1]);
 
 		return timer;
 	}
@@ -709,7 +1363,11 @@ void display_date(void)
  *     reads all lines in the given file.
  *     creates a process for each line in the file where the line
  *     indicates what process to create. The mutes the output of the child
- *     if quite_mode is set to 1.
+ *     if quite_mode is set to 1. Empty lines and comments are skipped.
+ *     every line is added to the table first, then the supervisor creates the
+ *     processes as their dependencies come up, in parallel, and this waits
+ *     until every one of them passed or failed its start check.
+ *     lines whose process is still running from a previous macD adopt it instead.
  * parameters:
  *     file_path: string of the path to the file to read.
  *     quite_mode: 1 if it should mute child out put 0 otherwise.
@@ -718,65 +1376,60 @@ void display_date(void)
  */
 int *read_file(char *file_path, int quite_mode)
 {
-	FILE *fptr = fopen(file_path, "r");
+	struct process_list *list = load_process_list(file_path);
 
-	if (fptr == NULL) {
+	if (list == NULL) {
 		fprintf(OUTPUT_FILE, "macD: %s not found", file_path);
 		return NULL;
 	}
 	//read file for processes
 	fprintf(OUTPUT_FILE, "%s", "Starting report, ");
 	display_date();
-	char *line = read_next_line(fptr);
-
-	TARGET_TIME = read_timer(line);
-	if (TARGET_TIME != -1) {
-		free(line);
-		line = read_next_line(fptr);
-	}
+	int first = 0;
+
+	if (list->count > 0)
+		TARGET_TIME = read_timer(list->lines[0].argv);
+	if (TARGET_TIME != -1)
+		first = 1;
+	stats_lock(&PIDLOCK);
+	QUITE_MODE = quite_mode;
 	PIDS = malloc(sizeof(int)*MAX_PROCESSES);
-	int index = 0;
-	int line_number = 0;
-	int len_pids = MAX_PROCESSES;
-	int *out_pid = malloc(sizeof(int *));
-
-	while (line != NULL) {
-		*out_pid = -2;
-		if (line[0] != '\0')
-			create_process(line, out_pid, quite_mode);
-		if (*out_pid >= 0) {
-			PIDS[index] = *out_pid;
-			char *path = strtok(line, " ");
-
-			fprintf(OUTPUT_FILE, "[%d] %s, started successfully (pid: %d)\n", line_number, path, *out_pid);
-			index++;
-		} else {
-			if (line[0] == '\0') {
-				fprintf(OUTPUT_FILE, "[%d] badprogram , failed to start\n", line_number);
-			} else {
-				char *path = strtok(line, " ");
-
-				fprintf(OUTPUT_FILE, "[%d] badprogram %s, failed to start\n", line_number, path);
-			}
+	PROC_INFO = malloc(sizeof(struct process_info)*MAX_PROCESSES);
+	PIDS_CAPACITY = MAX_PROCESSES;
+	PIDS[0] = -1;//to indicate end of array
+	for (int k = first; k < list->count; k++) {
+		struct list_line *line = &list->lines[k];
+		struct process_info info;
+		char **command = NULL;
+
+		if (line->argc == -1)
+			fprintf(stderr, "macD: %s:%d: unterminated quote\n", file_path, line->number);
+		else
+			command = parse_directives(line->argv, &info);
+		if (command == NULL) {
+			fprintf(OUTPUT_FILE, "[-] badprogram %s, failed to start\n", line->argv[0]);
+			continue;
 		}
-		if (index >= len_pids - 1) {
-			//increase size of pids
-			len_pids = len_pids + MAX_PROCESSES;
-			int *temp = PIDS;
-
-			PIDS = malloc(sizeof(int)*len_pids);
-			for (int i = 0; i < index; i++)
-				PIDS[i] = temp[i];
-			free(temp);
+		info.source = line->argv[0];
+		info.source_len = line->len;
+		info.state = PROC_WAITING;
+		info.announce = 1; //the supervisor reports each start check as it completes
+		journal_adopt(add_entry(command, &info));
+	}
+	journal_adopt_remaining();
+	//dependencies can name later lines, so they are resolved once every line is in the table.
+	for (int i = 0; PIDS[i] != -1; i++) {
+		if (deps_resolve(i) == -1 && PROC_INFO[i].state == PROC_WAITING) {
+			PROC_INFO[i].state = PROC_EXITED;
+			fprintf(OUTPUT_FILE, "[%d] badprogram %s, failed to start\n", i, PROC_INFO[i].argv[0]);
 		}
-		line_number++;
-		free(line);
-		line = read_next_line(fptr);
 	}
-	free(line);
-	free(out_pid);
-	fclose(fptr);
-	PIDS[index] = -1;//to indicate end of array
+	deps_break_cycles();
+	supervisor_wake();
+	for (int i = 0; PIDS[i] != -1; i++)
+		wait_started(i);
+	pthread_mutex_unlock(&PIDLOCK);
+	free_process_list(list);
 	return PIDS;
 }
 
@@ -935,19 +1588,17 @@ int get_cpu_usage(int pid)
 	char *part1 = "/proc/";
 	char *part2 = "/stat";
 
-	strncat(path, part1, 6);
+	strcat(path, part1);
 	char *str_pid = convert_int_to_string(pid);
 
 	strncat(path, str_pid, get_num_digits(pid));
 	free(str_pid);
-	strncat(path, part2, 5);
+	strcat(path, part2);
 	FILE *fptr = fopen(path, "r");
 
 	free(path);
-	if (fptr == NULL) {
-		fclose(fptr);
+	if (fptr == NULL)
 		return -1;
-	}
 	//Read until the usertime section of the file
 	// which is the 14th segment (after 13 spaces).
 	for (int i = 0; i < 13; i++) {
@@ -989,12 +1640,12 @@ int get_mem_usage(int pid)
 	char *part1 = "/proc/";
 	char *part2 = "/statm";
 
-	strncat(path, part1, 6);
+	strcat(path, part1);
 	char *str_pid = convert_int_to_string(pid);
 
 	strncat(path, str_pid, get_num_digits(pid));
 	free(str_pid);
-	strncat(path, part2, 6);
+	strcat(path, part2);
 	FILE *fptr = fopen(path, "r");
 
 	free(path);
@@ -1016,36 +1667,6 @@ int get_mem_usage(int pid)
 	return sum/1024;
 }
 
-/*
- * initialize_cpu_counters
- * description:
- *     creates an array with a size equal to the amount of processes.
- *     this array will contain the cpu usage of each process from the
- *     previous reporting cycle.
- * parameters:
- *     pids: list of process ids
- *     num_processes: the length of pids, the number of processes.
- * pre-conditions:
- *     pids is initialized.
- *     num_processes is the length of pids.
- * returns:
- *     list of integers containing the number of ticks each process
- *     has run on the cpu for. This list is in the same order as pids.
- *     so the processes at pids[i] will have run for counters[i] ticks.
- */
-int *initialize_cpu_counters(int *pids, int num_processes)
-{
-	int *counters = malloc(sizeof(int)*num_processes);
-
-	for (int i = 0; i < num_processes; i++) {
-		//get initial cpu usage
-		counters[i] = get_cpu_usage(pids[i]);
-		if (counters[i] < 0)
-			counters[i] = 0;
-	}
-	return counters;
-}
-
 /*
  * len_pids
  * description:
@@ -1070,10 +1691,71 @@ int len_pids(int *pids)
 	return len;
 }
 
+/*
+ * is_live
+ * description:
+ *     checks if the process of an entry is alive, as far as the supervisor knows.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     1 if the process hasn't been reaped yet, 0 otherwise.
+ */
+static int is_live(int index)
+{
+	int state = PROC_INFO[index].state;
+
+	return state == PROC_RUNNING || state == PROC_READY || state == PROC_STARTING;
+}
+
+/*
+ * wait_exits
+ * description:
+ *     waits for the supervisor to reap the processes being stopped.
+ * parameters:
+ *     stopping: for each entry of the table, non zero if its process is being stopped.
+ *     count: the number of entries in stopping.
+ *     ms: the longest time to wait, in ms.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of processes being stopped that are still alive.
+ */
+static int wait_exits(char *stopping, int count, int ms)
+{
+	struct timespec deadline;
+	int first = 0; //processes before first have all exited
+	int remaining;
+
+	//STATECOND waits on CLOCK_REALTIME.
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += ms / 1000;
+	deadline.tv_nsec += (ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	while (1) {
+		remaining = 0;
+		while (first < count && (stopping[first] == 0 || is_live(first) == 0))
+			first++;
+		for (int i = first; i < count; i++)
+			remaining += stopping[i] != 0 && is_live(i);
+		if (remaining == 0 || pthread_cond_timedwait(&STATECOND, &PIDLOCK, &deadline) == ETIMEDOUT)
+			break;
+	}
+	return remaining;
+}
+
 /*
  * terminate_program
  * description:
  *     terminates this process and all children processes.
+ *     every child is sent its stop signal at once, and the supervisor reaps
+ *     them as they exit while this waits for all of them together. The children
+ *     still alive after GRACE_MS are killed, so shutting down takes as long as
+ *     the slowest child instead of the sum of them.
  *     It then displays the final status for all children
  *     and the total runtime of the process.
  * parameters:
@@ -1087,28 +1769,63 @@ int len_pids(int *pids)
  */
 void terminate_program(int *pids, double elapsed_time)
 {
-	pthread_mutex_lock(&PIDLOCK);
+	stats_lock(&PIDLOCK);
+	pids = PIDS; //the table grows when processes are spawned or reloaded
+	SHUTTING_DOWN = 1;
 	fprintf(OUTPUT_FILE, "%s", "Terminating, ");
 	display_date();
-	int pid = pids[0];
-	int index = 0;
-
-	while (pid != -1) {
-		//check if process is still active
-		pid_t result = waitpid(pid, NULL, WNOHANG);
+	unsigned long begin = stats_now();
+	int count = len_pids(pids);
+	char *stopping = calloc(count+1, 1); //1 once sent its stop signal, 2 once killed
+	int stopped = 0;
+	int killed = 0;
+
+	for (int index = 0; index < count; index++) {
+		struct process_info *info = &PROC_INFO[index];
+
+		if (is_live(index)) {
+			kill(pids[index], info->stop_signal);
+			kill(pids[index], SIGCONT); //a throttled process only handles the signal once continued
+			stopping[index] = 1;
+			stopped++;
+		} else if (info->state == PROC_BACKOFF || info->state == PROC_WAITING) {
+			info->state = PROC_EXITED; //never restarted or created
+		}
+	}
+	//PIDLOCK is released while waiting, PIDS is read again after each wait.
+	if (stopped > 0 && wait_exits(stopping, count, GRACE_MS) > 0) {
+		for (int index = 0; index < count; index++) {
+			if (stopping[index] == 1 && is_live(index)) {
+				kill(PIDS[index], SIGKILL);
+				stopping[index] = 2;
+				killed++;
+			}
+		}
+		wait_exits(stopping, count, KILL_WAIT_MS);
+	}
+	for (int index = 0; index < count; index++) {
+		char description[32];
 
-		if (result == 0) {
-			fprintf(OUTPUT_FILE, "[%d] %s\n", index, "Terminated");
-			kill(pid, SIGKILL);
-		} else {
+		if (stopping[index] == 0) {
 			fprintf(OUTPUT_FILE, "[%d] %s\n", index, "Exited");
+			continue;
 		}
-		index++;
-		pid = pids[index];
+		if (is_live(index)) {
+			fprintf(OUTPUT_FILE, "[%d] %s\n", index, "Killed, not reaped");
+			continue;
+		}
+		describe_status(PROC_INFO[index].status, description);
+		if (stopping[index] == 2)
+			fprintf(OUTPUT_FILE, "[%d] Killed after %d ms (%s)\n", index, GRACE_MS, description);
+		else
+			fprintf(OUTPUT_FILE, "[%d] Terminated (%s)\n", index, description);
 	}
-	free(pids);
-	pthread_mutex_unlock(&PIDLOCK);
+	fprintf(OUTPUT_FILE, "Stopped %d processes in %lu ms, %d killed\n", stopped, (stats_now() - begin)/1000000, killed);
+	free(stopping);
+	//PIDLOCK stays held so no other thread touches the table before exit.
+	stats_dump(OUTPUT_FILE);
 	fprintf(OUTPUT_FILE, "Exiting (total time: %d seconds)\n", (int)(elapsed_time/1));
+	shm_close();
 	close_server();
 	exit(0);
 }
@@ -1137,7 +1854,8 @@ int check_timer(double current_time)
 /*
  * display_proc_state
  * description:
- *     displays the cpu usage and mem usage of a process.
+ *     displays the state, cpu usage and mem usage of a running process,
+ *     and the number of processes in its tree if it was sampled with its descendants.
  * parameters:
  *     index: the index of the process in the pids array.
  *     cpu: the percentage of time this process has spent on the cpu.
@@ -1147,14 +1865,192 @@ void display_proc_state(int index, int cpu, int mem)
 {
 	char percent = '%';
 
-	fprintf(OUTPUT_FILE, "[%d] Running, cpu usage: %d%c,", index, cpu, percent);
-	fprintf(OUTPUT_FILE, " mem usage: %d MB\n", mem);
+	char *state = PROC_INFO[index].state == PROC_READY ? "Ready" : "Running";
+
+	int tree = sample_size(index);
+
+	fprintf(OUTPUT_FILE, "[%d] %s, cpu usage: %d%c,", index, state, cpu, percent);
+	if (tree > 1)
+		fprintf(OUTPUT_FILE, " mem usage: %d MB, %d processes\n", mem, tree);
+	else
+		fprintf(OUTPUT_FILE, " mem usage: %d MB\n", mem);
+}
+
+/*
+ * display_counters
+ * description:
+ *     displays the storage io, context switches and run queue wait of a running process in the last report cycle.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ */
+void display_counters(int index)
+{
+	struct proc_counters *counters = &PROC_INFO[index].counters;
+
+	fprintf(OUTPUT_FILE, "[%d] storage: %llu KB read, %llu KB written, context switches: %llu voluntary, %llu involuntary, run queue wait: %llu ms\n",
+		index, counters->read_bytes/1024, counters->write_bytes/1024, counters->voluntary, counters->involuntary,
+		counters->wait_ns/1000000);
+}
+
+/*
+ * display_threads
+ * description:
+ *     displays the hottest threads of a process sampled with @threads on one line.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ */
+void display_threads(int index)
+{
+	struct process_info *info = &PROC_INFO[index];
+
+	if (info->thread_count == 0)
+		return;
+	fprintf(OUTPUT_FILE, "[%d] hot threads:", index);
+	for (int k = 0; k < info->thread_count; k++) {
+		struct thread_usage *thread = &info->threads[k];
+
+		fprintf(OUTPUT_FILE, "%s %s (%d) %d%%", k == 0 ? "" : ",", thread->name, thread->tid, thread->cpu);
+	}
+	fprintf(OUTPUT_FILE, "\n");
+}
+
+/*
+ * line_changed
+ * description:
+ *     checks if the line of a process in a report changed since it was last displayed.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ *     threshold: -1 for a normal report, where every line is displayed. For a
+ *                delta report, how far the cpu usage, in percent points, or the mem
+ *                usage, in percent of its last value, of a running process must move.
+ * returns:
+ *     1 if the line must be displayed, 0 otherwise.
+ */
+int line_changed(int index, int threshold)
+{
+	struct process_info *info = &PROC_INFO[index];
+
+	if (threshold == -1)
+		return 1;
+	if (info->shown_state != info->state || info->shown_pid != PIDS[index] || info->shown_removed != info->removed)
+		return 1;
+	if (info->state != PROC_RUNNING && info->state != PROC_READY)
+		return 0;
+	return abs(info->cpu - info->shown_cpu) > threshold || abs(info->mem - info->shown_mem)*100 > threshold*info->shown_mem;
+}
+
+/*
+ * line_shown
+ * description:
+ *     records the line of a process displayed in a report, for the next delta report.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ */
+void line_shown(int index)
+{
+	struct process_info *info = &PROC_INFO[index];
+
+	info->shown_state = info->state;
+	info->shown_pid = PIDS[index];
+	info->shown_removed = info->removed;
+	info->shown_cpu = info->cpu;
+	info->shown_mem = info->mem;
+}
+
+/*
+ * render_report
+ * description:
+ *     samples every running process and displays the body of a normal report,
+ *     or of a delta report, which only has the processes whose line changed
+ *     since they were last displayed.
+ * parameters:
+ *     pids: list of process ids
+ *     full_cpu_increase: the number of ticks of a process using a full cpu for a report period.
+ *     threshold: -1 for a normal report. For a delta report, how far the cpu usage,
+ *                in percent points, or the mem usage, in percent of its last value,
+ *                of a running process must move for it to be displayed.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     pids is terminated by a -1 element.
+ * returns:
+ *     1 if no process is running or waiting to be, 0 otherwise.
+ */
+int render_report(int *pids, int full_cpu_increase, int threshold)
+{
+	int done = 1;
+	int index = 0;
+	int unchanged = 0;
+
+	top_begin();
+	group_begin();
+	while (pids[index] != -1) {
+		struct process_info *info = &PROC_INFO[index];
+		int running = info->state == PROC_RUNNING || info->state == PROC_READY;
+
+		if (running) {
+			unsigned long before = stats_now();
+			int mem = 0;
+			int cpu = sample_process(index, &mem);
+			int cpu_percent = ((cpu - info->ticks)*100);
+
+			stats_record(STAT_SAMPLE, stats_now() - before);
+			cpu_percent = cpu_percent/full_cpu_increase;
+			info->ticks = cpu;
+			info->cpu = cpu_percent;
+			info->mem = mem;
+			for (int k = 0; k < info->thread_count; k++)
+				info->threads[k].cpu = info->threads[k].ticks*100/full_cpu_increase;
+		}
+		int show = line_changed(index, threshold);
+
+		if (show == 1)
+			line_shown(index);
+		else
+			unchanged++;
+		if (running) {
+			done = 0;
+			if (show == 1) {
+				display_proc_state(index, info->cpu, info->mem);
+				if (sample_counters_enabled() == 1)
+					display_counters(index);
+				display_threads(index);
+			}
+			group_sample(index);
+			rules_apply(index);
+			unsigned long dropped = output_dropped(index);
+			if (dropped > 0)
+				fprintf(OUTPUT_FILE, "[%d] log behind, %lu bytes of output not logged since the last report\n", index, dropped);
+		} else if (info->state == PROC_STARTING) {
+			done = 0;
+			if (show == 1)
+				fprintf(OUTPUT_FILE, "[%d] Starting\n", index);
+		} else if (info->state == PROC_BACKOFF) {
+			done = 0;
+			if (show == 1)
+				fprintf(OUTPUT_FILE, "[%d] Restarting\n", index);
+		} else if (info->state == PROC_WAITING) {
+			done = 0;
+			if (show == 1)
+				fprintf(OUTPUT_FILE, "[%d] Waiting\n", index);
+		} else if (show == 1) {
+			fprintf(OUTPUT_FILE, "[%d] %s\n", index, info->removed == 1 ? "Removed" : "Exited");
+		}
+		top_add(index, pids[index], info->state, info->cpu, info->mem);
+		index++;
+	}
+	if (threshold != -1)
+		fprintf(OUTPUT_FILE, "%d processes unchanged\n", unchanged);
+	top_commit();
+	top_report(OUTPUT_FILE);
+	group_report(OUTPUT_FILE);
+	return done;
 }
 
 /*
  * periodic_reports
  * description:
- *     displays the status of all processes every 5 seconds.
+ *     displays the status of all processes every 5 seconds. With -d every
+ *     report is a delta report, except one in KEYFRAME_REPORTS which is a normal report.
  * parameters:
  *     pids: list of process ids
  * pre-conditions:
@@ -1163,50 +2059,50 @@ void display_proc_state(int index, int cpu, int mem)
  */
 void periodic_reports(int *pids)
 {
-	int *counters = initialize_cpu_counters(pids, len_pids(pids));
 	int full_cpu_increase = 5*sysconf(_SC_CLK_TCK);
+	unsigned long period = 5000000000UL;
+	//reports are scheduled on the monotonic clock, how late each one starts is recorded as jitter.
+	unsigned long next_report = stats_now();
+	int reports = 0;
 
 	while (1) {
-		int done = 1;
-		int index = 0;
+		unsigned long cycle = stats_now();
+		//a delta report only makes sense after a normal one, which the first report always is.
+		int delta = DELTA_THRESHOLD != -1 && reports++ % KEYFRAME_REPORTS != 0;
 
+		stats_record(STAT_JITTER, cycle - next_report);
 		fprintf(OUTPUT_FILE, "%s\n", "...");
-		fprintf(OUTPUT_FILE, "%s", "Normal report, ");
+		fprintf(OUTPUT_FILE, "%s", delta ? "Delta report, " : "Normal report, ");
 		display_date();
-		pthread_mutex_lock(&PIDLOCK);
-		while (pids[index] != -1) {
-			pid_t result = waitpid(pids[index], NULL, WNOHANG);
-
-			if (result == 0) {
-				int cpu = get_cpu_usage(pids[index]);
-				int cpu_percent = ((cpu - counters[index])*100);
-				int mem = get_mem_usage(pids[index]);
-
-				cpu_percent = cpu_percent/full_cpu_increase;
-				counters[index] = cpu;
-				done = 0;
-				display_proc_state(index, cpu_percent, mem);
-			} else {
-				fprintf(OUTPUT_FILE, "[%d] Exited\n", index);
-			}
-			index++;
-		}
+		stats_lock(&PIDLOCK);
+		pids = PIDS; //the table grows when processes are spawned or reloaded
+		int done = render_report(pids, full_cpu_increase, delta ? DELTA_THRESHOLD : -1);
+
+		shm_publish(pids);
+		sched_rebalance(pids);
 		pthread_mutex_unlock(&PIDLOCK);
+		stats_record(STAT_REPORT, stats_now() - cycle);
 		if (done == 1) {
 			double current_time = time(NULL);
 			int total_time = (int)(current_time - START_TIME);
 
 			fprintf(OUTPUT_FILE, "Exiting (total time: %d seconds)\n...\n", total_time);
+			shm_close();
 			exit(0);
 		}
 		fprintf(OUTPUT_FILE, "%s\n", "...");
-		double t = time(NULL);
-		double current_time = t;
+		next_report += period;
+		unsigned long now = stats_now();
+
+		while (now < next_report) {
+			unsigned long remaining = (next_report - now)/1000;
+
+			usleep(remaining < 100000 ? remaining : 100000);
+			double current_time = time(NULL);
 
-		while (current_time - t < 5) {
-			current_time = time(NULL);
 			if (check_timer(current_time) == 1)
 				terminate_program(pids, current_time - START_TIME);
+			now = stats_now();
 		}
 	}
 }
@@ -1214,7 +2110,7 @@ void periodic_reports(int *pids)
 /*
  * sig_handler
  * description:
- *     called when SIGINT is passed to the process
+ *     called when SIGINT or SIGTERM is passed to the process
  *     sets KILL_STATE to 1 which tells the process to terminate
  *     itself and its children.
  * parameters:
@@ -1229,7 +2125,7 @@ void sig_handler(int sig)
 /*
  * register_handler
  * description:
- *     registers this program to react to the SIGINT signal
+ *     registers this program to react to the SIGINT and SIGTERM signals
  */
 void register_handler(void)
 {
@@ -1238,6 +2134,6 @@ void register_handler(void)
 	memset(&sa, 0, sizeof(sa));
 	sa.sa_flags = 0;
 	sa.sa_handler = sig_handler;
-	if (sigaction(SIGINT, &sa, NULL) == -1)
+	if (sigaction(SIGINT, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1)
 		err(1, "sigaction error");
 }
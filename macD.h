@@ -1,58 +1,278 @@
+//states of an entry in the process table.
+#define PROC_EXITED 0 //not running and won't be restarted
+#define PROC_STARTING 1 //created, waiting for its start check
+#define PROC_RUNNING 2
+#define PROC_BACKOFF 3 //exited, waiting to be restarted
+#define PROC_WAITING 4 //not created yet, waiting for its dependencies
+#define PROC_READY 5 //running, its readiness probe passed
+
+//wait status of a process whose exit wasn't waited on, an adopted process.
+#define STATUS_UNKNOWN -1
+
+//longest group name, including the terminating null.
+#define MAX_GROUP_LENGTH 32
+//longest name given with @name, including the terminating null.
+#define MAX_NAME_LENGTH 32
+//most threads @threads can report for a process.
+#define MAX_HOT_THREADS 64
+//length of a thread name, including the terminating null.
+#define THREAD_NAME_LENGTH 16
+
+//restart policies.
+#define RESTART_NEVER 0
+#define RESTART_ON_FAILURE 1
+#define RESTART_ALWAYS 2
+
+/*
+ * dependency
+ * description:
+ *     an entry of the process table that another one starts after.
+ */
+struct dependency {
+	int index; //index of the entry depended on
+	int required; //1 if the dependent fails when the entry exits, 0 if it only starts after it
+};
+
+/*
+ * proc_counters
+ * description:
+ *     the counters of a process read with -I from /proc/[pid]/io, status and schedstat.
+ *     the context switches and the wait are those of the main thread, or of every thread with @threads.
+ */
+struct proc_counters {
+	unsigned long long read_bytes; //bytes fetched from the storage, reads served by the page cache aren't counted
+	unsigned long long write_bytes; //bytes sent to the storage, or dirtied in the page cache to be written
+	unsigned long long voluntary; //context switches to wait for a resource
+	unsigned long long involuntary; //context switches forced by the scheduler
+	unsigned long long wait_ns; //time spent waiting on a run queue
+};
+
+/*
+ * thread_usage
+ * description:
+ *     the cpu usage of a thread of a process sampled with @threads.
+ */
+struct thread_usage {
+	int tid;
+	char name[THREAD_NAME_LENGTH];
+	int ticks; //cpu ticks used by the thread in the last report cycle
+	int cpu; //cpu usage, as a percent, in the last report cycle
+};
+
+/*
+ * process_info
+ * description:
+ *     bookkeeping kept for every entry in the process table.
+ *     PROC_INFO[i] describes the process whose pid is PIDS[i].
+ */
+struct process_info {
+	char **argv; //arguments used to start the process, without directives, packed with pack_args
+	char *source; //arguments of the line the entry was created from, directives included, NULL if none
+	int source_len; //length of source, the arguments are separated by null characters
+	char group[MAX_GROUP_LENGTH]; //group the process belongs to, empty if none
+	int group_id; //id of the group in macD_group, -1 if none
+	char name[MAX_NAME_LENGTH]; //name other entries use to depend on this one, empty if none
+	char *after; //names given with @after, separated by commas, until they are resolved
+	char *requires; //names given with @requires, separated by commas, until they are resolved
+	struct dependency *deps; //entries to wait for before the process is created
+	int dep_count;
+	char *probe; //readiness probe given with @ready, ie "tcp:8080", NULL if none
+	int probe_timeout; //ms the probe may take before the process is given up on
+	int stop_signal; //signal sent to the process when macD shuts down
+	int state;
+	int status; //wait status of the last exit
+	int ticks; //cpu ticks used by the process at the last report cycle
+	int cpu; //cpu usage, as a percent, in the last report cycle. -1 if not running
+	int mem; //memory usage, in MB, in the last report cycle.
+	int shown_state; //state in the last report line of the process, -1 if it wasn't reported yet
+	int shown_pid; //pid, removed, cpu and mem in the last report line
+	int shown_removed;
+	int shown_cpu;
+	int shown_mem;
+	struct proc_counters counters; //growth of the counters in the last report cycle
+	int hot_threads; //threads reported with @threads, 0 if the threads aren't sampled
+	struct thread_usage *threads; //hottest threads in the last report cycle, hottest first
+	int thread_count; //number of threads in threads
+	int unit; //placement unit the process is bound to, -1 if not bound
+	int restart; //restart policy
+	int backoff; //delay, in ms, before the first restart of a crash loop
+	int max_restarts; //quick restarts in a row allowed before giving up
+	int failures; //quick exits in a row
+	int restarts; //number of times the process was restarted
+	int restarting; //1 while the process is being restarted
+	int stopped; //1 if the process was killed on request, it won't be restarted
+	int forced; //1 if a rule killed the process to restart it, whatever its restart policy
+	int removed; //1 if the line of the process was removed from the process list file
+	int spawned; //1 if the entry was created with SPWN, its line isn't in the process list file
+	int announce; //1 if the supervisor reports the result of the start check
+	struct timespec started; //when the process was last created
+	struct timespec deadline; //when the pending start check or restart is due
+};
+
+extern int *PIDS;
+extern struct process_info *PROC_INFO;
+extern FILE *OUTPUT_FILE;
+extern int SHUTTING_DOWN;
+extern int GRACE_MS;
+extern char *SOCKET_PATH;
+extern pthread_mutex_t PIDLOCK;
+extern pthread_cond_t STATECOND;
+
 /*
- * get_num_args
+ * exec_process
  * description:
- *     counts the number of arguments in a given line of text
- *     assuming this line is from the process list file.
- *     counts the number of spaces in the line and uses this
- *     to determin the number of args.
+ *     replaces the calling process, a newly forked child, with the
+ *     process indicated by argv.
  * parameters:
- *     line: a string of the command to count the args of
- * pre-condition:
- *    line is initialized.
+ *     argv: arguments of the process to execute, terminated by NULL.
+ *     quite_mode: 1 if the output of the process should be muted
+ *     unit: placement unit to bind the process to, -1 to leave it unbound.
+ *     err_fd: file descriptor to write errno to if exec fails, -1 for none.
+ *     out_fd: file descriptor to use as stdout and stderr, -1 to keep macD's.
+ *     notify_fd: file descriptor to hand to the process as PROBE_NOTIFY_FD, -1 for none.
+ * pre-conditions:
+ *     argv is initialized.
+ * post-conditions:
+ *     this process is replaced, or exits if exec fails.
+ */
+void exec_process(char **argv, int quite_mode, int unit, int err_fd, int out_fd, int notify_fd);
+
+/*
+ * create_process
+ * description:
+ *     creates a new process using the fork function, or through the
+ *     zygote if it is running.
+ *     changes the process to the process indicated by argv.
+ *     the new process is waited on by the supervisor.
+ * parameters:
+ *     argv: arguments of the process to create, packed with pack_args.
+ *     out_pid: pointer to store the pid of the new process to,
+ *              set to -1 if the process couldn't be created.
+ *     quite_mode: 1 if the output of the process should be muted
+ *     unit: placement unit to bind the process to, -1 to leave it unbound.
+ *     out_fd: file descriptor to use as stdout and stderr, -1 to keep macD's.
+ *     notify_fd: file descriptor to hand to the process as PROBE_NOTIFY_FD, -1 for none.
+ * pre-conditions:
+ *     argv is initialized.
+ */
+void create_process(char **argv, int *out_pid, int quite_mode, int unit, int out_fd, int notify_fd);
+
+/*
+ * init_process_info
+ * description:
+ *     sets every field of info to its default value.
+ * parameters:
+ *     info: the process_info to initialize.
+ */
+void init_process_info(struct process_info *info);
+
+/*
+ * parse_directive
+ * description:
+ *     applies a single directive of the form key=value to info.
+ * parameters:
+ *     directive: the directive, without the leading '@'.
+ *     info: the process_info to apply the directive to.
  * returns:
- *     number of args in line.
+ *     0 if the directive is valid, -1 otherwise.
  */
-int get_num_args(char *line);
+int parse_directive(char *directive, struct process_info *info);
 
 /*
- * get_args
+ * free_directives
  * description:
- *     creates a list of strings containing the arguments
- *     of the given line, which represents a process from the process list file.
+ *     frees what the directives of info allocated.
  * parameters:
- *     line: a string of the command to get the args of
+ *     info: the process_info.
+ */
+void free_directives(struct process_info *info);
+
+/*
+ * parse_directives
+ * description:
+ *     reads the directives at the start of a line from the process list file.
+ *     directives are arguments starting with '@', ie "@restart=always ./worker".
+ * parameters:
+ *     argv: the arguments of the line, terminated by NULL.
+ *     info: the process_info to initialize and apply the directives to.
  * pre-condition:
- *     line is initialized.
+ *     argv is initialized.
  * returns:
- *     list of strings each element is an argument.
+ *     pointer to the arguments of the command that follow the directives,
+ *     or NULL if one of the directives is invalid or no command follows them.
  */
-char **get_args(char *line);
+char **parse_directives(char **argv, struct process_info *info);
 
 /*
- * create_process
+ * start_process
+ * description:
+ *     creates the process of the entry at index in the process table
+ *     and starts its start check.
+ * parameters:
+ *     index: index of the entry in PIDS and PROC_INFO.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     0 if the process was created, -1 otherwise.
+ */
+int start_process(int index);
+
+/*
+ * add_entry
+ * description:
+ *     appends a new entry to the process table without creating its process.
+ *     the entry takes over the dependency names of info.
+ * parameters:
+ *     argv: the arguments of the process, without directives.
+ *     info: the options of the process, read from its directives.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     argv is initialized.
+ * returns:
+ *     the index of the new entry.
+ */
+int add_entry(char **argv, struct process_info *info);
+
+/*
+ * add_process
  * description:
- *     creates a new process using the fork function.
- *     changes the process to the process indicated by process_path.
- *     terminates any failed forks.
+ *     appends a new entry to the process table and creates its process, or
+ *     leaves it waiting if its dependencies aren't up yet.
  * parameters:
- *     process_path: string containing path to the process to create.
+ *     argv: the arguments of the process, without directives.
+ *     info: the options of the process, read from its directives.
  * pre-conditions:
- *     process_path is initialized.
+ *     argv is initialized.
+ * returns:
+ *     the index of the new entry, or -1 if the process couldn't be created,
+ *     one of its dependencies doesn't exist or has exited, or macD is shutting down.
  */
-void create_process(char *process_line, int *out_pid, int quite_mode);
+int add_process(char **argv, struct process_info *info);
 
 /*
- * read_next_line
+ * drop_process
  * description:
- *     reads the next line in the given file object
+ *     removes the entry at index from the process table if it is the last one.
+ *     the table is left as is once macD is shutting down.
  * parameters:
- *     fptr: pointer to the FILE object to read from.
+ *     index: index of the entry to remove.
  * pre-conditions:
- *     fptr is initialized and is a valid FILE object
+ *     PIDLOCK is held.
+ */
+void drop_process(int index);
+
+/*
+ * wait_started
+ * description:
+ *     waits for the dependencies and the start check of the process at index to complete.
+ * parameters:
+ *     index: index of the process in PIDS.
+ * pre-conditions:
+ *     PIDLOCK is held.
  * returns:
- *     char array, string, containing the next line of the file.
+ *     0 if the process passed its start check, -1 if it exited.
  */
-char *read_next_line(FILE *fptr);
+int wait_started(int index);
 
 /*
  * convert_str_to_int
@@ -75,12 +295,12 @@ int convert_str_to_int(char *str);
  *     if the line is in the form "timelimit [integer]" then
  *     [integer] is returned.
  * parameters:
- *     line: line to check if its a timer.
+ *     argv: the arguments of the line to check, terminated by NULL.
  * returns:
  *     the value of the time limit if the given line is a timer.
  *     -1 otherwise.
  */
-int read_timer(char *line);
+int read_timer(char **argv);
 
 /*
  * get_month
@@ -212,25 +432,6 @@ int get_cpu_usage(int pid);
  */
 int get_mem_usage(int pid);
 
-/*
- * initialize_cpu_counters
- * description:
- *     creates an array with a size equal to the amount of processes.
- *     this array will contain the cpu usage of each process from the
- *     previous reporting cycle.
- * parameters:
- *     pids: list of process ids
- *     num_processes: the length of pids, the number of processes.
- * pre-conditions:
- *     pids is initialized.
- *     num_processes is the length of pids.
- * returns:
- *     list of integers containing the number of ticks each process
- *     has run on the cpu for. This list is in the same order as pids.
- *     so the processes at pids[i] will have run for counters[i] ticks.
- */
-int *initialize_cpu_counters(int *pids, int num_processes);
-
 /*
  * len_pids
  * description:
@@ -250,6 +451,8 @@ int len_pids(int *pids);
  * terminate_program
  * description:
  *     terminates this process and all children processes.
+ *     every child is sent its stop signal at once and given GRACE_MS
+ *     to exit before it is killed.
  *     It then displays the final status for all children
  *     and the total runtime of the process.
  * parameters:
@@ -280,7 +483,8 @@ int check_timer(double current_time);
 /*
  * display_proc_state
  * description:
- *     displays the cpu usage and mem usage of a process.
+ *     displays the state, cpu usage and mem usage of a running process,
+ *     and the number of processes in its tree if it was sampled with its descendants.
  * parameters:
  *     index: the index of the process in the pids array.
  *     cpu: the percentage of time this process has spent on the cpu.
@@ -288,10 +492,72 @@ int check_timer(double current_time);
  */
 void display_proc_state(int index, int cpu, int mem);
 
+/*
+ * display_counters
+ * description:
+ *     displays the storage io, context switches and run queue wait of a running process in the last report cycle.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ */
+void display_counters(int index);
+
+/*
+ * display_threads
+ * description:
+ *     displays the hottest threads of a process sampled with @threads on one line.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ */
+void display_threads(int index);
+
+/*
+ * line_changed
+ * description:
+ *     checks if the line of a process in a report changed since it was last displayed.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ *     threshold: -1 for a normal report, where every line is displayed. For a
+ *                delta report, how far the cpu usage, in percent points, or the mem
+ *                usage, in percent of its last value, of a running process must move.
+ * returns:
+ *     1 if the line must be displayed, 0 otherwise.
+ */
+int line_changed(int index, int threshold);
+
+/*
+ * line_shown
+ * description:
+ *     records the line of a process displayed in a report, for the next delta report.
+ * parameters:
+ *     index: the index of the process in the pids array.
+ */
+void line_shown(int index);
+
+/*
+ * render_report
+ * description:
+ *     samples every running process and displays the body of a normal report,
+ *     or of a delta report, which only has the processes whose line changed
+ *     since they were last displayed.
+ * parameters:
+ *     pids: list of process ids
+ *     full_cpu_increase: the number of ticks of a process using a full cpu for a report period.
+ *     threshold: -1 for a normal report. For a delta report, how far the cpu usage,
+ *                in percent points, or the mem usage, in percent of its last value,
+ *                of a running process must move for it to be displayed.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     pids is terminated by a -1 element.
+ * returns:
+ *     1 if no process is running or waiting to be, 0 otherwise.
+ */
+int render_report(int *pids, int full_cpu_increase, int threshold);
+
 /*
  * periodic_reports
  * description:
- *     displays the status of all processes every 5 seconds.
+ *     displays the status of all processes every 5 seconds. With -d every
+ *     report is a delta report, except one in KEYFRAME_REPORTS which is a normal report.
  * parameters:
  *     pids: list of process ids
  * pre-conditions:
@@ -303,7 +569,7 @@ void periodic_reports(int *pids);
 /*
  * sig_handler
  * description:
- *     called when SIGINT is passed to the process
+ *     called when SIGINT or SIGTERM is passed to the process
  *     sets KILL_STATE to 1 which tells the process to terminate
  *     itself and its children.
  * parameters:
@@ -314,7 +580,7 @@ void sig_handler(int sig);
 /*
  * register_handler
  * description:
- *     registers this program to react to the SIGINT signal
+ *     registers this program to react to the SIGINT and SIGTERM signals
  */
 void register_handler(void);
 
@@ -330,6 +596,20 @@ void register_handler(void);
  */
 char *kill_process(int index);
 
+/*
+ * stop_process
+ * description:
+ *    terminates the process at index on request, it won't be restarted.
+ *    a process waiting to be restarted is not restarted.
+ * parameters:
+ *    index: the index of the process, which must be in the process table.
+ * pre-conditions:
+ *    PIDLOCK is held.
+ * returns:
+ *    1 if the process was terminated or its restart cancelled, 0 if it had already exited.
+ */
+int stop_process(int index);
+
 /*
  * get_num_running
  * description:
@@ -0,0 +1,377 @@
+/*
+ * macD_batch
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the batch mode of macD_c, used by scripts. The commands are read from
+ *     the command line or a file and all sent over one connection without
+ *     waiting for the replies in between. The server answers the commands of a
+ *     connection in order, so the replies are then read back one by one and
+ *     printed in a format that is easy to parse.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "macD_c.h"
+#include "macD_batch.h"
+
+struct batch_command *BATCH = NULL;
+int BATCH_LEN = 0;
+int BATCH_SOCK = -1;
+
+/*
+ * parse_batch_command
+ * description:
+ *     parses a line of a batch into a command. The name is not case sensitive.
+ * parameters:
+ *     text: the line to parse, modified in place.
+ *     command: the command to fill, its line points into text.
+ * returns:
+ *     0 if the line is a valid command, -1 otherwise.
+ */
+int parse_batch_command(char *text, struct batch_command *command)
+{
+	text += strspn(text, " \t");
+	int len = strcspn(text, " \t");
+	char *arg = text + len;
+
+	arg += strspn(arg, " \t");
+	if (len != 4)
+		return -1;
+	memcpy(command->name, text, 4);
+	command->name[4] = '\0';
+	str_lower(command->name);
+	command->line = NULL;
+	command->index = 0;
+	if (strcmp(command->name, "stat") == 0 || strcmp(command->name, "perf") == 0 || strcmp(command->name, "topk") == 0)
+		return arg[0] == '\0' ? 0 : -1;
+	if (strcmp(command->name, "kill") == 0 || strcmp(command->name, "tail") == 0 ||
+	    strcmp(command->name, "thrd") == 0 || strcmp(command->name, "proc") == 0) {
+		char *end;
+
+		command->index = strtol(arg, &end, 10);
+		return end != arg && *end == '\0' ? 0 : -1;
+	}
+	if (strcmp(command->name, "spwn") == 0) {
+		command->line = arg;
+		return arg[0] == '\0' ? -1 : 0;
+	}
+	if (strcmp(command->name, "gsta") == 0 || strcmp(command->name, "gkil") == 0 || strcmp(command->name, "gtal") == 0) {
+		command->line = arg;
+		return arg[0] == '\0' || arg[strcspn(arg, " \t")] != '\0' ? -1 : 0;
+	}
+	return -1;
+}
+
+/*
+ * add_command
+ * description:
+ *     parses a line and appends it to the batch. empty lines and
+ *     lines starting with '#' are skipped.
+ * parameters:
+ *     line: the line to add.
+ * returns:
+ *     0 if the line was added or skipped, -1 if it is not a valid command.
+ */
+static int add_command(char *line)
+{
+	char *text = strdup(line);
+	int len = strlen(text);
+
+	while (len > 0 && isspace((unsigned char)text[len-1]))
+		text[--len] = '\0';
+	char *start = text + strspn(text, " \t");
+
+	if (start[0] == '\0' || start[0] == '#') {
+		free(text);
+		return 0;
+	}
+	BATCH = realloc(BATCH, sizeof(struct batch_command)*(BATCH_LEN+1));
+	if (parse_batch_command(text, &BATCH[BATCH_LEN]) == -1) {
+		fprintf(stderr, "invalid command: %s\n", start);
+		free(text);
+		return -1;
+	}
+	BATCH[BATCH_LEN].text = text;
+	BATCH_LEN++;
+	return 0;
+}
+
+/*
+ * free_batch
+ * description:
+ *     frees every command of the batch.
+ */
+static void free_batch(void)
+{
+	for (int i = 0; i < BATCH_LEN; i++)
+		free(BATCH[i].text);
+	free(BATCH);
+	BATCH = NULL;
+	BATCH_LEN = 0;
+}
+
+/*
+ * send_all
+ * description:
+ *     sends exactly len bytes to the server.
+ * parameters:
+ *     buffer: the bytes to send.
+ *     len: the number of bytes to send.
+ * returns:
+ *     0 if every byte was sent, -1 otherwise.
+ */
+static int send_all(void *buffer, int len)
+{
+	char *ptr = buffer;
+
+	while (len > 0) {
+		int rc = send(BATCH_SOCK, ptr, len, MSG_NOSIGNAL);
+
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			return -1;
+		ptr += rc;
+		len -= rc;
+	}
+	return 0;
+}
+
+/*
+ * batch_sender
+ * description:
+ *     the thread function that sends every command of the batch, without
+ *     waiting for replies, then shuts down the sending side of the connection.
+ * parameters:
+ *     vargp: unused.
+ */
+void *batch_sender(void *vargp)
+{
+	for (int i = 0; i < BATCH_LEN; i++) {
+		struct batch_command *command = &BATCH[i];
+		int rc = send_all(command->name, 4);
+
+		if (rc == 0 && (strcmp(command->name, "kill") == 0 || strcmp(command->name, "tail") == 0 ||
+				strcmp(command->name, "thrd") == 0 || strcmp(command->name, "proc") == 0)) {
+			rc = send_all(&command->index, sizeof(int));
+		} else if (rc == 0 && command->line != NULL) {
+			int len = strlen(command->line);
+
+			rc = send_all(&len, sizeof(int));
+			if (rc == 0)
+				rc = send_all(command->line, len);
+		}
+		if (rc == -1)
+			break; //the reader notices the lost connection
+	}
+	shutdown(BATCH_SOCK, SHUT_WR);
+	return NULL;
+}
+
+/*
+ * recv_exact
+ * description:
+ *     receives exactly len bytes from the server.
+ * parameters:
+ *     buffer: where to store the bytes.
+ *     len: the number of bytes to receive.
+ * returns:
+ *     0 if len bytes were received, -1 if the connection was lost.
+ */
+static int recv_exact(void *buffer, int len)
+{
+	if (len == 0)
+		return 0;
+	return recv(BATCH_SOCK, buffer, len, MSG_WAITALL) == len ? 0 : -1;
+}
+
+/*
+ * print_reply
+ * description:
+ *     reads the reply to a command and prints it.
+ * parameters:
+ *     n: the position of the command in the batch.
+ *     command: the command the reply answers.
+ * returns:
+ *     0 if the command succeeded, 1 if it failed, -1 if the connection was lost.
+ */
+static int print_reply(int n, struct batch_command *command)
+{
+	int values[2];
+
+	if (strcmp(command->name, "stat") == 0) {
+		if (recv_exact(values, sizeof(int)) == -1)
+			return -1;
+		printf("[%d] stat ok running=%d\n", n, values[0]);
+		return 0;
+	}
+	if (strcmp(command->name, "kill") == 0) {
+		char reply[5];
+
+		if (recv_exact(reply, 4) == -1)
+			return -1;
+		reply[4] = '\0';
+		int ok = strcmp(reply, "SUCC") == 0;
+
+		printf("[%d] kill %s index=%d\n", n, ok ? "ok" : "fail", command->index);
+		return ok ? 0 : 1;
+	}
+	if (strcmp(command->name, "gkil") == 0) {
+		if (recv_exact(values, sizeof(int)) == -1)
+			return -1;
+		if (values[0] == -1) {
+			printf("[%d] gkil fail group=%s\n", n, command->line);
+			return 1;
+		}
+		printf("[%d] gkil ok group=%s killed=%d\n", n, command->line, values[0]);
+		return 0;
+	}
+	if (strcmp(command->name, "spwn") == 0) {
+		if (recv_exact(values, sizeof(values)) == -1)
+			return -1;
+		if (values[0] == -1) {
+			printf("[%d] spwn fail\n", n);
+			return 1;
+		}
+		printf("[%d] spwn ok index=%d pid=%d\n", n, values[0], values[1]);
+		return 0;
+	}
+	//perf, tail, thrd, proc, topk, gsta and gtal, the length of the text then the text
+	if (recv_exact(values, sizeof(int)) == -1 || values[0] < -1)
+		return -1;
+	if (values[0] == -1) {
+		if (strcmp(command->name, "tail") == 0 || strcmp(command->name, "thrd") == 0 || strcmp(command->name, "proc") == 0)
+			printf("[%d] %s fail index=%d\n", n, command->name, command->index);
+		else if (command->line != NULL)
+			printf("[%d] %s fail group=%s\n", n, command->name, command->line);
+		else
+			return -1;
+		return 1;
+	}
+	char *text = malloc(values[0]+1);
+
+	if (recv_exact(text, values[0]) == -1) {
+		free(text);
+		return -1;
+	}
+	text[values[0]] = '\0';
+	int lines = 0;
+
+	for (int i = 0; i < values[0]; i++)
+		lines += text[i] == '\n';
+	if (strcmp(command->name, "tail") == 0) {
+		//the output doesn't always end with a newline, one is added so the next reply starts on its own line.
+		int newline = values[0] > 0 && text[values[0]-1] != '\n';
+
+		printf("[%d] tail ok index=%d bytes=%d lines=%d\n%s%s", n, command->index, values[0],
+			lines + newline, text, newline ? "\n" : "");
+	} else if (strcmp(command->name, "thrd") == 0) {
+		printf("[%d] thrd ok index=%d lines=%d\n%s", n, command->index, lines, text);
+	} else if (strcmp(command->name, "proc") == 0) {
+		printf("[%d] proc ok %s", n, text);
+	} else if (strcmp(command->name, "gtal") == 0) {
+		printf("[%d] gtal ok group=%s bytes=%d lines=%d\n%s", n, command->line, values[0], lines, text);
+	} else if (strcmp(command->name, "gsta") == 0) {
+		printf("[%d] gsta ok group=%s lines=%d\n%s", n, command->line, lines, text);
+	} else {
+		printf("[%d] %s ok lines=%d\n%s", n, command->name, lines, text);
+	}
+	free(text);
+	return 0;
+}
+
+/*
+ * run_batch
+ * description:
+ *     sends the commands given on the command line and in file over one
+ *     connection, then prints one line per reply to stdout, in order:
+ *         [n] stat ok running=[count]
+ *         [n] kill ok index=[index] | [n] kill fail index=[index]
+ *         [n] spwn ok index=[index] pid=[pid] | [n] spwn fail
+ *         [n] perf ok lines=[count], followed by the lines of the statistics
+ *         [n] tail ok index=[index] bytes=[count] lines=[count], followed by the lines of output
+ *         | [n] tail fail index=[index]
+ *         [n] thrd ok index=[index] lines=[count], followed by the hottest threads of the process
+ *         | [n] thrd fail index=[index]
+ *         [n] proc ok index=[index] pid=[pid] cpu=[percent] ..., the usage of the process | [n] proc fail index=[index]
+ *         [n] topk ok lines=[count], followed by the fleet totals and rankings
+ *         [n] gsta ok group=[name] lines=[count], followed by the state of the group
+ *         | [n] gsta fail group=[name]
+ *         [n] gkil ok group=[name] killed=[count] | [n] gkil fail group=[name]
+ *         [n] gtal ok group=[name] bytes=[count] lines=[count], followed by the output of the group
+ *         | [n] gtal fail group=[name]
+ * parameters:
+ *     commands: the commands given on the command line.
+ *     count: the number of commands.
+ *     file: file to read more commands from, one per line, "-" for stdin, or NULL.
+ * returns:
+ *     0 if every command succeeded, 1 if a command failed,
+ *     2 if the commands were invalid or the connection was lost.
+ */
+int run_batch(char **commands, int count, char *file)
+{
+	int status = 0;
+
+	for (int i = 0; i < count && status == 0; i++) {
+		if (add_command(commands[i]) == -1)
+			status = 2;
+	}
+	if (file != NULL && status == 0) {
+		FILE *fptr = strcmp(file, "-") == 0 ? stdin : fopen(file, "r");
+		char *line = NULL;
+		size_t size = 0;
+
+		if (fptr == NULL) {
+			fprintf(stderr, "couldn't open %s\n", file);
+			status = 2;
+		}
+		while (status == 0 && getline(&line, &size, fptr) != -1) {
+			if (add_command(line) == -1)
+				status = 2;
+		}
+		free(line);
+		if (fptr != NULL && fptr != stdin)
+			fclose(fptr);
+	}
+	if (status == 0) {
+		BATCH_SOCK = connect_server();
+		if (BATCH_SOCK == -1) {
+			fprintf(stderr, "couldn't connect to macD: %s\n", strerror(errno));
+			status = 2;
+		}
+	}
+	if (status != 0) {
+		free_batch();
+		return status;
+	}
+	pthread_t sender;
+
+	//replies are read while the commands are still being sent, so neither side blocks on a full socket.
+	pthread_create(&sender, NULL, batch_sender, NULL);
+	for (int i = 0; i < BATCH_LEN; i++) {
+		int rc = print_reply(i, &BATCH[i]);
+
+		if (rc == -1) {
+			fprintf(stderr, "connection to macD lost after %d of %d replies\n", i, BATCH_LEN);
+			status = 2;
+			break;
+		}
+		if (rc == 1)
+			status = 1;
+	}
+	fflush(stdout);
+	shutdown(BATCH_SOCK, SHUT_RDWR);
+	pthread_join(sender, NULL);
+	close(BATCH_SOCK);
+	free_batch();
+	return status;
+}
@@ -0,0 +1,63 @@
+/*
+ * batch_command
+ * description:
+ *     a command of a batch, parsed from a line such as "kill 3" or "spwn ./worker -v".
+ */
+struct batch_command {
+	char name[5]; //stat, kill, spwn, perf, tail, thrd, proc, topk, gsta, gkil or gtal
+	int index; //index of a kill, tail, thrd or proc command
+	char *line; //line of a spwn command or group of a group command, points into text
+	char *text; //copy of the line the command was parsed from
+};
+
+/*
+ * parse_batch_command
+ * description:
+ *     parses a line of a batch into a command. The name is not case sensitive.
+ * parameters:
+ *     text: the line to parse, modified in place.
+ *     command: the command to fill, its line points into text.
+ * returns:
+ *     0 if the line is a valid command, -1 otherwise.
+ */
+int parse_batch_command(char *text, struct batch_command *command);
+
+/*
+ * batch_sender
+ * description:
+ *     the thread function that sends every command of the batch, without
+ *     waiting for replies, then shuts down the sending side of the connection.
+ * parameters:
+ *     vargp: unused.
+ */
+void *batch_sender(void *vargp);
+
+/*
+ * run_batch
+ * description:
+ *     sends the commands given on the command line and in file over one
+ *     connection, then prints one line per reply to stdout, in order:
+ *         [n] stat ok running=[count]
+ *         [n] kill ok index=[index] | [n] kill fail index=[index]
+ *         [n] spwn ok index=[index] pid=[pid] | [n] spwn fail
+ *         [n] perf ok lines=[count], followed by the lines of the statistics
+ *         [n] tail ok index=[index] bytes=[count] lines=[count], followed by the lines of output
+ *         | [n] tail fail index=[index]
+ *         [n] thrd ok index=[index] lines=[count], followed by the hottest threads of the process
+ *         | [n] thrd fail index=[index]
+ *         [n] proc ok index=[index] pid=[pid] cpu=[percent] ..., the usage of the process | [n] proc fail index=[index]
+ *         [n] topk ok lines=[count], followed by the fleet totals and rankings
+ *         [n] gsta ok group=[name] lines=[count], followed by the state of the group
+ *         | [n] gsta fail group=[name]
+ *         [n] gkil ok group=[name] killed=[count] | [n] gkil fail group=[name]
+ *         [n] gtal ok group=[name] bytes=[count] lines=[count], followed by the output of the group
+ *         | [n] gtal fail group=[name]
+ * parameters:
+ *     commands: the commands given on the command line.
+ *     count: the number of commands.
+ *     file: file to read more commands from, one per line, "-" for stdin, or NULL.
+ * returns:
+ *     0 if every command succeeded, 1 if a command failed,
+ *     2 if the commands were invalid or the connection was lost.
+ */
+int run_batch(char **commands, int count, char *file);
@@ -0,0 +1,326 @@
+/*
+ * macD_bench
+ * written by: Nathan Koop
+ *
+ * description:
+ *     micro-benchmarks for macD. For each fleet of dummy children it measures
+ *     how fast create_process spawns them, the cost of sampling one of them
+ *     with the sampler of the reports, the cost of rendering a report,
+ *     and the round trip latency of the STAT and KILL commands.
+ *     results are printed one per line as key=value pairs, times in us,
+ *     so that the output of two builds can be compared.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "macD.h"
+#include "macD_server.h"
+#include "macD_hist.h"
+#include "macD_bench.h"
+#include "macD_socket.h"
+#include "macD_sample.h"
+
+//fleet sizes used when none are given on the command line.
+int DEFAULT_FLEETS[] = { 10, 1000, 10000 };
+//every benchmark takes at least this many samples, so small fleets are measured in rounds.
+int MIN_SAMPLES = 1000;
+char *DUMMY_ARGV[] = { "sleep", "3600", NULL };
+int BENCH_SOCK = -1;
+
+/*
+ * main
+ * description:
+ *     runs every benchmark for each fleet size.
+ * parameters:
+ *     argc: number of command line arguments
+ *     argv: the fleet sizes to benchmark, the defaults are used if there are none.
+ */
+int main(int argc, char *argv[])
+{
+	OUTPUT_FILE = fopen("/dev/null", "w");
+	if (OUTPUT_FILE == NULL) {
+		fprintf(stderr, "couldn't open /dev/null\n");
+		exit(1);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	sample_init(0, 0);
+	//an abstract socket of its own, so the benchmarks can run next to a running macD.
+	char path[64];
+
+	sprintf(path, "@macd.bench.%d", getpid());
+	SOCKET_PATH = path;
+	start_server();
+	BENCH_SOCK = bench_connect();
+	printf("# macD benchmarks, times in us\n");
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++) {
+			int fleet = convert_str_to_int(argv[i]);
+
+			if (fleet <= 0) {
+				fprintf(stderr, "invalid fleet size %s\n", argv[i]);
+				exit(1);
+			}
+			bench_fleet(fleet);
+		}
+	} else {
+		for (int i = 0; i < (int)(sizeof(DEFAULT_FLEETS)/sizeof(int)); i++)
+			bench_fleet(DEFAULT_FLEETS[i]);
+	}
+	close(BENCH_SOCK);
+	return 0;
+}
+
+/*
+ * now_ns
+ * description:
+ *     reads the monotonic clock.
+ * returns:
+ *     the current time in ns.
+ */
+unsigned long now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000UL + now.tv_nsec;
+}
+
+/*
+ * bench_connect
+ * description:
+ *     connects to the server started by start_server.
+ * returns:
+ *     the connected socket.
+ */
+int bench_connect(void)
+{
+	int sock = socket_connect(SOCKET_PATH);
+
+	if (sock == -1) {
+		fprintf(stderr, "couldn't connect to the server %s\n", strerror(errno));
+		exit(1);
+	}
+	return sock;
+}
+
+/*
+ * bench_fleet
+ * description:
+ *     runs every benchmark on a fleet of the given size, then kills the fleet.
+ * parameters:
+ *     fleet: the number of dummy children to spawn.
+ */
+void bench_fleet(int fleet)
+{
+	char prefix[64];
+	int spawned = bench_spawn(fleet);
+
+	if (spawned < fleet)
+		fprintf(stderr, "bench: only %d of %d children could be spawned\n", spawned, fleet);
+	if (spawned == 0)
+		return;
+	sprintf(prefix, "fleet=%d", spawned);
+	bench_sample(prefix, spawned);
+	bench_report(prefix, spawned);
+	bench_stat(prefix);
+	bench_kill(prefix, spawned);
+	for (int i = 0; i < spawned; i++) {
+		kill(PIDS[i], SIGKILL);
+		waitpid(PIDS[i], NULL, 0);
+	}
+	pthread_mutex_lock(&PIDLOCK);
+	free(PIDS);
+	free(PROC_INFO);
+	PIDS = NULL;
+	PROC_INFO = NULL;
+	pthread_mutex_unlock(&PIDLOCK);
+}
+
+/*
+ * bench_spawn
+ * description:
+ *     spawns a fleet of dummy children with create_process and fills
+ *     the process table with them. Prints the latency of each spawn and the spawn rate.
+ * parameters:
+ *     fleet: the number of children to spawn.
+ * returns:
+ *     the number of children spawned, less than fleet if fork failed.
+ */
+int bench_spawn(int fleet)
+{
+	struct histogram hist;
+	char prefix[64];
+	int spawned = 0;
+
+	pthread_mutex_lock(&PIDLOCK);
+	PIDS = malloc(sizeof(int)*(fleet+1));
+	PROC_INFO = malloc(sizeof(struct process_info)*fleet);
+	hist_init(&hist);
+	unsigned long start = now_ns();
+
+	for (; spawned < fleet; spawned++) {
+		unsigned long before = now_ns();
+		int pid;
+
+		create_process(DUMMY_ARGV, &pid, 1, -1, -1, -1);
+		hist_record(&hist, now_ns() - before);
+		if (pid == -1)
+			break;
+		PIDS[spawned] = pid;
+		init_process_info(&PROC_INFO[spawned]);
+		PROC_INFO[spawned].argv = DUMMY_ARGV;
+		PROC_INFO[spawned].state = PROC_RUNNING;
+	}
+	unsigned long elapsed = now_ns() - start;
+
+	PIDS[spawned] = -1;
+	pthread_mutex_unlock(&PIDLOCK);
+	sprintf(prefix, "bench=spawn fleet=%d", fleet);
+	hist_print(stdout, prefix, &hist, 1000);
+	printf("bench=spawn_rate fleet=%d per_sec=%.0f\n", fleet, spawned/(elapsed/1e9));
+	return spawned;
+}
+
+/*
+ * bench_sample
+ * description:
+ *     measures the cost of sampling a single child with sample_process, as reports do.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ *     fleet: the number of children in the process table.
+ */
+void bench_sample(char *prefix, int fleet)
+{
+	struct histogram hist;
+	char line[128];
+	int rounds = (MIN_SAMPLES + fleet - 1)/fleet;
+
+	hist_init(&hist);
+	pthread_mutex_lock(&PIDLOCK);
+	for (int round = 0; round < rounds; round++) {
+		for (int i = 0; i < fleet; i++) {
+			unsigned long before = now_ns();
+			int mem;
+
+			sample_process(i, &mem);
+			hist_record(&hist, now_ns() - before);
+		}
+	}
+	pthread_mutex_unlock(&PIDLOCK);
+	sprintf(line, "bench=sample_per_pid %s", prefix);
+	hist_print(stdout, line, &hist, 1000);
+}
+
+/*
+ * bench_report
+ * description:
+ *     measures the cost of rendering a full report of the fleet, then of a
+ *     delta report with -d 5, where the idle children have no line, output going to /dev/null.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ *     fleet: the number of children in the process table.
+ */
+void bench_report(char *prefix, int fleet)
+{
+	struct histogram hist;
+	char line[128];
+	int rounds = 1 + 10000/fleet;
+	int full_cpu_increase = 5*sysconf(_SC_CLK_TCK);
+	int thresholds[] = { -1, 5 };
+
+	if (rounds > 200)
+		rounds = 200;
+	for (int mode = 0; mode < 2; mode++) {
+		hist_init(&hist);
+		for (int round = 0; round < rounds; round++) {
+			unsigned long before = now_ns();
+
+			pthread_mutex_lock(&PIDLOCK);
+			render_report(PIDS, full_cpu_increase, thresholds[mode]);
+			pthread_mutex_unlock(&PIDLOCK);
+			fflush(OUTPUT_FILE);
+			hist_record(&hist, now_ns() - before);
+		}
+		sprintf(line, "bench=%s %s", mode == 0 ? "report" : "report_delta", prefix);
+		hist_print(stdout, line, &hist, 1000);
+	}
+}
+
+/*
+ * round_trip
+ * description:
+ *     sends a request to the server and waits for its 4 byte reply.
+ * parameters:
+ *     request: the request to send.
+ *     len: the length of the request.
+ * returns:
+ *     the time between sending the request and receiving the reply, in ns.
+ */
+unsigned long round_trip(void *request, int len)
+{
+	char reply[4];
+	unsigned long before = now_ns();
+
+	if (send(BENCH_SOCK, request, len, 0) != len ||
+	    recv(BENCH_SOCK, reply, sizeof(reply), MSG_WAITALL) != sizeof(reply)) {
+		fprintf(stderr, "lost the server %s\n", strerror(errno));
+		exit(1);
+	}
+	return now_ns() - before;
+}
+
+/*
+ * bench_stat
+ * description:
+ *     measures the round trip latency of the STAT command.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ */
+void bench_stat(char *prefix)
+{
+	struct histogram hist;
+	char line[128];
+
+	hist_init(&hist);
+	for (int i = 0; i < MIN_SAMPLES; i++)
+		hist_record(&hist, round_trip("stat", 4));
+	sprintf(line, "bench=stat_rtt %s", prefix);
+	hist_print(stdout, line, &hist, 1000);
+}
+
+/*
+ * bench_kill
+ * description:
+ *     measures the round trip latency of the KILL command, by killing every child of the fleet.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ *     fleet: the number of children in the process table.
+ */
+void bench_kill(char *prefix, int fleet)
+{
+	struct histogram hist;
+	char line[128];
+
+	hist_init(&hist);
+	for (int i = 0; i < fleet; i++) {
+		char request[8];
+
+		//the command and the index are sent together, as a client typing fast would.
+		memcpy(request, "kill", 4);
+		memcpy(request+4, &i, sizeof(int));
+		hist_record(&hist, round_trip(request, sizeof(request)));
+	}
+	sprintf(line, "bench=kill_rtt %s", prefix);
+	hist_print(stdout, line, &hist, 1000);
+}
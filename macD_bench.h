@@ -0,0 +1,89 @@
+/*
+ * now_ns
+ * description:
+ *     reads the monotonic clock.
+ * returns:
+ *     the current time in ns.
+ */
+unsigned long now_ns(void);
+
+/*
+ * bench_connect
+ * description:
+ *     connects to the server started by start_server.
+ * returns:
+ *     the connected socket.
+ */
+int bench_connect(void);
+
+/*
+ * bench_fleet
+ * description:
+ *     runs every benchmark on a fleet of the given size, then kills the fleet.
+ * parameters:
+ *     fleet: the number of dummy children to spawn.
+ */
+void bench_fleet(int fleet);
+
+/*
+ * bench_spawn
+ * description:
+ *     spawns a fleet of dummy children with create_process and fills
+ *     the process table with them. Prints the latency of each spawn and the spawn rate.
+ * parameters:
+ *     fleet: the number of children to spawn.
+ * returns:
+ *     the number of children spawned, less than fleet if fork failed.
+ */
+int bench_spawn(int fleet);
+
+/*
+ * bench_sample
+ * description:
+ *     measures the cost of sampling a single child with sample_process, as reports do.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ *     fleet: the number of children in the process table.
+ */
+void bench_sample(char *prefix, int fleet);
+
+/*
+ * bench_report
+ * description:
+ *     measures the cost of rendering a full report of the fleet, output going to /dev/null.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ *     fleet: the number of children in the process table.
+ */
+void bench_report(char *prefix, int fleet);
+
+/*
+ * round_trip
+ * description:
+ *     sends a request to the server and waits for its 4 byte reply.
+ * parameters:
+ *     request: the request to send.
+ *     len: the length of the request.
+ * returns:
+ *     the time between sending the request and receiving the reply, in ns.
+ */
+unsigned long round_trip(void *request, int len);
+
+/*
+ * bench_stat
+ * description:
+ *     measures the round trip latency of the STAT command.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ */
+void bench_stat(char *prefix);
+
+/*
+ * bench_kill
+ * description:
+ *     measures the round trip latency of the KILL command, by killing every child of the fleet.
+ * parameters:
+ *     prefix: text identifying the fleet in the output.
+ *     fleet: the number of children in the process table.
+ */
+void bench_kill(char *prefix, int fleet);
@@ -21,13 +21,14 @@
 #include <signal.h>
 
 #include "macD_c.h"
+#include "macD_load.h"
+#include "macD_batch.h"
+#include "macD_socket.h"
 
-#define SERVER_PATH "macd.socket.server"
-#define CLIENT_PATH "macd.socket.client"
-
-struct sockaddr_un CLIENT_ADDRESS;
+char *SOCKET_PATH = DEFAULT_SOCKET_PATH;
 int CLIENT_SOCK;
-int STATE = 0; //0: normal, 1: kill command used, 2: stat command used
+int STATE = 0; //0: normal, 1: kill command used, 2: stat command used, 3: spwn command used, 4: spwn line sent, 5: perf command used, 6: tail, thrd or proc command used, 7: tail, thrd or proc index sent, 8: topk command used,
+//9: gkil command used, 10: gsta or gtal command used, 11: gkil group sent, 12: gsta or gtal group sent
 pthread_t THREAD;
 pthread_mutex_t STATELOCK;
 
@@ -35,14 +36,56 @@ pthread_mutex_t STATELOCK;
  * main
  * description:
  *     called when the executable is started.
- *     starts the client
+ *     starts the client, runs the load generator if the -l flag is used,
+ *     or sends the commands given as arguments if the -b flag is used.
  * parameters:
  *     argc: the number of command line arguments
  *     argv: array of strings representing the command line arguments.
  * returns:
- *     0 if executes properly.
+ *     0 if executes properly, the status of the batch with -b.
  */
 int main(int argc, char *argv[]){
+	struct load_options options;
+	int load = 0;
+	int batch = 0;
+	char *file = NULL;
+	int opt;
+	load_default_options(&options);
+	while((opt = getopt(argc, argv, "lc:t:n:d:r:m:k:bf:s:")) != -1){
+		if(opt == 'l'){
+			load = 1;
+		}else if(opt == 'c'){
+			options.connections = atoi(optarg);
+		}else if(opt == 't'){
+			options.threads = atoi(optarg);
+		}else if(opt == 'n'){
+			options.requests = atol(optarg);
+		}else if(opt == 'd'){
+			options.duration = atof(optarg);
+		}else if(opt == 'r'){
+			options.rate = atof(optarg);
+		}else if(opt == 'm'){
+			options.mix = optarg;
+		}else if(opt == 'k'){
+			options.kill_index = atoi(optarg);
+		}else if(opt == 'b'){
+			batch = 1;
+		}else if(opt == 'f'){
+			file = optarg;
+		}else if(opt == 's'){
+			SOCKET_PATH = optarg;
+		}else{
+			fprintf(stderr, "usage: macD_c [-s socket] [-l [-c connections] [-t threads] [-n requests | -d seconds] [-r rate] [-m stat,kill] [-k index]]\n");
+			fprintf(stderr, "       macD_c [-s socket] -b [-f file] [command ...]\n");
+			return 1;
+		}
+	}
+	if(batch == 1){
+		return run_batch(argv+optind, argc-optind, file);
+	}
+	if(load == 1){
+		return run_load(&options);
+	}
 	start_client();
 	return 0;
 }
@@ -76,12 +119,38 @@ void client_reciever(){
 			close(CLIENT_SOCK);
 			exit(1);
 		} else if(buffer != NULL){
-			if(buffer[0] == '\0'){
+			if(rc == 0){ //the server closed the connection, a reply can start with a null byte
 				close_client();
 			}
 			buffer[4] = '\0';
 			pthread_mutex_lock(&STATELOCK);
-			if(STATE != 2){ //read as string
+			if((STATE == 7 || STATE == 11 || STATE == 12) && *(int *)buffer == -1){ //output isn't captured, threads aren't sampled, process isn't running, invalid index or unknown group
+				fprintf(stderr, "Echo From Server: FAIL\n");
+			}else if(STATE == 11){ //read the number of processes terminated
+				fprintf(stderr, "Terminated %d processes\n", *(int *)buffer);
+			}else if(STATE == 5 || STATE == 7 || STATE == 8 || STATE == 12){ //read the text of the reply
+				int len = *(int *)buffer;
+				char *text = malloc(len+1);
+				rc = recv(CLIENT_SOCK, text, len, MSG_WAITALL);
+				if(rc != len){
+					close_client();
+				}
+				text[len] = '\0';
+				fprintf(stderr, "%s", text);
+				free(text);
+			}else if(STATE == 4){ //read index and pid
+				int index = *(int *)buffer;
+				int pid;
+				rc = recv(CLIENT_SOCK, &pid, 4, MSG_WAITALL);
+				if(rc != 4){
+					close_client();
+				}
+				if(index == -1){
+					fprintf(stderr, "Echo From Server: FAIL\n");
+				}else{
+					fprintf(stderr, "Spawned process %d (pid: %d)\n", index, pid);
+				}
+			}else if(STATE != 2){ //read as string
 				fprintf(stderr, "Echo From Server: %s\n", buffer);
 			}else{	//read as int
 				int value = *(int *)buffer;
@@ -161,6 +230,41 @@ int convert_char_to_digit(char c){
 	return -1;
 }
 
+/*
+ * send_line
+ * description:
+ *     reads a line from the user, the command of a process to spawn or the
+ *     name of a group, and sends it to the server, preceded by its length.
+ * parameters:
+ *     next_state: the state that reads the reply.
+ * post-condition:
+ *     STATE is next_state, the server replies to every line.
+ */
+void send_line(int next_state){
+	char *line = NULL;
+	size_t size = 0;
+	int len = getline(&line, &size, stdin);
+	if(len > 0 && line[len-1] == '\n'){
+		len--;
+		line[len] = '\0';
+	}
+	if(len <= 0){
+		len = 0; //the server answers an empty line with FAIL
+	}
+	pthread_mutex_lock(&STATELOCK);
+	STATE = next_state;
+	pthread_mutex_unlock(&STATELOCK);
+	int rc = send(CLIENT_SOCK, &len, 4, 0);
+	if(rc != -1 && len > 0){
+		rc = send(CLIENT_SOCK, line, len, 0);
+	}
+	if(rc == -1){
+		fprintf(stderr, "Sending Error\n");
+		close_client();
+	}
+	free(line);
+}
+
 /*
  * client_sender
  * description:
@@ -169,10 +273,21 @@ int convert_char_to_digit(char c){
 void *client_sender(void *vargp){
 	while(1){
 		pthread_mutex_lock(&STATELOCK);
-		if(STATE != 1){ //read in 4 byte string
+		if(STATE == 3){ //read in the line to spawn
+			pthread_mutex_unlock(&STATELOCK);
+			send_line(4);
+		}else if(STATE == 9 || STATE == 10){ //read in the name of the group
+			int next_state = STATE == 9 ? 11 : 12;
+			pthread_mutex_unlock(&STATELOCK);
+			send_line(next_state);
+		}else if(STATE != 1 && STATE != 6){ //read in 4 byte string
 			pthread_mutex_unlock(&STATELOCK);
 			char *buffer = malloc(5);
-			fread(buffer, 1, 5, stdin);
+			if(fread(buffer, 1, 5, stdin) < 4){ //end of input, the server closes the connection once it has replied
+				free(buffer);
+				shutdown(CLIENT_SOCK, SHUT_WR);
+				return NULL;
+			}
 			buffer[4] = '\0';
 			str_lower(buffer);
 			if(strcmp(buffer, "kill") == 0){
@@ -183,6 +298,30 @@ void *client_sender(void *vargp){
 				pthread_mutex_lock(&STATELOCK);
 				STATE = 2;
 				pthread_mutex_unlock(&STATELOCK);
+			}else if(strcmp(buffer, "spwn") == 0){
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 3;
+				pthread_mutex_unlock(&STATELOCK);
+			}else if(strcmp(buffer, "perf") == 0){
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 5;
+				pthread_mutex_unlock(&STATELOCK);
+			}else if(strcmp(buffer, "tail") == 0 || strcmp(buffer, "thrd") == 0 || strcmp(buffer, "proc") == 0){
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 6;
+				pthread_mutex_unlock(&STATELOCK);
+			}else if(strcmp(buffer, "topk") == 0){
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 8;
+				pthread_mutex_unlock(&STATELOCK);
+			}else if(strcmp(buffer, "gkil") == 0){
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 9;
+				pthread_mutex_unlock(&STATELOCK);
+			}else if(strcmp(buffer, "gsta") == 0 || strcmp(buffer, "gtal") == 0){
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 10;
+				pthread_mutex_unlock(&STATELOCK);
 			}
 			int rc = send(CLIENT_SOCK, buffer, 4, 0);
 			if(rc == -1){
@@ -191,6 +330,7 @@ void *client_sender(void *vargp){
 			}
 			free(buffer);
 		}else{ //read in integer
+			int tail = STATE == 6;
 			pthread_mutex_unlock(&STATELOCK);
 			int x = 0;
 			char c;
@@ -210,17 +350,24 @@ void *client_sender(void *vargp){
 				if(d == -1){
 					break;
 				}else{
-					x = (x*10)+r;
+					x = (x*10)+d;
 				}
 			}
+			if(tail == 1){ //the reply of tail, thrd and proc is text, set before it can arrive
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 7;
+				pthread_mutex_unlock(&STATELOCK);
+			}
 			int rc = send(CLIENT_SOCK, &x, 4, 0);
 			if(rc == -1){
 				fprintf(stderr, "Sending Error\n");
 				close_client();
 			}
-			pthread_mutex_lock(&STATELOCK);
-			STATE = 0;
-			pthread_mutex_unlock(&STATELOCK);
+			if(tail == 0){
+				pthread_mutex_lock(&STATELOCK);
+				STATE = 0;
+				pthread_mutex_unlock(&STATELOCK);
+			}
 		}
 	}
 }
@@ -233,39 +380,25 @@ void *client_sender(void *vargp){
  *     in a concurrent fashion.
  */
 void start_client(){
-	int client_sock, rc;
-	int len;
-	struct sockaddr_un server_address;
-	struct sockaddr_un client_address;
-	memset(&server_address, 0, sizeof(struct sockaddr_un));
-	memset(&client_address, 0, sizeof(struct sockaddr_un));
-	client_sock = socket(AF_UNIX, SOCK_STREAM, 0);
-	if (client_sock == -1){
-		fprintf(stderr, "Socket Error\n");
-		exit(1);
-	}
-	client_address.sun_family = AF_UNIX;
-	strncpy(client_address.sun_path, CLIENT_PATH, 19);
-	len = sizeof(client_address);
-	unlink(CLIENT_PATH);
-	rc = bind(client_sock, (struct sockaddr *) &client_address, len);
-	if(rc == -1){
-		fprintf(stderr, "Binding Error\n");
-		close(client_sock);
-		exit(1);
-	}
-	server_address.sun_family = AF_UNIX;
-	strncpy(server_address.sun_path, SERVER_PATH, 19);
-	rc = connect(client_sock, (struct sockaddr *) &server_address, len);
-	if (rc == -1) {
-		fprintf(stderr, "Connection Error\n");
-		close(client_sock);
+	CLIENT_SOCK = connect_server();
+	if (CLIENT_SOCK == -1) {
+		fprintf(stderr, "Connection Error %s: %s\n", SOCKET_PATH, strerror(errno));
 		exit(1);
 	}
-	CLIENT_ADDRESS = client_address;
-	CLIENT_SOCK = client_sock;
 	pthread_t send_thread;
 	pthread_create(&send_thread, NULL, client_sender, NULL);
 	THREAD = send_thread;
 	client_reciever();
 }
+
+/*
+ * connect_server
+ * description:
+ *     opens a connection to the server listening on SOCKET_PATH. The client
+ *     socket is autobound, so any number of connections can be open at once.
+ * returns:
+ *     the connected socket, or -1 if the server couldn't be reached.
+ */
+int connect_server(){
+	return socket_connect(SOCKET_PATH);
+}
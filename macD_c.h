@@ -38,6 +38,18 @@ void str_lower(char *str);
  */
 int convert_char_to_digit(char c);
 
+/*
+ * send_line
+ * description:
+ *     reads a line from the user, the command of a process to spawn or the
+ *     name of a group, and sends it to the server, preceded by its length.
+ * parameters:
+ *     next_state: the state that reads the reply.
+ * post-condition:
+ *     STATE is next_state, the server replies to every line.
+ */
+void send_line(int next_state);
+
 /*
  * client_sender
  * description:
@@ -53,3 +65,13 @@ void *client_sender(void *vargp);
  *     in a concurrent fashion.
  */
 void start_client();
+
+/*
+ * connect_server
+ * description:
+ *     opens a connection to the server listening on SOCKET_PATH. The client
+ *     socket is autobound, so any number of connections can be open at once.
+ * returns:
+ *     the connected socket, or -1 if the server couldn't be reached.
+ */
+int connect_server();
@@ -0,0 +1,260 @@
+/*
+ * macD_deps
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the dependencies between the processes of the table. A line of the
+ *     process list file can name its process with @name and list the processes
+ *     it starts after with @after and @requires. At startup every line is
+ *     added to the table first, then the supervisor creates every process whose
+ *     dependencies are up at once, so starting the file takes as long as its
+ *     longest chain of dependencies instead of the sum of every start check.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "macD.h"
+#include "macD_deps.h"
+
+/*
+ * find_named
+ * description:
+ *     finds the entry with the given name.
+ * parameters:
+ *     name: the name given with @name.
+ *     self: the index of the entry looking, it can't depend on itself.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the index of the last entry with that name that wasn't removed, or -1 if there is none.
+ */
+static int find_named(char *name, int self)
+{
+	int found = -1;
+
+	for (int i = 0; PIDS[i] != -1; i++) {
+		if (i != self && PROC_INFO[i].removed == 0 && strcmp(PROC_INFO[i].name, name) == 0)
+			found = i;
+	}
+	return found;
+}
+
+/*
+ * deps_resolve
+ * description:
+ *     turns the names an entry was given with @after and @requires into
+ *     the indices of the entries they name. If several entries have the same
+ *     name, the last one that wasn't removed from the process list file is used.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     0 if every name was found, -1 otherwise.
+ */
+int deps_resolve(int index)
+{
+	struct process_info *info = &PROC_INFO[index];
+	char *lists[2] = { info->after, info->requires };
+	int result = 0;
+
+	for (int required = 0; required < 2; required++) {
+		char *save = NULL;
+
+		if (lists[required] == NULL)
+			continue;
+		for (char *name = strtok_r(lists[required], ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)) {
+			int dep = find_named(name, index);
+
+			if (dep == -1) {
+				fprintf(stderr, "macD: unknown dependency %s\n", name);
+				result = -1;
+				continue;
+			}
+			info->deps = realloc(info->deps, sizeof(struct dependency)*(info->dep_count+1));
+			info->deps[info->dep_count].index = dep;
+			info->deps[info->dep_count].required = required;
+			info->dep_count++;
+		}
+	}
+	free(info->after);
+	free(info->requires);
+	info->after = NULL;
+	info->requires = NULL;
+	return result;
+}
+
+/*
+ * deps_ready
+ * description:
+ *     checks the dependencies of an entry. An entry given with @after starts once
+ *     it is running or has exited, one given with @requires must be running.
+ *     a process with a readiness probe is only running once it is ready.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the dependencies of the entry are resolved.
+ * returns:
+ *     1 if the process can be created, 0 if it must wait, -1 if a required entry has exited.
+ */
+int deps_ready(int index)
+{
+	struct process_info *info = &PROC_INFO[index];
+	int ready = 1;
+
+	for (int i = 0; i < info->dep_count; i++) {
+		struct process_info *dep = &PROC_INFO[info->deps[i].index];
+		//a process killed on request is gone, even before the supervisor reaps it.
+		int state = dep->stopped == 1 ? PROC_EXITED : dep->state;
+
+		if (state == PROC_EXITED && info->deps[i].required == 1)
+			return -1;
+		if (state != PROC_RUNNING && state != PROC_READY && state != PROC_EXITED)
+			ready = 0;
+	}
+	return ready;
+}
+
+/*
+ * fail_waiting
+ * description:
+ *     gives up on a waiting entry, its process is never created.
+ * parameters:
+ *     index: the index of the entry.
+ *     reason: why, for the report.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+static void fail_waiting(int index, char *reason)
+{
+	struct process_info *info = &PROC_INFO[index];
+
+	info->state = PROC_EXITED;
+	if (info->announce == 1)
+		fprintf(OUTPUT_FILE, "[%d] badprogram %s, %s\n", index, info->argv[0], reason);
+	pthread_cond_broadcast(&STATECOND);
+}
+
+/*
+ * deps_break_cycles
+ * description:
+ *     fails the waiting entries that depend on each other in a cycle, and the
+ *     entries waiting on them, since none of them could ever start.
+ *     the waiting entries are sorted topologically, the ones left over can't start.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void deps_break_cycles(void)
+{
+	int count = len_pids(PIDS);
+	int *pending = calloc(count, sizeof(int)); //dependencies of each entry not sorted yet
+	int *offsets = calloc(count+1, sizeof(int)); //where the dependents of each entry start in dependents
+	int *queue = malloc(sizeof(int)*(count+1));
+	int head = 0;
+	int tail = 0;
+
+	for (int i = 0; i < count; i++) {
+		struct process_info *info = &PROC_INFO[i];
+
+		if (info->state != PROC_WAITING)
+			continue;
+		for (int k = 0; k < info->dep_count; k++) {
+			if (PROC_INFO[info->deps[k].index].state == PROC_WAITING) {
+				pending[i]++;
+				offsets[info->deps[k].index+1]++;
+			}
+		}
+	}
+	for (int i = 0; i < count; i++)
+		offsets[i+1] += offsets[i];
+	int *dependents = malloc(sizeof(int)*(offsets[count]+1));
+
+	//fill each range from its start, which leaves offsets[i] at the start of range i+1.
+	for (int i = 0; i < count; i++) {
+		struct process_info *info = &PROC_INFO[i];
+
+		if (info->state != PROC_WAITING)
+			continue;
+		for (int k = 0; k < info->dep_count; k++) {
+			int dep = info->deps[k].index;
+
+			if (PROC_INFO[dep].state == PROC_WAITING)
+				dependents[offsets[dep]++] = i;
+		}
+	}
+	for (int i = count; i > 0; i--)
+		offsets[i] = offsets[i-1];
+	offsets[0] = 0;
+	for (int i = 0; i < count; i++) {
+		if (PROC_INFO[i].state == PROC_WAITING && pending[i] == 0)
+			queue[tail++] = i;
+	}
+	while (head < tail) {
+		int i = queue[head++];
+
+		for (int k = offsets[i]; k < offsets[i+1]; k++) {
+			if (--pending[dependents[k]] == 0)
+				queue[tail++] = dependents[k];
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		if (PROC_INFO[i].state == PROC_WAITING && pending[i] > 0)
+			fail_waiting(i, "dependency cycle");
+	}
+	free(pending);
+	free(offsets);
+	free(queue);
+	free(dependents);
+}
+
+/*
+ * deps_start_ready
+ * description:
+ *     creates the processes of every waiting entry whose dependencies are up,
+ *     and fails the ones that require an entry which exited. A failure can let
+ *     other entries go on or fail, so the table is scanned until nothing fails.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void deps_start_ready(void)
+{
+	int failed = 1;
+
+	if (SHUTTING_DOWN == 1)
+		return;
+	while (failed == 1) {
+		failed = 0;
+		for (int i = 0; PIDS[i] != -1; i++) {
+			if (PROC_INFO[i].state != PROC_WAITING)
+				continue;
+			int ready = deps_ready(i);
+
+			if (ready == 0 || (ready == 1 && start_process(i) == 0))
+				continue;
+			fail_waiting(i, ready == 1 ? "failed to start" : "failed to start, a process it requires exited");
+			failed = 1;
+		}
+	}
+}
+
+/*
+ * deps_free
+ * description:
+ *     frees the dependencies of info, resolved or not.
+ * parameters:
+ *     info: the process_info.
+ */
+void deps_free(struct process_info *info)
+{
+	free(info->after);
+	free(info->requires);
+	free(info->deps);
+	info->after = NULL;
+	info->requires = NULL;
+	info->deps = NULL;
+	info->dep_count = 0;
+}
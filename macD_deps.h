@@ -0,0 +1,59 @@
+/*
+ * deps_resolve
+ * description:
+ *     turns the names an entry was given with @after and @requires into
+ *     the indices of the entries they name. If several entries have the same
+ *     name, the last one that wasn't removed from the process list file is used.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     0 if every name was found, -1 otherwise.
+ */
+int deps_resolve(int index);
+
+/*
+ * deps_ready
+ * description:
+ *     checks the dependencies of an entry. An entry given with @after starts once
+ *     it is running or has exited, one given with @requires must be running.
+ *     a process with a readiness probe is only running once it is ready.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the dependencies of the entry are resolved.
+ * returns:
+ *     1 if the process can be created, 0 if it must wait, -1 if a required entry has exited.
+ */
+int deps_ready(int index);
+
+/*
+ * deps_break_cycles
+ * description:
+ *     fails the waiting entries that depend on each other in a cycle, and the
+ *     entries waiting on them, since none of them could ever start.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void deps_break_cycles(void);
+
+/*
+ * deps_start_ready
+ * description:
+ *     creates the processes of every waiting entry whose dependencies are up,
+ *     and fails the ones that require an entry which exited.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void deps_start_ready(void);
+
+/*
+ * deps_free
+ * description:
+ *     frees the dependencies of info, resolved or not.
+ * parameters:
+ *     info: the process_info.
+ */
+void deps_free(struct process_info *info);
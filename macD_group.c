@@ -0,0 +1,357 @@
+/*
+ * macD_group
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the process table indexed by group. Processes are put in a group with the
+ *     @group directive, every group keeps the indices of its members, so a
+ *     command on a group of 200 workers finds them without scanning the table,
+ *     and the group of a process is kept as an id in its process_info so the
+ *     report and the rules compare ints instead of names.
+ *     groups are only changed under PIDLOCK and are never removed.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "macD.h"
+#include "macD_output.h"
+#include "macD_group.h"
+
+struct group *GROUPS = NULL; //groups in the order they were created, indexed by id
+int GROUP_COUNT = 0;
+int GROUPS_CAPACITY = 0;
+int GROUP_HEADS[GROUP_BUCKETS]; //first group of each bucket, -1 for none
+int GROUPS_INITIALIZED = 0;
+
+/*
+ * hash_name
+ * description:
+ *     computes the FNV-1a hash of a group name.
+ * parameters:
+ *     name: the name to hash.
+ * returns:
+ *     the bucket of name.
+ */
+static int hash_name(char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	for (int i = 0; name[i] != '\0'; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash & (GROUP_BUCKETS-1);
+}
+
+/*
+ * group_find
+ * description:
+ *     finds a group by name.
+ * parameters:
+ *     name: the name of the group.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the id of the group, or -1 if no process ever belonged to it.
+ */
+int group_find(char *name)
+{
+	if (GROUPS_INITIALIZED == 0 || name[0] == '\0')
+		return -1;
+	int id = GROUP_HEADS[hash_name(name)];
+
+	while (id != -1 && strcmp(GROUPS[id].name, name) != 0)
+		id = GROUPS[id].next;
+	return id;
+}
+
+/*
+ * group_intern
+ * description:
+ *     finds a group by name, creating it if it doesn't exist yet.
+ * parameters:
+ *     name: the name of the group.
+ * pre-conditions:
+ *     PIDLOCK is held, or no other thread uses the groups yet.
+ * returns:
+ *     the id of the group, or -1 if name is empty.
+ */
+int group_intern(char *name)
+{
+	if (name[0] == '\0')
+		return -1;
+	if (GROUPS_INITIALIZED == 0) {
+		memset(GROUP_HEADS, -1, sizeof(GROUP_HEADS));
+		GROUPS_INITIALIZED = 1;
+	}
+	int id = group_find(name);
+
+	if (id != -1)
+		return id;
+	if (GROUP_COUNT == GROUPS_CAPACITY) {
+		GROUPS_CAPACITY = GROUPS_CAPACITY == 0 ? 8 : GROUPS_CAPACITY*2;
+		GROUPS = realloc(GROUPS, sizeof(struct group)*GROUPS_CAPACITY);
+	}
+	id = GROUP_COUNT++;
+	struct group *group = &GROUPS[id];
+	int bucket = hash_name(name);
+
+	memset(group, 0, sizeof(struct group));
+	strncpy(group->name, name, MAX_GROUP_LENGTH-1);
+	group->next = GROUP_HEADS[bucket];
+	GROUP_HEADS[bucket] = id;
+	return id;
+}
+
+/*
+ * group_join
+ * description:
+ *     adds a new entry of the process table to the group named by its group field,
+ *     and sets its group_id.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     index is the last entry of the process table.
+ */
+void group_join(int index)
+{
+	int id = group_intern(PROC_INFO[index].group);
+
+	PROC_INFO[index].group_id = id;
+	if (id == -1)
+		return;
+	struct group *group = &GROUPS[id];
+
+	if (group->count == group->capacity) {
+		group->capacity = group->capacity == 0 ? 8 : group->capacity*2;
+		group->members = realloc(group->members, sizeof(int)*group->capacity);
+	}
+	group->members[group->count++] = index;
+}
+
+/*
+ * group_leave
+ * description:
+ *     removes an entry from its group, when drop_process removes it from the table.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     index is the last entry of the process table.
+ */
+void group_leave(int index)
+{
+	int id = PROC_INFO[index].group_id;
+
+	//the last entry of the table is the last member of its group.
+	if (id != -1 && GROUPS[id].count > 0 && GROUPS[id].members[GROUPS[id].count-1] == index)
+		GROUPS[id].count--;
+}
+
+/*
+ * group_kill
+ * description:
+ *     terminates every process of a group, like a kill command on each of them.
+ * parameters:
+ *     name: the name of the group.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of processes terminated, or -1 if the group doesn't exist.
+ */
+int group_kill(char *name)
+{
+	int id = group_find(name);
+	int killed = 0;
+
+	if (id == -1)
+		return -1;
+	for (int i = 0; i < GROUPS[id].count; i++)
+		killed += stop_process(GROUPS[id].members[i]);
+	return killed;
+}
+
+/*
+ * state_name
+ * description:
+ *     the name of a state of the process table.
+ * parameters:
+ *     state: one of the PROC_ states.
+ */
+static char *state_name(int state)
+{
+	if (state == PROC_RUNNING)
+		return "running";
+	if (state == PROC_READY)
+		return "ready";
+	if (state == PROC_STARTING)
+		return "starting";
+	if (state == PROC_BACKOFF)
+		return "restarting";
+	if (state == PROC_WAITING)
+		return "waiting";
+	return "exited";
+}
+
+/*
+ * group_stat
+ * description:
+ *     renders the state of a group: a line of totals,
+ *     "group=[name] processes=[count] running=[count] cpu=[percent] mem=[MB]",
+ *     then a line per member, "index=[i] pid=[p] state=[state] cpu=[percent] mem=[MB]",
+ *     with the usage measured in the last report cycle.
+ * parameters:
+ *     name: the name of the group.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the group doesn't exist.
+ */
+char *group_stat(char *name, int *out_len)
+{
+	int id = group_find(name);
+
+	if (id == -1)
+		return NULL;
+	struct group *group = &GROUPS[id];
+	int running = 0;
+	long cpu = 0;
+	long mem = 0;
+
+	for (int i = 0; i < group->count; i++) {
+		struct process_info *info = &PROC_INFO[group->members[i]];
+
+		if (info->state != PROC_RUNNING && info->state != PROC_READY && info->state != PROC_STARTING)
+			continue;
+		running++;
+		cpu += info->cpu > 0 ? info->cpu : 0;
+		mem += info->mem > 0 ? info->mem : 0;
+	}
+	char *text = NULL;
+	size_t len = 0;
+	FILE *file = open_memstream(&text, &len);
+
+	fprintf(file, "group=%s processes=%d running=%d cpu=%ld mem=%ld\n", group->name, group->count, running, cpu, mem);
+	for (int i = 0; i < group->count; i++) {
+		int index = group->members[i];
+		struct process_info *info = &PROC_INFO[index];
+		int live = info->state == PROC_RUNNING || info->state == PROC_READY || info->state == PROC_STARTING;
+
+		fprintf(file, "index=%d pid=%d state=%s cpu=%d mem=%d\n", index, PIDS[index],
+			state_name(info->state), live && info->cpu > 0 ? info->cpu : 0, live ? info->mem : 0);
+	}
+	fclose(file);
+	*out_len = len;
+	return text;
+}
+
+/*
+ * group_tail
+ * description:
+ *     copies the output kept for every member of a group, each preceded by
+ *     a line "==> [index] <==".
+ * parameters:
+ *     name: the name of the group.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the group doesn't exist or output isn't captured.
+ */
+char *group_tail(char *name, int *out_len)
+{
+	int id = group_find(name);
+	int captured = 0;
+
+	if (id == -1)
+		return NULL;
+	char *text = NULL;
+	size_t len = 0;
+	FILE *file = open_memstream(&text, &len);
+
+	for (int i = 0; i < GROUPS[id].count; i++) {
+		int index = GROUPS[id].members[i];
+		int tail_len;
+		char *tail = output_tail(index, &tail_len);
+
+		if (tail == NULL)
+			continue;
+		captured = 1;
+		fprintf(file, "==> %d <==\n", index);
+		fwrite(tail, 1, tail_len, file);
+		if (tail_len > 0 && tail[tail_len-1] != '\n')
+			fputc('\n', file);
+		free(tail);
+	}
+	fclose(file);
+	if (captured == 0) {
+		free(text);
+		return NULL;
+	}
+	*out_len = len;
+	return text;
+}
+
+/*
+ * group_begin
+ * description:
+ *     starts a report cycle: clears the rollup of every group.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void group_begin(void)
+{
+	for (int id = 0; id < GROUP_COUNT; id++) {
+		GROUPS[id].running = 0;
+		GROUPS[id].cpu = 0;
+		GROUPS[id].mem = 0;
+	}
+}
+
+/*
+ * group_sample
+ * description:
+ *     adds the last sample of a running process to the rollup of its group.
+ * parameters:
+ *     index: the index of the process.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void group_sample(int index)
+{
+	struct process_info *info = &PROC_INFO[index];
+
+	if (info->group_id == -1)
+		return;
+	struct group *group = &GROUPS[info->group_id];
+
+	group->running++;
+	group->cpu += info->cpu > 0 ? info->cpu : 0;
+	group->mem += info->mem > 0 ? info->mem : 0;
+}
+
+/*
+ * group_report
+ * description:
+ *     displays the rollup of every group that has members.
+ * parameters:
+ *     file: where to display it.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void group_report(FILE *file)
+{
+	for (int id = 0; id < GROUP_COUNT; id++) {
+		struct group *group = &GROUPS[id];
+
+		if (group->count == 0)
+			continue;
+		fprintf(file, "Group %s: %d processes, %d running, cpu usage: %ld%%, mem usage: %ld MB\n",
+			group->name, group->count, group->running, group->cpu, group->mem);
+	}
+}
@@ -0,0 +1,145 @@
+//buckets of the hash table of group names, a power of 2.
+#define GROUP_BUCKETS 64
+
+/*
+ * group
+ * description:
+ *     a group of the process table and the entries that belong to it.
+ */
+struct group {
+	char name[MAX_GROUP_LENGTH];
+	int *members; //indices of the entries of the group, in increasing order
+	int count; //number of members
+	int capacity;
+	int next; //next group in the same bucket, -1 for none
+	int running; //members running in the last report cycle
+	long cpu; //cpu usage of the members in the last report cycle, as a percent
+	long mem; //memory usage of the members in the last report cycle, in MB
+};
+
+/*
+ * group_intern
+ * description:
+ *     finds a group by name, creating it if it doesn't exist yet.
+ * parameters:
+ *     name: the name of the group.
+ * pre-conditions:
+ *     PIDLOCK is held, or no other thread uses the groups yet.
+ * returns:
+ *     the id of the group, or -1 if name is empty.
+ */
+int group_intern(char *name);
+
+/*
+ * group_find
+ * description:
+ *     finds a group by name.
+ * parameters:
+ *     name: the name of the group.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the id of the group, or -1 if no process ever belonged to it.
+ */
+int group_find(char *name);
+
+/*
+ * group_join
+ * description:
+ *     adds a new entry of the process table to the group named by its group field,
+ *     and sets its group_id.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     index is the last entry of the process table.
+ */
+void group_join(int index);
+
+/*
+ * group_leave
+ * description:
+ *     removes an entry from its group, when drop_process removes it from the table.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     index is the last entry of the process table.
+ */
+void group_leave(int index);
+
+/*
+ * group_kill
+ * description:
+ *     terminates every process of a group, like a kill command on each of them.
+ * parameters:
+ *     name: the name of the group.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of processes terminated, or -1 if the group doesn't exist.
+ */
+int group_kill(char *name);
+
+/*
+ * group_stat
+ * description:
+ *     renders the state of a group: a line of totals,
+ *     "group=[name] processes=[count] running=[count] cpu=[percent] mem=[MB]",
+ *     then a line per member, "index=[i] pid=[p] state=[state] cpu=[percent] mem=[MB]",
+ *     with the usage measured in the last report cycle.
+ * parameters:
+ *     name: the name of the group.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the group doesn't exist.
+ */
+char *group_stat(char *name, int *out_len);
+
+/*
+ * group_tail
+ * description:
+ *     copies the output kept for every member of a group, each preceded by
+ *     a line "==> [index] <==".
+ * parameters:
+ *     name: the name of the group.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the group doesn't exist or output isn't captured.
+ */
+char *group_tail(char *name, int *out_len);
+
+/*
+ * group_begin
+ * description:
+ *     starts a report cycle: clears the rollup of every group.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void group_begin(void);
+
+/*
+ * group_sample
+ * description:
+ *     adds the last sample of a running process to the rollup of its group.
+ * parameters:
+ *     index: the index of the process.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void group_sample(int index);
+
+/*
+ * group_report
+ * description:
+ *     displays the rollup of every group that has members.
+ * parameters:
+ *     file: where to display it.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void group_report(FILE *file);
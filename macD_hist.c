@@ -0,0 +1,153 @@
+/*
+ * macD_hist
+ * written by: Nathan Koop
+ *
+ * description:
+ *     log-linear latency histograms used by the benchmarks and the
+ *     load generator to report percentiles.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "macD_hist.h"
+
+/*
+ * bucket_of
+ * description:
+ *     finds the bucket a value is counted in.
+ * parameters:
+ *     value: the value to find the bucket of.
+ * returns:
+ *     the index of the bucket in counts.
+ */
+static int bucket_of(unsigned long value)
+{
+	if (value < HIST_SUB_BUCKETS)
+		return value;
+	int shift = 63 - __builtin_clzl(value) - HIST_SUB_BITS;
+
+	return (shift+1)*HIST_SUB_BUCKETS + ((value >> shift) & (HIST_SUB_BUCKETS-1));
+}
+
+/*
+ * bucket_top
+ * description:
+ *     finds the highest value counted in a bucket.
+ * parameters:
+ *     bucket: the index of the bucket.
+ * returns:
+ *     the highest value of the bucket.
+ */
+static unsigned long bucket_top(int bucket)
+{
+	if (bucket < HIST_SUB_BUCKETS)
+		return bucket;
+	int shift = bucket/HIST_SUB_BUCKETS - 1;
+	unsigned long sub = HIST_SUB_BUCKETS + bucket%HIST_SUB_BUCKETS;
+
+	return ((sub+1) << shift) - 1;
+}
+
+/*
+ * hist_init
+ * description:
+ *     empties the histogram.
+ * parameters:
+ *     hist: the histogram to empty.
+ */
+void hist_init(struct histogram *hist)
+{
+	memset(hist, 0, sizeof(struct histogram));
+}
+
+/*
+ * hist_record
+ * description:
+ *     records a value in the histogram.
+ * parameters:
+ *     hist: the histogram to record to.
+ *     value: the value to record, usually a latency in ns.
+ */
+void hist_record(struct histogram *hist, unsigned long value)
+{
+	hist->counts[bucket_of(value)]++;
+	if (hist->count == 0 || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->count++;
+	hist->sum += value;
+}
+
+/*
+ * hist_merge
+ * description:
+ *     adds all the values recorded in src to dst.
+ * parameters:
+ *     dst: the histogram to add to.
+ *     src: the histogram to add.
+ */
+void hist_merge(struct histogram *dst, struct histogram *src)
+{
+	if (src->count == 0)
+		return;
+	for (int i = 0; i < HIST_SIZE; i++)
+		dst->counts[i] += src->counts[i];
+	if (dst->count == 0 || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+	dst->sum += src->sum;
+}
+
+/*
+ * hist_percentile
+ * description:
+ *     finds the value below which the given percent of the recorded values fall.
+ * parameters:
+ *     hist: the histogram to read.
+ *     percent: the percentile to find, between 0 and 100.
+ * returns:
+ *     the highest value of the bucket holding the percentile, 0 if the histogram is empty.
+ */
+unsigned long hist_percentile(struct histogram *hist, double percent)
+{
+	if (hist->count == 0)
+		return 0;
+	unsigned long rank = (unsigned long)(percent/100*hist->count + 0.5);
+	unsigned long seen = 0;
+
+	if (rank < 1)
+		rank = 1;
+	for (int i = 0; i < HIST_SIZE; i++) {
+		seen += hist->counts[i];
+		if (seen >= rank) {
+			unsigned long top = bucket_top(i);
+
+			return top > hist->max ? hist->max : top;
+		}
+	}
+	return hist->max;
+}
+
+/*
+ * hist_print
+ * description:
+ *     prints the histogram as a single line of key=value pairs, after prefix.
+ *     values are divided by scale, ie 1000 to print ns as us.
+ * parameters:
+ *     file: the file to print to.
+ *     prefix: text printed at the start of the line.
+ *     hist: the histogram to print.
+ *     scale: what the values are divided by before they are printed.
+ */
+void hist_print(FILE *file, char *prefix, struct histogram *hist, double scale)
+{
+	double mean = hist->count == 0 ? 0 : hist->sum/hist->count;
+
+	fprintf(file, "%s count=%lu min=%.3f mean=%.3f p50=%.3f p90=%.3f p99=%.3f p999=%.3f max=%.3f\n",
+		prefix, hist->count, hist->min/scale, mean/scale,
+		hist_percentile(hist, 50)/scale, hist_percentile(hist, 90)/scale,
+		hist_percentile(hist, 99)/scale, hist_percentile(hist, 99.9)/scale, hist->max/scale);
+}
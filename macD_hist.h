@@ -0,0 +1,73 @@
+//values below 2^HIST_SUB_BITS are counted exactly, larger values with a relative error below 1/2^HIST_SUB_BITS.
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_SIZE ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+/*
+ * histogram
+ * description:
+ *     a log-linear histogram of latencies, in the style of HdrHistogram.
+ *     every power of two is split into HIST_SUB_BUCKETS linear buckets,
+ *     so recording is a few instructions and percentiles keep a fixed relative precision.
+ */
+struct histogram {
+	unsigned long counts[HIST_SIZE];
+	unsigned long count; //number of values recorded
+	unsigned long min;
+	unsigned long max;
+	double sum;
+};
+
+/*
+ * hist_init
+ * description:
+ *     empties the histogram.
+ * parameters:
+ *     hist: the histogram to empty.
+ */
+void hist_init(struct histogram *hist);
+
+/*
+ * hist_record
+ * description:
+ *     records a value in the histogram.
+ * parameters:
+ *     hist: the histogram to record to.
+ *     value: the value to record, usually a latency in ns.
+ */
+void hist_record(struct histogram *hist, unsigned long value);
+
+/*
+ * hist_merge
+ * description:
+ *     adds all the values recorded in src to dst.
+ * parameters:
+ *     dst: the histogram to add to.
+ *     src: the histogram to add.
+ */
+void hist_merge(struct histogram *dst, struct histogram *src);
+
+/*
+ * hist_percentile
+ * description:
+ *     finds the value below which the given percent of the recorded values fall.
+ * parameters:
+ *     hist: the histogram to read.
+ *     percent: the percentile to find, between 0 and 100.
+ * returns:
+ *     the highest value of the bucket holding the percentile, 0 if the histogram is empty.
+ */
+unsigned long hist_percentile(struct histogram *hist, double percent);
+
+/*
+ * hist_print
+ * description:
+ *     prints the histogram as a single line of key=value pairs, after prefix.
+ *     values are divided by scale, ie 1000 to print ns as us.
+ * parameters:
+ *     file: the file to print to.
+ *     prefix: text printed at the start of the line.
+ *     hist: the histogram to print.
+ *     scale: what the values are divided by before they are printed.
+ */
+void hist_print(FILE *file, char *prefix, struct histogram *hist, double scale);
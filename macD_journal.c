@@ -0,0 +1,634 @@
+/*
+ * macD_journal
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the state journal, kept with -j [file]. Every process macD creates is
+ *     appended to the journal with its pid and start time, and so are the
+ *     changes of its state and its exit. If macD crashes or is restarted to be
+ *     upgraded its children keep running, and the next macD started with the
+ *     same journal adopts the ones that are still alive instead of starting them
+ *     again. A pid is only trusted if the process with that pid has the start
+ *     time in the journal, so a process that reused the pid is never adopted.
+ *     adopted processes aren't children of the new macD, so their exit is read
+ *     from a pidfd the supervisor polls instead of from waitpid.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include "macD.h"
+#include "macD_supervisor.h"
+#include "macD_probe.h"
+#include "macD_journal.h"
+#include "macD_sample.h"
+
+//kinds of records.
+#define JOURNAL_START 1 //a process was created, the line of its entry follows the record
+#define JOURNAL_STATE 2 //a process passed its start check or its readiness probe
+#define JOURNAL_EXIT 3 //a process exited
+
+//the journal is rewritten with only the processes alive once it grows past this many bytes.
+#define JOURNAL_COMPACT_BYTES 1048576
+
+/*
+ * journal_record
+ * description:
+ *     a record of the journal. Each record is appended with a single write, so
+ *     a crash of macD can only cut the last one short.
+ */
+struct journal_record {
+	int type; //one of the JOURNAL_ kinds
+	int index; //index of the entry in the process table
+	int pid;
+	int state;
+	unsigned long long start_time; //start time of the process, in clock ticks since boot
+	int spawned; //1 if the entry was created with SPWN
+	int source_len; //length of the line that follows a JOURNAL_START record
+};
+
+/*
+ * recovered
+ * description:
+ *     an entry whose process was alive when the journal was last written.
+ */
+struct recovered {
+	int pid; //0 if the process exited or was already matched
+	int state;
+	unsigned long long start_time;
+	int spawned;
+	char *source; //line of the entry, directives included
+	int source_len;
+};
+
+/*
+ * journal_slot
+ * description:
+ *     what the journal keeps about an entry of the process table.
+ */
+struct journal_slot {
+	unsigned long long start_time; //start time of the process, to rewrite the journal
+	int pidfd; //pidfd of the adopted process, -1 if it is a child of macD
+};
+
+char *JOURNAL_PATH = NULL;
+int JOURNAL_FD = -1;
+long JOURNAL_SIZE = 0;
+int JOURNAL_EPOLL = -1;
+struct journal_slot *JOURNAL = NULL; //indexed like PIDS
+int JOURNAL_CAPACITY = 0;
+struct recovered *RECOVERED = NULL; //indexed like the process table of the previous macD
+int RECOVERED_COUNT = 0;
+
+/*
+ * read_start_time
+ * description:
+ *     reads the start time of a process from /proc/[pid]/stat.
+ * parameters:
+ *     pid: the pid of the process.
+ * returns:
+ *     the start time in clock ticks since boot, or 0 if the process doesn't exist or has exited.
+ */
+static unsigned long long read_start_time(int pid)
+{
+	char path[64];
+	char buffer[1024];
+
+	sprintf(path, "/proc/%d/stat", pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd == -1)
+		return 0;
+	int len = read(fd, buffer, sizeof(buffer)-1);
+
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buffer[len] = '\0';
+	//the name of the process can hold spaces and parentheses, the fields start after the last one.
+	char *field = strrchr(buffer, ')');
+
+	if (field == NULL || field[1] != ' ' || field[2] == 'Z')
+		return 0;
+	//field is before the state, which is field 3, the start time is field 22.
+	for (int k = 3; k <= 22 && field != NULL; k++)
+		field = strchr(field+1, ' ');
+	if (field == NULL)
+		return 0;
+	return strtoull(field+1, NULL, 10);
+}
+
+/*
+ * journal_slot
+ * description:
+ *     the slot of an entry, growing the slots to the size of the process table.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+static struct journal_slot *journal_slot(int index)
+{
+	if (index >= JOURNAL_CAPACITY) {
+		int capacity = JOURNAL_CAPACITY == 0 ? 16 : JOURNAL_CAPACITY;
+
+		while (capacity <= index)
+			capacity *= 2;
+		JOURNAL = realloc(JOURNAL, sizeof(struct journal_slot)*capacity);
+		for (int i = JOURNAL_CAPACITY; i < capacity; i++) {
+			JOURNAL[i].start_time = 0;
+			JOURNAL[i].pidfd = -1;
+		}
+		JOURNAL_CAPACITY = capacity;
+	}
+	return &JOURNAL[index];
+}
+
+/*
+ * write_record
+ * description:
+ *     appends a record about an entry to the journal.
+ * parameters:
+ *     fd: the journal.
+ *     type: one of the JOURNAL_ kinds.
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of bytes written, -1 if the write failed.
+ */
+static long write_record(int fd, int type, int index)
+{
+	struct process_info *info = &PROC_INFO[index];
+	struct journal_record record;
+	struct iovec iov[2];
+
+	memset(&record, 0, sizeof(record));
+	record.type = type;
+	record.index = index;
+	record.pid = PIDS[index];
+	record.state = info->state;
+	record.start_time = journal_slot(index)->start_time;
+	record.spawned = info->spawned;
+	if (type == JOURNAL_START && info->source != NULL)
+		record.source_len = info->source_len;
+	iov[0].iov_base = &record;
+	iov[0].iov_len = sizeof(record);
+	iov[1].iov_base = info->source;
+	iov[1].iov_len = record.source_len;
+	return writev(fd, iov, record.source_len > 0 ? 2 : 1);
+}
+
+/*
+ * journal_append
+ * description:
+ *     appends a record about an entry, and rewrites the journal once it grew past JOURNAL_COMPACT_BYTES.
+ * parameters:
+ *     type: one of the JOURNAL_ kinds.
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+static void journal_append(int type, int index)
+{
+	long written = write_record(JOURNAL_FD, type, index);
+
+	if (written > 0)
+		JOURNAL_SIZE += written;
+	if (JOURNAL_SIZE > JOURNAL_COMPACT_BYTES)
+		journal_compact();
+}
+
+/*
+ * journal_replay
+ * description:
+ *     reads the journal left by the previous macD and keeps the entries whose
+ *     process was alive when it was last written. A record cut short by a crash
+ *     ends the journal, it is truncated so new records don't follow it.
+ * parameters:
+ *     fd: the journal, opened for reading and writing.
+ */
+static void journal_replay(int fd)
+{
+	struct stat file_stat;
+	long offset = 0;
+
+	if (fstat(fd, &file_stat) == -1 || file_stat.st_size == 0)
+		return;
+	long size = file_stat.st_size;
+	char *data = malloc(size);
+
+	if (pread(fd, data, size, 0) != size) {
+		free(data);
+		return;
+	}
+	while (offset + (long)sizeof(struct journal_record) <= size) {
+		struct journal_record record;
+
+		//the lines make records unaligned, so they are copied out.
+		memcpy(&record, data+offset, sizeof(record));
+		long end = offset + sizeof(record) + record.source_len;
+
+		if (record.type < JOURNAL_START || record.type > JOURNAL_EXIT || record.index < 0 ||
+		    record.source_len < 0 || end > size)
+			break;
+		if (record.index >= RECOVERED_COUNT) {
+			int count = record.index+1;
+
+			RECOVERED = realloc(RECOVERED, sizeof(struct recovered)*count);
+			memset(RECOVERED+RECOVERED_COUNT, 0, sizeof(struct recovered)*(count-RECOVERED_COUNT));
+			RECOVERED_COUNT = count;
+		}
+		struct recovered *entry = &RECOVERED[record.index];
+
+		if (record.type == JOURNAL_START) {
+			free(entry->source);
+			entry->pid = record.pid;
+			entry->state = record.state;
+			entry->start_time = record.start_time;
+			entry->spawned = record.spawned;
+			entry->source_len = record.source_len;
+			entry->source = malloc(record.source_len+1);
+			memcpy(entry->source, data+offset+sizeof(record), record.source_len);
+			entry->source[record.source_len] = '\0';
+		} else if (entry->pid == record.pid && record.type == JOURNAL_STATE) {
+			entry->state = record.state;
+		} else if (entry->pid == record.pid) {
+			entry->pid = 0;
+		}
+		offset = end;
+	}
+	if (offset < size)
+		ftruncate(fd, offset);
+	JOURNAL_SIZE = offset;
+	free(data);
+}
+
+/*
+ * journal_open
+ * description:
+ *     opens the journal, creating it if it doesn't exist, and reads the
+ *     processes the previous macD left running. macD becomes a child subreaper,
+ *     so the processes its children fork and leave behind are reparented to it
+ *     and reaped by the supervisor instead of outliving it unnoticed.
+ * parameters:
+ *     path: path of the journal.
+ * returns:
+ *     0 if the journal was opened, -1 otherwise.
+ */
+int journal_open(char *path)
+{
+	int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	if (fd == -1)
+		return -1;
+	JOURNAL_EPOLL = epoll_create1(EPOLL_CLOEXEC);
+	if (JOURNAL_EPOLL == -1 || prctl(PR_SET_CHILD_SUBREAPER, 1) == -1) {
+		close(fd);
+		return -1;
+	}
+	journal_replay(fd);
+	JOURNAL_PATH = path;
+	JOURNAL_FD = fd;
+	return 0;
+}
+
+/*
+ * journal_watch_fd
+ * description:
+ *     the epoll set of the pidfds of the adopted processes.
+ * returns:
+ *     the descriptor of the set, for the supervisor to poll, or -1 if there is no journal.
+ */
+int journal_watch_fd(void)
+{
+	return JOURNAL_EPOLL;
+}
+
+/*
+ * source_command
+ * description:
+ *     finds the command in the line of an entry, after its directives.
+ * parameters:
+ *     entry: the recovered entry.
+ * returns:
+ *     the first argument of the command, for the report.
+ */
+static char *source_command(struct recovered *entry)
+{
+	char *arg = entry->source;
+
+	while (arg[0] == '@' && arg + strlen(arg) + 1 < entry->source + entry->source_len)
+		arg += strlen(arg) + 1;
+	return arg;
+}
+
+/*
+ * adopt
+ * description:
+ *     takes over the process of a recovered entry, if it is still the same process.
+ *     a process that was still starting is done with its start check, it survived
+ *     the restart of macD, but one with a readiness probe is probed again. The pipe
+ *     of a notify probe didn't survive, so it is taken as ready.
+ * parameters:
+ *     index: the index of the entry of the process table that takes it over.
+ *     entry: the recovered entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     0 if the process was adopted, -1 if it exited.
+ */
+static int adopt(int index, struct recovered *entry)
+{
+	struct process_info *info = &PROC_INFO[index];
+	int pid = entry->pid;
+
+	entry->pid = 0;
+	if (read_start_time(pid) != entry->start_time)
+		return -1;
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+	//the pid could have been reused before the pidfd pinned it.
+	if (pidfd == -1 || read_start_time(pid) != entry->start_time) {
+		if (pidfd != -1)
+			close(pidfd);
+		return -1;
+	}
+	struct journal_slot *slot = journal_slot(index);
+	struct epoll_event event = { .events = EPOLLIN, .data.u64 = index };
+
+	slot->start_time = entry->start_time;
+	slot->pidfd = pidfd;
+	epoll_ctl(JOURNAL_EPOLL, EPOLL_CTL_ADD, pidfd, &event);
+	PIDS[index] = pid;
+	clock_gettime(CLOCK_MONOTONIC, &info->started);
+	int mem;
+	int ticks = sample_process(index, &mem);
+
+	//the first report counts from now, not from when the process, or its tree with -T, started.
+	info->ticks = ticks > 0 ? ticks : 0;
+	info->cpu = 0;
+	info->mem = 0;
+	info->state = entry->state;
+	if (info->state == PROC_STARTING && info->probe == NULL)
+		info->state = PROC_RUNNING;
+	else if (info->state == PROC_STARTING && strcmp(info->probe, "notify") == 0)
+		info->state = PROC_READY;
+	else if (info->state == PROC_STARTING)
+		probe_start(index);
+	fprintf(OUTPUT_FILE, "[%d] %s, adopted (pid: %d)\n", index, info->argv[0], pid);
+	pthread_cond_broadcast(&STATECOND);
+	return 0;
+}
+
+/*
+ * matches
+ * description:
+ *     checks if a recovered entry is the one of a line of the process list file.
+ * parameters:
+ *     entry: the recovered entry.
+ *     info: the entry created from the line.
+ * returns:
+ *     1 if the process of entry is alive and it was created from the same line, 0 otherwise.
+ */
+static int matches(struct recovered *entry, struct process_info *info)
+{
+	return entry->pid != 0 && entry->spawned == 0 && entry->source_len == info->source_len &&
+	       memcmp(entry->source, info->source, info->source_len) == 0;
+}
+
+/*
+ * journal_adopt
+ * description:
+ *     adopts the process the previous macD ran for the same line of the
+ *     process list file, if it is still alive.
+ * parameters:
+ *     index: the index of the entry, created from a line of the process list file.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the entry hasn't been started.
+ * returns:
+ *     0 if the process was adopted, -1 if the entry must be started.
+ */
+int journal_adopt(int index)
+{
+	struct process_info *info = &PROC_INFO[index];
+	int found = -1;
+
+	if (JOURNAL_FD == -1 || info->source == NULL)
+		return -1;
+	//lines usually keep their index, so the entry with the same index is tried first.
+	if (index < RECOVERED_COUNT && matches(&RECOVERED[index], info))
+		found = index;
+	for (int i = 0; found == -1 && i < RECOVERED_COUNT; i++) {
+		if (matches(&RECOVERED[i], info))
+			found = i;
+	}
+	if (found == -1)
+		return -1;
+	return adopt(index, &RECOVERED[found]);
+}
+
+/*
+ * journal_adopt_remaining
+ * description:
+ *     adopts the processes clients spawned that are still alive, stops the ones
+ *     of lines removed from the process list file while macD wasn't running,
+ *     and rewrites the journal with the processes of the new process table.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     journal_adopt was called for every line of the process list file.
+ */
+void journal_adopt_remaining(void)
+{
+	if (JOURNAL_FD == -1)
+		return;
+	for (int i = 0; i < RECOVERED_COUNT; i++) {
+		struct recovered *entry = &RECOVERED[i];
+		struct process_info info;
+
+		if (entry->pid == 0)
+			continue;
+		if (read_start_time(entry->pid) != entry->start_time) {
+			entry->pid = 0;
+			continue;
+		}
+		int argc = 0;
+
+		for (int k = 0; k < entry->source_len; k++)
+			argc += entry->source[k] == '\0';
+		char **argv = malloc(sizeof(char *)*(argc+1));
+
+		argv[0] = entry->source;
+		for (int k = 1; k < argc; k++)
+			argv[k] = argv[k-1] + strlen(argv[k-1]) + 1;
+		argv[argc] = NULL;
+		char **command = parse_directives(argv, &info);
+
+		if (entry->spawned == 0) {
+			fprintf(OUTPUT_FILE, "[-] %s, removed (pid: %d)\n", source_command(entry), entry->pid);
+			stop_with_grace(-1, entry->pid, command != NULL ? info.stop_signal : SIGTERM);
+			if (command != NULL)
+				free_directives(&info);
+			free(argv);
+			continue;
+		}
+		if (command != NULL) {
+			info.source = entry->source;
+			info.source_len = entry->source_len;
+			info.spawned = 1;
+			info.announce = 1;
+			int index = add_entry(command, &info);
+
+			if (adopt(index, entry) == -1)
+				drop_process(index);
+		}
+		free(argv);
+	}
+	for (int i = 0; i < RECOVERED_COUNT; i++)
+		free(RECOVERED[i].source);
+	free(RECOVERED);
+	RECOVERED = NULL;
+	RECOVERED_COUNT = 0;
+	journal_compact();
+}
+
+/*
+ * journal_started
+ * description:
+ *     records that the process of an entry was created.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     PIDS[index] is the new process.
+ */
+void journal_started(int index)
+{
+	if (JOURNAL_FD == -1)
+		return;
+	journal_slot(index)->start_time = read_start_time(PIDS[index]);
+	journal_append(JOURNAL_START, index);
+}
+
+/*
+ * journal_state
+ * description:
+ *     records that the process of an entry passed its start check or its readiness probe.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void journal_state(int index)
+{
+	if (JOURNAL_FD == -1)
+		return;
+	journal_append(JOURNAL_STATE, index);
+}
+
+/*
+ * journal_exited
+ * description:
+ *     records that the process of an entry exited, and stops watching it if it was adopted.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void journal_exited(int index)
+{
+	if (JOURNAL_FD == -1)
+		return;
+	struct journal_slot *slot = journal_slot(index);
+
+	if (slot->pidfd != -1) {
+		epoll_ctl(JOURNAL_EPOLL, EPOLL_CTL_DEL, slot->pidfd, NULL);
+		close(slot->pidfd);
+		slot->pidfd = -1;
+	}
+	journal_append(JOURNAL_EXIT, index);
+}
+
+/*
+ * journal_events
+ * description:
+ *     handles the exits of adopted processes. They weren't waited on by macD,
+ *     so their exit status is unknown.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     called by the supervisor.
+ */
+void journal_events(void)
+{
+	struct epoll_event events[16];
+	int count;
+
+	while ((count = epoll_wait(JOURNAL_EPOLL, events, 16, 0)) > 0) {
+		for (int k = 0; k < count; k++) {
+			int index = events[k].data.u64;
+			int state = PROC_INFO[index].state;
+
+			if (JOURNAL[index].pidfd == -1)
+				continue;
+			if (state == PROC_STARTING || state == PROC_RUNNING || state == PROC_READY)
+				handle_exit(index, STATUS_UNKNOWN);
+			else
+				journal_exited(index);
+		}
+		if (count < 16)
+			break;
+	}
+}
+
+/*
+ * journal_compact
+ * description:
+ *     rewrites the journal with a record for each process that is alive.
+ *     the new journal is written next to the old one and renamed over it once
+ *     it is on disk, so there is always a complete journal to recover from.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void journal_compact(void)
+{
+	char *path = malloc(strlen(JOURNAL_PATH)+5);
+	long size = 0;
+
+	sprintf(path, "%s.new", JOURNAL_PATH);
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+
+	if (fd == -1) {
+		free(path);
+		return; //the old journal is still appended to
+	}
+	for (int i = 0; PIDS != NULL && PIDS[i] != -1; i++) {
+		int state = PROC_INFO[i].state;
+
+		if (state == PROC_STARTING || state == PROC_RUNNING || state == PROC_READY)
+			size += write_record(fd, JOURNAL_START, i);
+	}
+	if (fsync(fd) == -1 || rename(path, JOURNAL_PATH) == -1) {
+		close(fd);
+		unlink(path);
+		free(path);
+		return;
+	}
+	close(JOURNAL_FD);
+	JOURNAL_FD = fd;
+	JOURNAL_SIZE = size;
+	free(path);
+}
@@ -0,0 +1,103 @@
+/*
+ * journal_open
+ * description:
+ *     opens the journal, creating it if it doesn't exist, and reads the
+ *     processes the previous macD left running. macD becomes a child subreaper,
+ *     so the processes its children fork and leave behind are reparented to it
+ *     and reaped by the supervisor instead of outliving it unnoticed.
+ * parameters:
+ *     path: path of the journal.
+ * returns:
+ *     0 if the journal was opened, -1 otherwise.
+ */
+int journal_open(char *path);
+
+/*
+ * journal_watch_fd
+ * description:
+ *     the epoll set of the pidfds of the adopted processes.
+ * returns:
+ *     the descriptor of the set, for the supervisor to poll, or -1 if there is no journal.
+ */
+int journal_watch_fd(void);
+
+/*
+ * journal_adopt
+ * description:
+ *     adopts the process the previous macD ran for the same line of the
+ *     process list file, if it is still alive.
+ * parameters:
+ *     index: the index of the entry, created from a line of the process list file.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the entry hasn't been started.
+ * returns:
+ *     0 if the process was adopted, -1 if the entry must be started.
+ */
+int journal_adopt(int index);
+
+/*
+ * journal_adopt_remaining
+ * description:
+ *     adopts the processes clients spawned that are still alive, stops the ones
+ *     of lines removed from the process list file while macD wasn't running,
+ *     and rewrites the journal with the processes of the new process table.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     journal_adopt was called for every line of the process list file.
+ */
+void journal_adopt_remaining(void);
+
+/*
+ * journal_started
+ * description:
+ *     records that the process of an entry was created.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     PIDS[index] is the new process.
+ */
+void journal_started(int index);
+
+/*
+ * journal_state
+ * description:
+ *     records that the process of an entry passed its start check or its readiness probe.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void journal_state(int index);
+
+/*
+ * journal_exited
+ * description:
+ *     records that the process of an entry exited, and stops watching it if it was adopted.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void journal_exited(int index);
+
+/*
+ * journal_events
+ * description:
+ *     handles the exits of adopted processes. They weren't waited on by macD,
+ *     so their exit status is unknown.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     called by the supervisor.
+ */
+void journal_events(void);
+
+/*
+ * journal_compact
+ * description:
+ *     rewrites the journal with a record for each process that is alive.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void journal_compact(void);
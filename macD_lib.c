@@ -0,0 +1,942 @@
+/*
+ * macD_lib
+ * written by: Nathan Koop
+ *
+ * description:
+ *     libmacD, lets C and C++ programs send commands to macD directly
+ *     instead of running macD_c. A connection keeps a queue of the commands
+ *     to send and of the replies to read, so commands can be pipelined with
+ *     the non-blocking functions; the blocking functions are built on the same
+ *     queue and wait with poll. The socket is always non-blocking.
+ *     it also reads the status page macD publishes in shared memory.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "macD_socket.h"
+#include "macD_lib.h"
+
+/*
+ * macd_conn
+ * description:
+ *     a connection to macD, the commands queued on it and the reply being read.
+ */
+struct macd_conn {
+	int sock; //-1 once the connection is lost
+	char *path;
+	char *out; //commands not sent yet
+	int out_len;
+	int out_sent;
+	int out_cap;
+	struct macd_reply *pending; //ring of the commands waiting for a reply
+	int head;
+	int count;
+	int cap;
+	char header[8]; //fixed size part of the reply being read
+	int header_len;
+	int text_len; //bytes of the perf text read so far
+};
+
+//times the status page is found locked in a row before macd_status_read gives up.
+#define STATUS_SPINS 1000000
+
+/*
+ * macd_status
+ * description:
+ *     a mapping of the status page.
+ */
+struct macd_status {
+	int fd;
+	long size; //size of the mapping
+	struct macd_status_page *page;
+};
+
+/*
+ * reply_size
+ * description:
+ *     the size of the fixed part of the reply to a command.
+ * parameters:
+ *     command: one of the MACD_ commands.
+ * returns:
+ *     the size in bytes.
+ */
+static int reply_size(int command)
+{
+	return command == MACD_SPAWN ? 2*sizeof(int) : sizeof(int);
+}
+
+/*
+ * reconnect
+ * description:
+ *     reopens a connection that was lost.
+ * parameters:
+ *     conn: the connection.
+ * returns:
+ *     0 if the connection is open, -1 with errno set otherwise.
+ */
+static int reconnect(struct macd_conn *conn)
+{
+	if (conn->sock != -1)
+		return 0;
+	conn->sock = socket_connect(conn->path);
+	if (conn->sock == -1)
+		return -1;
+	fcntl(conn->sock, F_SETFL, fcntl(conn->sock, F_GETFL) | O_NONBLOCK);
+	return 0;
+}
+
+/*
+ * lose_connection
+ * description:
+ *     closes a connection that failed and drops what was queued on it.
+ * parameters:
+ *     conn: the connection.
+ *     error: the errno to report.
+ * returns:
+ *     -1.
+ */
+static int lose_connection(struct macd_conn *conn, int error)
+{
+	for (int i = 0; i < conn->count; i++)
+		free(conn->pending[(conn->head + i) % conn->cap].text);
+	if (conn->sock != -1)
+		close(conn->sock);
+	conn->sock = -1;
+	conn->out_len = 0;
+	conn->out_sent = 0;
+	conn->head = 0;
+	conn->count = 0;
+	conn->header_len = 0;
+	conn->text_len = 0;
+	errno = error;
+	return -1;
+}
+
+/*
+ * append
+ * description:
+ *     adds bytes to the commands waiting to be sent.
+ * parameters:
+ *     conn: the connection.
+ *     data: the bytes to add.
+ *     len: the number of bytes.
+ */
+static void append(struct macd_conn *conn, const void *data, int len)
+{
+	if (conn->out_len + len > conn->out_cap) {
+		//move what is left to send to the front before growing.
+		memmove(conn->out, conn->out + conn->out_sent, conn->out_len - conn->out_sent);
+		conn->out_len -= conn->out_sent;
+		conn->out_sent = 0;
+		while (conn->out_len + len > conn->out_cap)
+			conn->out_cap = conn->out_cap == 0 ? 256 : conn->out_cap*2;
+		conn->out = realloc(conn->out, conn->out_cap);
+	}
+	memcpy(conn->out + conn->out_len, data, len);
+	conn->out_len += len;
+}
+
+/*
+ * queue_command
+ * description:
+ *     queues a command and the reply it expects.
+ * parameters:
+ *     conn: the connection.
+ *     command: one of the MACD_ commands.
+ *     name: the 4 letter name of the command.
+ *     value: the index of a kill, tail, threads or process.
+ *     line: the line of a spawn or the name of a group, NULL for other commands.
+ * returns:
+ *     0 if the command was queued, -1 with errno set otherwise.
+ */
+static int queue_command(struct macd_conn *conn, int command, const char *name, int value, const char *line)
+{
+	int len = line == NULL ? 0 : strlen(line);
+	int max = command == MACD_SPAWN ? MACD_MAX_LINE : MACD_NAME_LENGTH-1;
+
+	//macD closes the connection on a line longer than it accepts, such lines and empty ones are refused here.
+	if (line != NULL && (len == 0 || len > max)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (reconnect(conn) == -1)
+		return -1;
+	if (conn->count == conn->cap) {
+		struct macd_reply *pending = malloc(sizeof(struct macd_reply)*(conn->cap == 0 ? 16 : conn->cap*2));
+
+		for (int i = 0; i < conn->count; i++)
+			pending[i] = conn->pending[(conn->head + i) % conn->cap];
+		free(conn->pending);
+		conn->pending = pending;
+		conn->cap = conn->cap == 0 ? 16 : conn->cap*2;
+		conn->head = 0;
+	}
+	struct macd_reply *reply = &conn->pending[(conn->head + conn->count) % conn->cap];
+
+	memset(reply, 0, sizeof(struct macd_reply));
+	reply->command = command;
+	reply->value = value;
+	conn->count++;
+	append(conn, name, 4);
+	if (command == MACD_KILL || command == MACD_TAIL || command == MACD_THREADS || command == MACD_PROCESS)
+		append(conn, &value, sizeof(int));
+	if (line != NULL) {
+		append(conn, &len, sizeof(int));
+		append(conn, line, len);
+	}
+	return 0;
+}
+
+/*
+ * macd_open
+ * description:
+ *     connects to macD. The connection is kept open and reused by every
+ *     command; if macD closes it, the next command reconnects.
+ * parameters:
+ *     path: the socket macD listens on, @name for an abstract socket,
+ *           or NULL for macd.socket.server in the working directory.
+ * returns:
+ *     the connection, or NULL with errno set if macD couldn't be reached.
+ */
+struct macd_conn *macd_open(const char *path)
+{
+	struct macd_conn *conn = calloc(1, sizeof(struct macd_conn));
+
+	conn->sock = -1;
+	conn->path = strdup(path == NULL ? DEFAULT_SOCKET_PATH : path);
+	if (reconnect(conn) == -1) {
+		int error = errno;
+
+		free(conn->path);
+		free(conn);
+		errno = error;
+		return NULL;
+	}
+	return conn;
+}
+
+/*
+ * macd_close
+ * description:
+ *     closes the connection and frees it, replies not yet read are lost.
+ * parameters:
+ *     conn: the connection to close.
+ */
+void macd_close(struct macd_conn *conn)
+{
+	if (conn == NULL)
+		return;
+	lose_connection(conn, 0);
+	free(conn->pending);
+	free(conn->out);
+	free(conn->path);
+	free(conn);
+}
+
+/*
+ * macd_send_stat, macd_send_kill, macd_send_spawn, macd_send_perf, macd_send_tail, macd_send_threads,
+ * macd_send_process, macd_send_top, macd_send_group_stat, macd_send_group_kill, macd_send_group_tail
+ * description:
+ *     queue a command without waiting for its reply. Any number of commands can be
+ *     queued, macD answers them in order. The queue is sent by macd_flush and the
+ *     replies are read by macd_read_reply.
+ * returns:
+ *     0 if the command was queued, -1 with errno set if macD couldn't be
+ *     reached or the line of a spawn or the name of a group is invalid.
+ */
+int macd_send_stat(struct macd_conn *conn)
+{
+	return queue_command(conn, MACD_STAT, "stat", 0, NULL);
+}
+
+int macd_send_kill(struct macd_conn *conn, int index)
+{
+	return queue_command(conn, MACD_KILL, "kill", index, NULL);
+}
+
+int macd_send_spawn(struct macd_conn *conn, const char *line)
+{
+	return queue_command(conn, MACD_SPAWN, "spwn", 0, line == NULL ? "" : line);
+}
+
+int macd_send_perf(struct macd_conn *conn)
+{
+	return queue_command(conn, MACD_PERF, "perf", 0, NULL);
+}
+
+int macd_send_tail(struct macd_conn *conn, int index)
+{
+	return queue_command(conn, MACD_TAIL, "tail", index, NULL);
+}
+
+int macd_send_threads(struct macd_conn *conn, int index)
+{
+	return queue_command(conn, MACD_THREADS, "thrd", index, NULL);
+}
+
+int macd_send_process(struct macd_conn *conn, int index)
+{
+	return queue_command(conn, MACD_PROCESS, "proc", index, NULL);
+}
+
+int macd_send_top(struct macd_conn *conn)
+{
+	return queue_command(conn, MACD_TOP, "topk", 0, NULL);
+}
+
+int macd_send_group_stat(struct macd_conn *conn, const char *group)
+{
+	return queue_command(conn, MACD_GROUP_STAT, "gsta", 0, group == NULL ? "" : group);
+}
+
+int macd_send_group_kill(struct macd_conn *conn, const char *group)
+{
+	return queue_command(conn, MACD_GROUP_KILL, "gkil", 0, group == NULL ? "" : group);
+}
+
+int macd_send_group_tail(struct macd_conn *conn, const char *group)
+{
+	return queue_command(conn, MACD_GROUP_TAIL, "gtal", 0, group == NULL ? "" : group);
+}
+
+/*
+ * macd_flush
+ * description:
+ *     sends as much of the queued commands as the socket accepts without blocking.
+ * parameters:
+ *     conn: the connection.
+ * returns:
+ *     0 if everything was sent, 1 if some is left (wait for POLLOUT on macd_fd),
+ *     -1 with errno set if the connection was lost.
+ */
+int macd_flush(struct macd_conn *conn)
+{
+	while (conn->out_sent < conn->out_len) {
+		if (conn->sock == -1) {
+			errno = ENOTCONN;
+			return -1;
+		}
+		int rc = send(conn->sock, conn->out + conn->out_sent, conn->out_len - conn->out_sent, MSG_NOSIGNAL);
+
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+		if (rc == -1)
+			return lose_connection(conn, errno);
+		conn->out_sent += rc;
+	}
+	conn->out_len = 0;
+	conn->out_sent = 0;
+	return 0;
+}
+
+/*
+ * receive
+ * description:
+ *     reads into buffer without blocking.
+ * parameters:
+ *     conn: the connection.
+ *     buffer: where to store the bytes.
+ *     len: the most bytes to read.
+ * returns:
+ *     the number of bytes read, 0 if none are available, -1 if the connection was lost.
+ */
+static int receive(struct macd_conn *conn, void *buffer, int len)
+{
+	while (1) {
+		int rc = recv(conn->sock, buffer, len, 0);
+
+		if (rc > 0)
+			return rc;
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+		return lose_connection(conn, rc == 0 ? ECONNRESET : errno);
+	}
+}
+
+/*
+ * macd_read_reply
+ * description:
+ *     reads what macD sent without blocking and returns the next reply once it is complete.
+ * parameters:
+ *     conn: the connection.
+ *     reply: filled with the reply.
+ * returns:
+ *     1 if reply was filled, 0 if no reply is complete yet (wait for POLLIN on macd_fd),
+ *     -1 with errno set if the connection was lost, the replies outstanding are lost with it.
+ */
+int macd_read_reply(struct macd_conn *conn, struct macd_reply *reply)
+{
+	if (conn->count == 0)
+		return 0;
+	if (conn->sock == -1) {
+		errno = ENOTCONN;
+		return -1;
+	}
+	struct macd_reply *head = &conn->pending[conn->head];
+	int size = reply_size(head->command);
+
+	while (conn->header_len < size) {
+		int rc = receive(conn, conn->header + conn->header_len, size - conn->header_len);
+
+		if (rc <= 0)
+			return rc;
+		conn->header_len += rc;
+	}
+	if (head->command == MACD_PERF || head->command == MACD_TOP ||
+	    head->command == MACD_TAIL || head->command == MACD_THREADS || head->command == MACD_PROCESS ||
+	    head->command == MACD_GROUP_STAT || head->command == MACD_GROUP_TAIL) {
+		if (head->text == NULL) {
+			memcpy(&head->len, conn->header, sizeof(int));
+			//only the commands on a process or a group can fail
+			if (head->len < -1 || (head->len == -1 && (head->command == MACD_PERF || head->command == MACD_TOP)))
+				return lose_connection(conn, EPROTO);
+			head->text = head->len == -1 ? NULL : malloc(head->len + 1);
+		}
+		while (conn->text_len < head->len) {
+			int rc = receive(conn, head->text + conn->text_len, head->len - conn->text_len);
+
+			if (rc <= 0)
+				return rc;
+			conn->text_len += rc;
+		}
+		if (head->text != NULL)
+			head->text[head->len] = '\0';
+		head->ok = head->text != NULL;
+	} else if (head->command == MACD_KILL) {
+		head->ok = memcmp(conn->header, "SUCC", 4) == 0;
+	} else if (head->command == MACD_SPAWN) {
+		memcpy(&head->value, conn->header, sizeof(int));
+		memcpy(&head->pid, conn->header + sizeof(int), sizeof(int));
+		head->ok = head->value != -1;
+	} else if (head->command == MACD_GROUP_KILL) {
+		memcpy(&head->value, conn->header, sizeof(int));
+		head->ok = head->value != -1;
+	} else {
+		memcpy(&head->value, conn->header, sizeof(int));
+		head->ok = 1;
+	}
+	*reply = *head;
+	conn->head = (conn->head + 1) % conn->cap;
+	conn->count--;
+	conn->header_len = 0;
+	conn->text_len = 0;
+	return 1;
+}
+
+/*
+ * macd_fd
+ * description:
+ *     the socket of the connection, to wait on with poll, select or epoll.
+ * returns:
+ *     the socket, or -1 if the connection was lost and not reopened yet.
+ */
+int macd_fd(struct macd_conn *conn)
+{
+	return conn->sock;
+}
+
+/*
+ * macd_events
+ * description:
+ *     the events to wait for on macd_fd.
+ * returns:
+ *     POLLIN if replies are outstanding, ored with POLLOUT if queued commands are left to send.
+ */
+int macd_events(struct macd_conn *conn)
+{
+	return (conn->count > 0 ? POLLIN : 0) | (conn->out_sent < conn->out_len ? POLLOUT : 0);
+}
+
+/*
+ * macd_pending
+ * description:
+ *     the number of commands whose reply hasn't been read yet.
+ */
+int macd_pending(struct macd_conn *conn)
+{
+	return conn->count;
+}
+
+/*
+ * wait_reply
+ * description:
+ *     sends the queued command and blocks until its reply is read.
+ * parameters:
+ *     conn: the connection, with exactly one command queued.
+ *     reply: filled with the reply.
+ * returns:
+ *     0 if the reply was read, -1 with errno set otherwise.
+ */
+static int wait_reply(struct macd_conn *conn, struct macd_reply *reply)
+{
+	while (1) {
+		int rc = macd_flush(conn);
+
+		if (rc == 0)
+			rc = macd_read_reply(conn, reply);
+		else if (rc == 1)
+			rc = 0;
+		if (rc == 1)
+			return 0;
+		if (rc == -1)
+			return -1;
+		struct pollfd fd = { .fd = conn->sock, .events = macd_events(conn) };
+
+		if (poll(&fd, 1, -1) == -1 && errno != EINTR)
+			return lose_connection(conn, errno);
+	}
+}
+
+/*
+ * call
+ * description:
+ *     queues a command and waits for its reply.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     command: one of the MACD_ commands.
+ *     index: the index of a kill, tail, threads or process.
+ *     line: the line of a spawn or the name of a group.
+ *     reply: filled with the reply.
+ * returns:
+ *     0 if the reply was read, -1 with errno set otherwise.
+ */
+static int call(struct macd_conn *conn, int command, int index, const char *line, struct macd_reply *reply)
+{
+	int rc;
+
+	//the reply read would belong to an earlier command.
+	if (conn->count > 0) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (command == MACD_STAT)
+		rc = macd_send_stat(conn);
+	else if (command == MACD_KILL)
+		rc = macd_send_kill(conn, index);
+	else if (command == MACD_SPAWN)
+		rc = macd_send_spawn(conn, line);
+	else if (command == MACD_TAIL)
+		rc = macd_send_tail(conn, index);
+	else if (command == MACD_THREADS)
+		rc = macd_send_threads(conn, index);
+	else if (command == MACD_PROCESS)
+		rc = macd_send_process(conn, index);
+	else if (command == MACD_TOP)
+		rc = macd_send_top(conn);
+	else if (command == MACD_GROUP_STAT)
+		rc = macd_send_group_stat(conn, line);
+	else if (command == MACD_GROUP_KILL)
+		rc = macd_send_group_kill(conn, line);
+	else if (command == MACD_GROUP_TAIL)
+		rc = macd_send_group_tail(conn, line);
+	else
+		rc = macd_send_perf(conn);
+	if (rc == -1)
+		return -1;
+	return wait_reply(conn, reply);
+}
+
+/*
+ * macd_stat
+ * description:
+ *     asks macD how many processes are running and waits for the answer.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     out_running: set to the number of running processes.
+ * returns:
+ *     0 on success, -1 with errno set if macD couldn't be reached.
+ */
+int macd_stat(struct macd_conn *conn, int *out_running)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_STAT, 0, NULL, &reply) == -1)
+		return -1;
+	*out_running = reply.value;
+	return 0;
+}
+
+/*
+ * macd_kill
+ * description:
+ *     asks macD to terminate a process and waits for the answer.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ * returns:
+ *     0 if the process was terminated, 1 if macD answered FAIL,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_kill(struct macd_conn *conn, int index)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_KILL, index, NULL, &reply) == -1)
+		return -1;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * macd_spawn
+ * description:
+ *     asks macD to start a process and waits until it is running.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     line: the command of the process, directives included, as in the process list file.
+ *     out_index: set to the index of the new process, can be NULL.
+ *     out_pid: set to the pid of the new process, can be NULL.
+ * returns:
+ *     0 if the process was started, 1 if it failed to start,
+ *     -1 with errno set if macD couldn't be reached or the line is invalid.
+ */
+int macd_spawn(struct macd_conn *conn, const char *line, int *out_index, int *out_pid)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_SPAWN, 0, line, &reply) == -1)
+		return -1;
+	if (out_index != NULL)
+		*out_index = reply.value;
+	if (out_pid != NULL)
+		*out_pid = reply.pid;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * macd_perf
+ * description:
+ *     fetches the internal statistics of macD, one key=value line per histogram.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     out_text: set to the statistics, to be freed with free.
+ *     out_len: set to the length of the statistics, can be NULL.
+ * returns:
+ *     0 on success, -1 with errno set if macD couldn't be reached.
+ */
+int macd_perf(struct macd_conn *conn, char **out_text, int *out_len)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_PERF, 0, NULL, &reply) == -1)
+		return -1;
+	*out_text = reply.text;
+	if (out_len != NULL)
+		*out_len = reply.len;
+	return 0;
+}
+
+/*
+ * macd_tail
+ * description:
+ *     fetches the latest output of a process, when macD captures output.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ *     out_text: set to the output, oldest first, to be freed with free.
+ *     out_len: set to the length of the output, can be NULL.
+ * returns:
+ *     0 on success, 1 if output isn't captured or the index is invalid,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_tail(struct macd_conn *conn, int index, char **out_text, int *out_len)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_TAIL, index, NULL, &reply) == -1)
+		return -1;
+	*out_text = reply.text;
+	if (out_len != NULL)
+		*out_len = reply.len;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * macd_threads
+ * description:
+ *     fetches the hottest threads of a process sampled with @threads in the
+ *     last report cycle, a line "index=[index] pid=[pid] threads=[count]"
+ *     followed by a line "tid=[tid] cpu=[percent] name=[name]" per thread.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ *     out_text: set to the threads, hottest first, to be freed with free.
+ *     out_len: set to the length of the text, can be NULL.
+ * returns:
+ *     0 on success, 1 if the threads of the process aren't sampled or the index is invalid,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_threads(struct macd_conn *conn, int index, char **out_text, int *out_len)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_THREADS, index, NULL, &reply) == -1)
+		return -1;
+	*out_text = reply.text;
+	if (out_len != NULL)
+		*out_len = reply.len;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * macd_process
+ * description:
+ *     fetches the usage of a process in the last report cycle, a line
+ *     "index=[index] pid=[pid] cpu=[percent] mem=[MB]", followed if macD runs with -I by
+ *     " storage_read=[bytes] storage_write=[bytes] voluntary=[switches] involuntary=[switches] wait=[us]"
+ *     where the counters are their growth in the cycle, storage_read and storage_write
+ *     are the bytes read from and written to the storage, not the page cache, and wait is
+ *     the time spent waiting on a run queue. The context switches and the wait are those
+ *     of the main thread of the process, or of all its threads if it has @threads.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ *     out_text: set to the line, to be freed with free.
+ *     out_len: set to the length of the line, can be NULL.
+ * returns:
+ *     0 on success, 1 if the process isn't running or the index is invalid,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_process(struct macd_conn *conn, int index, char **out_text, int *out_len)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_PROCESS, index, NULL, &reply) == -1)
+		return -1;
+	*out_text = reply.text;
+	if (out_len != NULL)
+		*out_len = reply.len;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * macd_top
+ * description:
+ *     fetches the fleet totals and the processes using the most cpu and memory
+ *     in the last report cycle of macD.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     out_text: set to the totals and rankings, to be freed with free.
+ *     out_len: set to the length of the text, can be NULL.
+ * returns:
+ *     0 on success, -1 with errno set if macD couldn't be reached.
+ */
+int macd_top(struct macd_conn *conn, char **out_text, int *out_len)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_TOP, 0, NULL, &reply) == -1)
+		return -1;
+	*out_text = reply.text;
+	if (out_len != NULL)
+		*out_len = reply.len;
+	return 0;
+}
+
+/*
+ * macd_group_stat
+ * description:
+ *     fetches the state of a group of processes, named with @group.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     group: the name of the group.
+ *     out_text: set to the state of the group, to be freed with free.
+ *     out_len: set to the length of the text, can be NULL.
+ * returns:
+ *     0 on success, 1 if no process belongs to the group,
+ *     -1 with errno set if macD couldn't be reached or the name is invalid.
+ */
+int macd_group_stat(struct macd_conn *conn, const char *group, char **out_text, int *out_len)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_GROUP_STAT, 0, group, &reply) == -1)
+		return -1;
+	*out_text = reply.text;
+	if (out_len != NULL)
+		*out_len = reply.len;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * macd_group_kill
+ * description:
+ *     asks macD to terminate every process of a group and waits for the answer.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     group: the name of the group.
+ *     out_killed: set to the number of processes terminated, can be NULL.
+ * returns:
+ *     0 on success, 1 if no process belongs to the group,
+ *     -1 with errno set if macD couldn't be reached or the name is invalid.
+ */
+int macd_group_kill(struct macd_conn *conn, const char *group, int *out_killed)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_GROUP_KILL, 0, group, &reply) == -1)
+		return -1;
+	if (out_killed != NULL)
+		*out_killed = reply.ok ? reply.value : 0;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * macd_group_tail
+ * description:
+ *     fetches the latest output of every process of a group, when macD captures output.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     group: the name of the group.
+ *     out_text: set to the output, to be freed with free.
+ *     out_len: set to the length of the output, can be NULL.
+ * returns:
+ *     0 on success, 1 if output isn't captured or no process belongs to the group,
+ *     -1 with errno set if macD couldn't be reached or the name is invalid.
+ */
+int macd_group_tail(struct macd_conn *conn, const char *group, char **out_text, int *out_len)
+{
+	struct macd_reply reply;
+
+	if (call(conn, MACD_GROUP_TAIL, 0, group, &reply) == -1)
+		return -1;
+	*out_text = reply.text;
+	if (out_len != NULL)
+		*out_len = reply.len;
+	return reply.ok ? 0 : 1;
+}
+
+/*
+ * status_map
+ * description:
+ *     maps the whole status page, again if macD grew it.
+ * parameters:
+ *     status: the status page.
+ * returns:
+ *     0 if the page is mapped, -1 with errno set otherwise.
+ */
+static int status_map(struct macd_status *status)
+{
+	struct stat st;
+
+	if (fstat(status->fd, &st) == -1)
+		return -1;
+	if ((unsigned long)st.st_size < sizeof(struct macd_status_page)) {
+		errno = EPROTO;
+		return -1;
+	}
+	void *page = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, status->fd, 0);
+
+	if (page == MAP_FAILED)
+		return -1;
+	if (status->page != NULL)
+		munmap(status->page, status->size);
+	status->page = page;
+	status->size = st.st_size;
+	return 0;
+}
+
+/*
+ * macd_status_open
+ * description:
+ *     maps the status page macD publishes when it is started with -m.
+ *     reading it afterwards makes no system call and doesn't involve macD.
+ * parameters:
+ *     name: the name given to macD with -m.
+ * returns:
+ *     the mapped page, or NULL with errno set if it doesn't exist.
+ */
+struct macd_status *macd_status_open(const char *name)
+{
+	char path[256];
+	struct macd_status *status = calloc(1, sizeof(struct macd_status));
+
+	snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+	status->fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+	if (status->fd == -1 || status_map(status) == -1 || status->page->magic != MACD_STATUS_MAGIC ||
+	    status->page->version != MACD_STATUS_VERSION) {
+		int error = status->fd != -1 && status->page != NULL ? EPROTO : errno;
+
+		macd_status_close(status);
+		errno = error;
+		return NULL;
+	}
+	return status;
+}
+
+/*
+ * macd_status_read
+ * description:
+ *     copies a consistent snapshot of the status page.
+ * parameters:
+ *     status: the mapped page.
+ *     header: filled with the header of the page, can be NULL.
+ *     out: filled with the first max entries of the process table.
+ *     max: the number of entries out has room for.
+ * returns:
+ *     the number of entries in the process table, which can be more than max,
+ *     or -1 with errno set if the page is invalid or stays locked.
+ */
+int macd_status_read(struct macd_status *status, struct macd_status_page *header, struct macd_status_process *out, int max)
+{
+	struct macd_status_page *page = status->page;
+
+	for (int spins = 0; spins < STATUS_SPINS; spins++) {
+		unsigned long seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+
+		if (seq & 1)
+			continue; //macD is writing the page
+		int capacity = page->capacity;
+		int count = page->count;
+
+		if (sizeof(struct macd_status_page) + capacity*sizeof(struct macd_status_process) > (unsigned long)status->size) {
+			//macD grew the page since it was mapped, the only case where a read makes system calls.
+			if (status_map(status) == -1)
+				return -1;
+			page = status->page;
+			continue;
+		}
+		if (count < 0 || count > capacity)
+			continue; //torn read, seq will have changed
+		if (header != NULL)
+			memcpy(header, page, sizeof(struct macd_status_page));
+		memcpy(out, page->processes, sizeof(struct macd_status_process)*(count < max ? count : max));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+			return count;
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+/*
+ * macd_status_close
+ * description:
+ *     unmaps the status page.
+ * parameters:
+ *     status: the mapped page.
+ */
+void macd_status_close(struct macd_status *status)
+{
+	if (status == NULL)
+		return;
+	if (status->page != NULL)
+		munmap(status->page, status->size);
+	if (status->fd != -1)
+		close(status->fd);
+	free(status);
+}
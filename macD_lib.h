@@ -0,0 +1,396 @@
+/*
+ * libmacD, a client library for the control protocol of macD
+ * and the reader of its shared memory status page.
+ * build it with "make libmacD.a" and link with -L. -lmacD.
+ * a connection may only be used by one thread at a time.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//commands of a reply.
+#define MACD_STAT 0
+#define MACD_KILL 1
+#define MACD_SPAWN 2
+#define MACD_PERF 3
+#define MACD_TAIL 4
+#define MACD_TOP 5
+#define MACD_GROUP_STAT 6
+#define MACD_GROUP_KILL 7
+#define MACD_GROUP_TAIL 8
+#define MACD_THREADS 9
+#define MACD_PROCESS 10
+//longest line a spawn request can carry.
+#define MACD_MAX_LINE 65536
+
+/*
+ * macd_reply
+ * description:
+ *     the reply to a command sent with the non-blocking functions.
+ */
+struct macd_reply {
+	int command; //one of the MACD_ commands
+	int ok; //1 if the command succeeded, 0 if macD answered FAIL
+	int value; //running processes for stat, index of the process for kill, spawn, tail, threads and process, processes terminated for group kill
+	int pid; //pid of the spawned process
+	char *text; //statistics of perf, output of tail and group tail, hottest threads of threads, usage of process, rankings of top or state of group stat, to be freed with free, NULL for other commands
+	int len; //length of text
+};
+
+struct macd_conn;
+
+/*
+ * macd_open
+ * description:
+ *     connects to macD. The connection is kept open and reused by every
+ *     command; if macD closes it, the next command reconnects.
+ * parameters:
+ *     path: the socket macD listens on, @name for an abstract socket,
+ *           or NULL for macd.socket.server in the working directory.
+ * returns:
+ *     the connection, or NULL with errno set if macD couldn't be reached.
+ */
+struct macd_conn *macd_open(const char *path);
+
+/*
+ * macd_close
+ * description:
+ *     closes the connection and frees it, replies not yet read are lost.
+ * parameters:
+ *     conn: the connection to close.
+ */
+void macd_close(struct macd_conn *conn);
+
+/*
+ * macd_stat
+ * description:
+ *     asks macD how many processes are running and waits for the answer.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     out_running: set to the number of running processes.
+ * returns:
+ *     0 on success, -1 with errno set if macD couldn't be reached.
+ */
+int macd_stat(struct macd_conn *conn, int *out_running);
+
+/*
+ * macd_kill
+ * description:
+ *     asks macD to terminate a process and waits for the answer.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ * returns:
+ *     0 if the process was terminated, 1 if macD answered FAIL,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_kill(struct macd_conn *conn, int index);
+
+/*
+ * macd_spawn
+ * description:
+ *     asks macD to start a process and waits until it is running.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     line: the command of the process, directives included, as in the process list file.
+ *     out_index: set to the index of the new process, can be NULL.
+ *     out_pid: set to the pid of the new process, can be NULL.
+ * returns:
+ *     0 if the process was started, 1 if it failed to start,
+ *     -1 with errno set if macD couldn't be reached or the line is invalid.
+ */
+int macd_spawn(struct macd_conn *conn, const char *line, int *out_index, int *out_pid);
+
+/*
+ * macd_perf
+ * description:
+ *     fetches the internal statistics of macD, one key=value line per histogram.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     out_text: set to the statistics, to be freed with free.
+ *     out_len: set to the length of the statistics, can be NULL.
+ * returns:
+ *     0 on success, -1 with errno set if macD couldn't be reached.
+ */
+int macd_perf(struct macd_conn *conn, char **out_text, int *out_len);
+
+/*
+ * macd_tail
+ * description:
+ *     fetches the latest output of a process, when macD captures output.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ *     out_text: set to the output, oldest first, to be freed with free.
+ *     out_len: set to the length of the output, can be NULL.
+ * returns:
+ *     0 on success, 1 if output isn't captured or the index is invalid,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_tail(struct macd_conn *conn, int index, char **out_text, int *out_len);
+
+/*
+ * macd_threads
+ * description:
+ *     fetches the hottest threads of a process sampled with @threads in the
+ *     last report cycle, a line "index=[index] pid=[pid] threads=[count]"
+ *     followed by a line "tid=[tid] cpu=[percent] name=[name]" per thread.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ *     out_text: set to the threads, hottest first, to be freed with free.
+ *     out_len: set to the length of the text, can be NULL.
+ * returns:
+ *     0 on success, 1 if the threads of the process aren't sampled or the index is invalid,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_threads(struct macd_conn *conn, int index, char **out_text, int *out_len);
+
+/*
+ * macd_process
+ * description:
+ *     fetches the usage of a process in the last report cycle, a line
+ *     "index=[index] pid=[pid] cpu=[percent] mem=[MB]", followed if macD runs with -I by
+ *     " storage_read=[bytes] storage_write=[bytes] voluntary=[switches] involuntary=[switches] wait=[us]"
+ *     where the counters are their growth in the cycle, storage_read and storage_write
+ *     are the bytes read from and written to the storage, not the page cache, and wait is
+ *     the time spent waiting on a run queue. The context switches and the wait are those
+ *     of the main thread of the process, or of all its threads if it has @threads.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     index: the index of the process.
+ *     out_text: set to the line, to be freed with free.
+ *     out_len: set to the length of the line, can be NULL.
+ * returns:
+ *     0 on success, 1 if the process isn't running or the index is invalid,
+ *     -1 with errno set if macD couldn't be reached.
+ */
+int macd_process(struct macd_conn *conn, int index, char **out_text, int *out_len);
+
+/*
+ * macd_top
+ * description:
+ *     fetches the fleet totals and the processes using the most cpu and memory
+ *     in the last report cycle of macD. The first line holds the totals,
+ *     "cycle=C processes=N running=R starting=S backoff=B exited=E cpu=[percent] mem=[MB]",
+ *     followed by up to 10 lines "cpu index=I pid=P value=[percent]" and
+ *     up to 10 lines "mem index=I pid=P value=[MB]", largest first.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     out_text: set to the totals and rankings, to be freed with free.
+ *     out_len: set to the length of the text, can be NULL.
+ * returns:
+ *     0 on success, -1 with errno set if macD couldn't be reached.
+ */
+int macd_top(struct macd_conn *conn, char **out_text, int *out_len);
+
+/*
+ * macd_group_stat
+ * description:
+ *     fetches the state of a group of processes, named with @group. The first line
+ *     holds the totals, "group=[name] processes=N running=R cpu=[percent] mem=[MB]",
+ *     followed by a line per process "index=I pid=P state=S cpu=[percent] mem=[MB]".
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     group: the name of the group.
+ *     out_text: set to the state of the group, to be freed with free.
+ *     out_len: set to the length of the text, can be NULL.
+ * returns:
+ *     0 on success, 1 if no process belongs to the group,
+ *     -1 with errno set if macD couldn't be reached or the name is invalid.
+ */
+int macd_group_stat(struct macd_conn *conn, const char *group, char **out_text, int *out_len);
+
+/*
+ * macd_group_kill
+ * description:
+ *     asks macD to terminate every process of a group and waits for the answer.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     group: the name of the group.
+ *     out_killed: set to the number of processes terminated, can be NULL.
+ * returns:
+ *     0 on success, 1 if no process belongs to the group,
+ *     -1 with errno set if macD couldn't be reached or the name is invalid.
+ */
+int macd_group_kill(struct macd_conn *conn, const char *group, int *out_killed);
+
+/*
+ * macd_group_tail
+ * description:
+ *     fetches the latest output of every process of a group, each preceded by
+ *     a line "==> [index] <==", when macD captures output.
+ * parameters:
+ *     conn: the connection, with no reply outstanding.
+ *     group: the name of the group.
+ *     out_text: set to the output, to be freed with free.
+ *     out_len: set to the length of the output, can be NULL.
+ * returns:
+ *     0 on success, 1 if output isn't captured or no process belongs to the group,
+ *     -1 with errno set if macD couldn't be reached or the name is invalid.
+ */
+int macd_group_tail(struct macd_conn *conn, const char *group, char **out_text, int *out_len);
+
+/*
+ * macd_send_stat, macd_send_kill, macd_send_spawn, macd_send_perf, macd_send_tail, macd_send_threads,
+ * macd_send_process, macd_send_top, macd_send_group_stat, macd_send_group_kill, macd_send_group_tail
+ * description:
+ *     queue a command without waiting for its reply. Any number of commands can be
+ *     queued, macD answers them in order. The queue is sent by macd_flush and the
+ *     replies are read by macd_read_reply.
+ * returns:
+ *     0 if the command was queued, -1 with errno set if macD couldn't be
+ *     reached or the line of a spawn or the name of a group is invalid.
+ */
+int macd_send_stat(struct macd_conn *conn);
+int macd_send_kill(struct macd_conn *conn, int index);
+int macd_send_spawn(struct macd_conn *conn, const char *line);
+int macd_send_perf(struct macd_conn *conn);
+int macd_send_tail(struct macd_conn *conn, int index);
+int macd_send_threads(struct macd_conn *conn, int index);
+int macd_send_process(struct macd_conn *conn, int index);
+int macd_send_top(struct macd_conn *conn);
+int macd_send_group_stat(struct macd_conn *conn, const char *group);
+int macd_send_group_kill(struct macd_conn *conn, const char *group);
+int macd_send_group_tail(struct macd_conn *conn, const char *group);
+
+/*
+ * macd_flush
+ * description:
+ *     sends as much of the queued commands as the socket accepts without blocking.
+ * parameters:
+ *     conn: the connection.
+ * returns:
+ *     0 if everything was sent, 1 if some is left (wait for POLLOUT on macd_fd),
+ *     -1 with errno set if the connection was lost.
+ */
+int macd_flush(struct macd_conn *conn);
+
+/*
+ * macd_read_reply
+ * description:
+ *     reads what macD sent without blocking and returns the next reply once it is complete.
+ * parameters:
+ *     conn: the connection.
+ *     reply: filled with the reply.
+ * returns:
+ *     1 if reply was filled, 0 if no reply is complete yet (wait for POLLIN on macd_fd),
+ *     -1 with errno set if the connection was lost, the replies outstanding are lost with it.
+ */
+int macd_read_reply(struct macd_conn *conn, struct macd_reply *reply);
+
+/*
+ * macd_fd
+ * description:
+ *     the socket of the connection, to wait on with poll, select or epoll.
+ * returns:
+ *     the socket, or -1 if the connection was lost and not reopened yet.
+ */
+int macd_fd(struct macd_conn *conn);
+
+/*
+ * macd_events
+ * description:
+ *     the events to wait for on macd_fd.
+ * returns:
+ *     POLLIN if replies are outstanding, ored with POLLOUT if queued commands are left to send.
+ */
+int macd_events(struct macd_conn *conn);
+
+/*
+ * macd_pending
+ * description:
+ *     the number of commands whose reply hasn't been read yet.
+ */
+int macd_pending(struct macd_conn *conn);
+
+//the status page macD publishes with -m, see macd_status_open.
+#define MACD_STATUS_MAGIC 0x4463616d
+#define MACD_STATUS_VERSION 1
+#define MACD_NAME_LENGTH 32
+//states of a process, the same values as the PROC_ states of macD.h.
+#define MACD_EXITED 0
+#define MACD_STARTING 1
+#define MACD_RUNNING 2
+#define MACD_BACKOFF 3
+#define MACD_WAITING 4
+#define MACD_READY 5
+
+/*
+ * macd_status_process
+ * description:
+ *     an entry of the process table in the status page.
+ */
+struct macd_status_process {
+	int pid; //pid of the last run, 0 if it never started
+	int state; //one of the MACD_ states
+	int cpu; //cpu usage, as a percent, in the last report cycle
+	int mem; //memory usage, in MB, in the last report cycle
+	int restarts; //number of times the process was restarted
+	int removed; //1 if its line was removed from the process list file
+	unsigned long started; //unix time, in ns, the process was last created
+	char name[MACD_NAME_LENGTH]; //first argument of the process, truncated
+	char group[MACD_NAME_LENGTH]; //group of the process, empty if none
+};
+
+/*
+ * macd_status_page
+ * description:
+ *     the header of the status page, followed by capacity entries.
+ *     macD makes seq odd while it writes the page and even once it is done,
+ *     so a copy taken between two equal even values of seq is consistent.
+ */
+struct macd_status_page {
+	unsigned int magic; //MACD_STATUS_MAGIC
+	unsigned int version; //MACD_STATUS_VERSION
+	unsigned long seq;
+	int capacity; //entries the segment has room for
+	int count; //entries in the process table
+	int running; //processes running
+	int pid; //pid of macD
+	unsigned long updated; //unix time, in ns, of the last update
+	unsigned long cycles; //number of updates since macD started
+	struct macd_status_process processes[];
+};
+
+struct macd_status;
+
+/*
+ * macd_status_open
+ * description:
+ *     maps the status page macD publishes when it is started with -m.
+ *     reading it afterwards makes no system call and doesn't involve macD.
+ * parameters:
+ *     name: the name given to macD with -m.
+ * returns:
+ *     the mapped page, or NULL with errno set if it doesn't exist.
+ */
+struct macd_status *macd_status_open(const char *name);
+
+/*
+ * macd_status_read
+ * description:
+ *     copies a consistent snapshot of the status page.
+ * parameters:
+ *     status: the mapped page.
+ *     header: filled with the header of the page, can be NULL.
+ *     out: filled with the first max entries of the process table.
+ *     max: the number of entries out has room for.
+ * returns:
+ *     the number of entries in the process table, which can be more than max,
+ *     or -1 with errno set if the page is invalid or stays locked.
+ */
+int macd_status_read(struct macd_status *status, struct macd_status_page *header, struct macd_status_process *out, int max);
+
+/*
+ * macd_status_close
+ * description:
+ *     unmaps the status page.
+ * parameters:
+ *     status: the mapped page.
+ */
+void macd_status_close(struct macd_status *status);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,369 @@
+/*
+ * macD_load
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the load generator of macD_c. Opens many connections to macD and
+ *     sends a mix of requests over them, either as fast as the server
+ *     answers or at a target rate, then reports the throughput and the
+ *     latency percentiles. Each thread drives its share of the connections
+ *     with epoll and keeps at most one request outstanding per connection.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "macD_hist.h"
+#include "macD_load.h"
+#include "macD_c.h"
+
+//how long the replies of a timed run are waited for once it is over, in ns.
+#define DRAIN_NS 2000000000UL
+
+/*
+ * load_worker
+ * description:
+ *     a load thread and the connections it drives.
+ */
+struct load_worker {
+	pthread_t thread;
+	struct load_options *options;
+	int count; //number of connections of the worker
+	int *socks;
+	unsigned long *due; //when the request outstanding on each connection was due
+	int *received; //bytes of the reply received on each connection
+	int *idle; //stack of the connections with no request outstanding
+	int num_idle;
+	int open; //connections still open
+	long quota; //requests to send, -1 for a timed run
+	double rate; //requests per second for this worker, 0 for as fast as possible
+	long issued;
+	long completed;
+	long errors;
+	unsigned long start;
+	unsigned long end;
+	struct histogram hist;
+};
+
+char *MIX[16];
+int MIX_LEN = 0;
+pthread_barrier_t LOAD_BARRIER;
+
+/*
+ * load_now
+ * description:
+ *     reads the monotonic clock.
+ * returns:
+ *     the current time in ns.
+ */
+static unsigned long load_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000UL + now.tv_nsec;
+}
+
+/*
+ * load_default_options
+ * description:
+ *     sets every field of options to its default value.
+ * parameters:
+ *     options: the options to initialize.
+ */
+void load_default_options(struct load_options *options)
+{
+	options->connections = 100;
+	options->threads = 4;
+	options->requests = 100000;
+	options->duration = 0;
+	options->rate = 0;
+	options->mix = "stat";
+	options->kill_index = -1;
+}
+
+/*
+ * parse_mix
+ * description:
+ *     splits the mix of commands into MIX.
+ * parameters:
+ *     mix: comma separated list of commands.
+ * returns:
+ *     0 if every command can be sent by the load generator, -1 otherwise.
+ */
+static int parse_mix(char *mix)
+{
+	char *copy = strdup(mix);
+	char *save;
+	int valid = 1;
+
+	for (char *token = strtok_r(copy, ",", &save); token != NULL && valid == 1; token = strtok_r(NULL, ",", &save)) {
+		if (MIX_LEN == (int)(sizeof(MIX)/sizeof(char *)))
+			valid = 0;
+		else if (strcasecmp(token, "stat") == 0)
+			MIX[MIX_LEN++] = "stat";
+		else if (strcasecmp(token, "kill") == 0)
+			MIX[MIX_LEN++] = "kill";
+		else
+			valid = 0;
+	}
+	free(copy);
+	return valid == 1 && MIX_LEN > 0 ? 0 : -1;
+}
+
+/*
+ * load_connect
+ * description:
+ *     opens a non-blocking connection to the server.
+ * returns:
+ *     the connected socket, or -1 if the server couldn't be reached.
+ */
+static int load_connect(void)
+{
+	int sock = connect_server();
+
+	if (sock != -1)
+		fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	return sock;
+}
+
+/*
+ * send_request
+ * description:
+ *     sends the next command of the mix over a connection.
+ * parameters:
+ *     worker: the worker owning the connection.
+ *     conn: the index of the connection in the worker.
+ *     due: when the request was due to be sent.
+ * returns:
+ *     0 if the request was sent, -1 if the connection failed.
+ */
+static int send_request(struct load_worker *worker, int conn, unsigned long due)
+{
+	char request[8];
+	int len = 4;
+	char *command = MIX[worker->issued % MIX_LEN];
+
+	memcpy(request, command, 4);
+	if (strcmp(command, "kill") == 0) {
+		memcpy(request+4, &worker->options->kill_index, sizeof(int));
+		len = 8;
+	}
+	worker->issued++;
+	if (send(worker->socks[conn], request, len, MSG_NOSIGNAL) != len)
+		return -1;
+	worker->due[conn] = due;
+	return 0;
+}
+
+/*
+ * drop_connection
+ * description:
+ *     closes a connection that failed or that the server closed, it counts as an error.
+ *     an idle connection is taken off the idle stack so it isn't used again.
+ * parameters:
+ *     worker: the worker owning the connection.
+ *     conn: the index of the connection in the worker.
+ */
+static void drop_connection(struct load_worker *worker, int conn)
+{
+	if (worker->socks[conn] == -1)
+		return;
+	for (int i = 0; i < worker->num_idle; i++) {
+		if (worker->idle[i] == conn) {
+			worker->idle[i] = worker->idle[--worker->num_idle];
+			break;
+		}
+	}
+	close(worker->socks[conn]);
+	worker->socks[conn] = -1;
+	worker->open--;
+	worker->errors++;
+}
+
+/*
+ * read_reply
+ * description:
+ *     reads what the server sent on a connection and records the latency of a complete reply.
+ * parameters:
+ *     worker: the worker owning the connection.
+ *     conn: the index of the connection in the worker.
+ */
+static void read_reply(struct load_worker *worker, int conn)
+{
+	char reply[4];
+	int wanted = sizeof(reply) - worker->received[conn];
+	int rec = recv(worker->socks[conn], reply, wanted, 0);
+
+	if (rec == -1 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (rec <= 0) {
+		drop_connection(worker, conn);
+		return;
+	}
+	worker->received[conn] += rec;
+	if (worker->received[conn] < (int)sizeof(reply))
+		return;
+	hist_record(&worker->hist, load_now() - worker->due[conn]);
+	worker->received[conn] = 0;
+	worker->completed++;
+	worker->idle[worker->num_idle++] = conn;
+}
+
+/*
+ * load_worker
+ * description:
+ *     the thread function of a load thread, sends requests over its
+ *     share of the connections until its share of the run is done.
+ * parameters:
+ *     vargp: the worker's struct load_worker.
+ */
+void *load_worker(void *vargp)
+{
+	struct load_worker *worker = vargp;
+	struct epoll_event events[64];
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	for (int i = 0; i < worker->count; i++) {
+		struct epoll_event event;
+
+		event.events = EPOLLIN;
+		event.data.u32 = i;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, worker->socks[i], &event);
+		worker->idle[worker->num_idle++] = i;
+	}
+	pthread_barrier_wait(&LOAD_BARRIER);
+	worker->start = load_now();
+	unsigned long deadline = worker->start + (unsigned long)(worker->options->duration*1e9);
+
+	while (worker->open > 0) {
+		unsigned long now = load_now();
+		int sending = worker->quota < 0 ? now < deadline : worker->issued < worker->quota;
+		unsigned long next_due = now;
+
+		while (sending && worker->num_idle > 0) {
+			if (worker->rate > 0)
+				next_due = worker->start + (unsigned long)(worker->issued*1e9/worker->rate);
+			if (next_due > now)
+				break;
+			int conn = worker->idle[--worker->num_idle];
+
+			if (send_request(worker, conn, next_due) == -1)
+				drop_connection(worker, conn);
+			sending = worker->quota < 0 ? now < deadline : worker->issued < worker->quota;
+		}
+		if (!sending && worker->num_idle == worker->open)
+			break; //every reply is in
+		if (!sending && worker->quota < 0 && now > deadline + DRAIN_NS)
+			break;
+		int timeout = 100;
+
+		if (sending && worker->num_idle > 0 && next_due > now)
+			timeout = (next_due - now + 999999)/1000000;
+		int n = epoll_wait(epfd, events, 64, timeout);
+
+		for (int i = 0; i < n; i++)
+			read_reply(worker, events[i].data.u32);
+	}
+	worker->end = load_now();
+	//requests that never got a reply are errors.
+	worker->errors += worker->open - worker->num_idle;
+	for (int i = 0; i < worker->count; i++) {
+		if (worker->socks[i] != -1)
+			close(worker->socks[i]);
+	}
+	close(epfd);
+	return NULL;
+}
+
+/*
+ * run_load
+ * description:
+ *     opens the connections, sends requests over them as described by options,
+ *     then prints the throughput and the latency percentiles to stdout.
+ *     with a rate, latency is measured from the time a request was due to be sent,
+ *     so a server that falls behind is not hidden by requests waiting for a free connection.
+ * parameters:
+ *     options: the settings of the run.
+ * returns:
+ *     0 if every request got a reply, 1 otherwise.
+ */
+int run_load(struct load_options *options)
+{
+	if (options->connections <= 0 || options->threads <= 0 || options->rate < 0 ||
+	    (options->duration <= 0 && options->requests <= 0) || parse_mix(options->mix) == -1) {
+		fprintf(stderr, "invalid load options\n");
+		return 1;
+	}
+	if (options->threads > options->connections)
+		options->threads = options->connections;
+	int threads = options->threads;
+	struct load_worker *workers = calloc(threads, sizeof(struct load_worker));
+	int assigned = 0;
+
+	for (int t = 0; t < threads; t++) {
+		struct load_worker *worker = &workers[t];
+
+		worker->options = options;
+		worker->count = options->connections/threads + (t < options->connections%threads);
+		worker->socks = malloc(sizeof(int)*worker->count);
+		worker->due = calloc(worker->count, sizeof(unsigned long));
+		worker->received = calloc(worker->count, sizeof(int));
+		worker->idle = malloc(sizeof(int)*worker->count);
+		worker->quota = -1;
+		if (options->duration <= 0)
+			worker->quota = options->requests/threads + (t < options->requests%threads);
+		worker->rate = options->rate*worker->count/options->connections;
+		hist_init(&worker->hist);
+		for (int i = 0; i < worker->count; i++) {
+			worker->socks[i] = load_connect();
+			if (worker->socks[i] == -1) {
+				fprintf(stderr, "couldn't open connection %d: %s\n", assigned, strerror(errno));
+				exit(1);
+			}
+			assigned++;
+		}
+		worker->open = worker->count;
+	}
+	pthread_barrier_init(&LOAD_BARRIER, NULL, threads+1);
+	for (int t = 0; t < threads; t++)
+		pthread_create(&workers[t].thread, NULL, load_worker, &workers[t]);
+	pthread_barrier_wait(&LOAD_BARRIER);
+	unsigned long start = load_now();
+	unsigned long end = start;
+	struct histogram total;
+	long completed = 0;
+	long errors = 0;
+
+	hist_init(&total);
+	for (int t = 0; t < threads; t++) {
+		pthread_join(workers[t].thread, NULL);
+		hist_merge(&total, &workers[t].hist);
+		completed += workers[t].completed;
+		errors += workers[t].errors;
+		if (workers[t].end > end)
+			end = workers[t].end;
+		free(workers[t].socks);
+		free(workers[t].due);
+		free(workers[t].received);
+		free(workers[t].idle);
+	}
+	free(workers);
+	pthread_barrier_destroy(&LOAD_BARRIER);
+	double elapsed = (end - start)/1e9;
+
+	printf("load connections=%d threads=%d mix=%s rate=%.0f requests=%ld errors=%ld elapsed=%.3f throughput=%.0f\n",
+		options->connections, threads, options->mix, options->rate, completed, errors,
+		elapsed, elapsed > 0 ? completed/elapsed : 0);
+	hist_print(stdout, "latency unit=us", &total, 1000);
+	return errors > 0 ? 1 : 0;
+}
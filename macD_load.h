@@ -0,0 +1,47 @@
+/*
+ * load_options
+ * description:
+ *     the settings of a load run, read from the command line of macD_c.
+ */
+struct load_options {
+	int connections; //number of connections to the server
+	int threads; //number of threads sharing the connections
+	long requests; //total number of requests to send, used if duration is 0
+	double duration; //seconds to send requests for, 0 to send a number of requests
+	double rate; //requests per second over all connections, 0 to send as fast as possible
+	char *mix; //comma separated list of the commands to send in turn, ie "stat,kill"
+	int kill_index; //index sent with kill commands
+};
+
+/*
+ * load_default_options
+ * description:
+ *     sets every field of options to its default value.
+ * parameters:
+ *     options: the options to initialize.
+ */
+void load_default_options(struct load_options *options);
+
+/*
+ * run_load
+ * description:
+ *     opens the connections, sends requests over them as described by options,
+ *     then prints the throughput and the latency percentiles to stdout.
+ *     with a rate, latency is measured from the time a request was due to be sent,
+ *     so a server that falls behind is not hidden by requests waiting for a free connection.
+ * parameters:
+ *     options: the settings of the run.
+ * returns:
+ *     0 if every request got a reply, 1 otherwise.
+ */
+int run_load(struct load_options *options);
+
+/*
+ * load_worker
+ * description:
+ *     the thread function of a load thread, sends requests over its
+ *     share of the connections until its share of the run is done.
+ * parameters:
+ *     vargp: the worker's struct load_worker.
+ */
+void *load_worker(void *vargp);
@@ -0,0 +1,425 @@
+/*
+ * macD_output
+ * written by: Nathan Koop
+ *
+ * description:
+ *     captures the stdout and stderr of the children. Every child writes to
+ *     a pipe of its own, the output thread drains the pipes into a ring buffer
+ *     per entry of the process table, which the tail command reads.
+ *     with a log directory, the output is also duplicated with tee into a log
+ *     pipe per entry and the log thread splices it into the log file, so the
+ *     output is never copied through macD for logging. The output thread never
+ *     waits on the disk: if the log pipe is full, the output still goes to the
+ *     ring and the bytes missing from the log are counted, so a slow log disk
+ *     never blocks the children.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include "macD_output.h"
+#include "macD_stats.h"
+
+//most bytes moved from a pipe in one go.
+#define OUTPUT_CHUNK 65536
+//reads of one pipe in a row before the other pipes get a turn.
+#define OUTPUT_ROUNDS 16
+//size asked for the log pipes, so a burst of output fits while the disk catches up.
+#define LOG_PIPE_SIZE (1 << 20)
+
+/*
+ * output_ring
+ * description:
+ *     the output of an entry of the process table, kept for as long as macD runs.
+ */
+struct output_ring {
+	pthread_mutex_t lock;
+	char *data;
+	unsigned long written; //bytes written since the ring was reset, data[written % RING_SIZE] is next
+	int log_fd; //log file of the entry, -1 if output isn't logged
+	int log_pipe[2]; //output waiting to be spliced into log_fd
+	unsigned long dropped; //bytes missing from the log because the log pipe was full
+};
+
+/*
+ * output_stream
+ * description:
+ *     the read end of the pipe a child writes its output to.
+ */
+struct output_stream {
+	int fd;
+	struct output_ring *ring;
+	struct output_stream *prev;
+	struct output_stream *next;
+};
+
+int OUTPUT_ENABLED = 0;
+int RING_SIZE = 65536;
+char *LOG_DIR = NULL;
+int OUTPUT_EPOLL = -1;
+int LOG_EPOLL = -1;
+struct output_ring **RINGS = NULL; //ring of each index of the process table, NULL until it first starts
+int RINGS_CAPACITY = 0;
+struct output_stream *STREAMS = NULL; //pipes being drained
+pthread_mutex_t OUTPUTLOCK = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * new_ring
+ * description:
+ *     creates the ring of an entry and opens its log file.
+ * parameters:
+ *     index: the index of the entry.
+ * returns:
+ *     the new ring.
+ */
+static struct output_ring *new_ring(int index)
+{
+	struct output_ring *ring = calloc(1, sizeof(struct output_ring));
+
+	pthread_mutex_init(&ring->lock, NULL);
+	ring->data = malloc(RING_SIZE);
+	ring->log_fd = -1;
+	if (LOG_DIR == NULL)
+		return ring;
+	char path[4096];
+
+	snprintf(path, sizeof(path), "%s/%d.log", LOG_DIR, index);
+	//splice can't write to a file opened with O_APPEND, so the offset is moved to the end instead.
+	ring->log_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (ring->log_fd == -1 || lseek(ring->log_fd, 0, SEEK_END) == -1 ||
+	    pipe2(ring->log_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+		fprintf(stderr, "[%d] couldn't open log %s: %s\n", index, path, strerror(errno));
+		if (ring->log_fd != -1)
+			close(ring->log_fd);
+		ring->log_fd = -1;
+		return ring;
+	}
+	fcntl(ring->log_pipe[1], F_SETPIPE_SZ, LOG_PIPE_SIZE);
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = ring };
+
+	epoll_ctl(LOG_EPOLL, EPOLL_CTL_ADD, ring->log_pipe[0], &event);
+	return ring;
+}
+
+/*
+ * ring_of
+ * description:
+ *     finds the ring of an entry.
+ * parameters:
+ *     index: the index of the entry.
+ *     create: 1 to create the ring if the entry has none yet.
+ * returns:
+ *     the ring of the entry, NULL if it has none.
+ */
+static struct output_ring *ring_of(int index, int create)
+{
+	struct output_ring *ring = NULL;
+
+	pthread_mutex_lock(&OUTPUTLOCK);
+	if (index >= RINGS_CAPACITY && create == 1) {
+		int capacity = RINGS_CAPACITY == 0 ? 64 : RINGS_CAPACITY;
+
+		while (capacity <= index)
+			capacity *= 2;
+		RINGS = realloc(RINGS, sizeof(struct output_ring *)*capacity);
+		memset(RINGS + RINGS_CAPACITY, 0, sizeof(struct output_ring *)*(capacity - RINGS_CAPACITY));
+		RINGS_CAPACITY = capacity;
+	}
+	if (index >= 0 && index < RINGS_CAPACITY) {
+		if (RINGS[index] == NULL && create == 1)
+			RINGS[index] = new_ring(index);
+		ring = RINGS[index];
+	}
+	pthread_mutex_unlock(&OUTPUTLOCK);
+	return ring;
+}
+
+/*
+ * ring_read
+ * description:
+ *     reads from a pipe straight into the ring, overwriting the oldest output.
+ * parameters:
+ *     ring: the ring.
+ *     fd: the pipe to read from.
+ *     len: the most bytes to read.
+ * returns:
+ *     the number of bytes read, 0 at EOF, -1 on error.
+ */
+static int ring_read(struct output_ring *ring, int fd, int len)
+{
+	struct iovec iov[2];
+
+	if (len > RING_SIZE)
+		len = RING_SIZE;
+	pthread_mutex_lock(&ring->lock);
+	int pos = ring->written % RING_SIZE;
+	int first = len < RING_SIZE - pos ? len : RING_SIZE - pos;
+
+	iov[0].iov_base = ring->data + pos;
+	iov[0].iov_len = first;
+	iov[1].iov_base = ring->data;
+	iov[1].iov_len = len - first;
+	int rc = readv(fd, iov, len > first ? 2 : 1);
+
+	if (rc > 0)
+		ring->written += rc;
+	pthread_mutex_unlock(&ring->lock);
+	return rc;
+}
+
+/*
+ * drain
+ * description:
+ *     moves what a child wrote into its ring, and into its log pipe if it is logged.
+ * parameters:
+ *     stream: the pipe of the child.
+ * returns:
+ *     1 if the pipe is still open, 0 if the child closed it.
+ */
+static int drain(struct output_stream *stream)
+{
+	struct output_ring *ring = stream->ring;
+	int chunk = OUTPUT_CHUNK < RING_SIZE ? OUTPUT_CHUNK : RING_SIZE;
+
+	for (int round = 0; round < OUTPUT_ROUNDS; round++) {
+		int len = chunk;
+		int logged = -1;
+
+		if (ring->log_fd != -1) {
+			//tee only references the pages of the pipe, then exactly what was duplicated is read.
+			logged = tee(stream->fd, ring->log_pipe[1], chunk, SPLICE_F_NONBLOCK);
+			if (logged > 0)
+				len = logged;
+		}
+		int rc = ring_read(ring, stream->fd, len);
+
+		if (rc == 0)
+			return 0;
+		if (rc == -1)
+			return errno == EAGAIN || errno == EINTR ? 1 : 0;
+		if (ring->log_fd != -1 && logged <= 0)
+			__atomic_add_fetch(&ring->dropped, rc, __ATOMIC_RELAXED);
+	}
+	return 1;
+}
+
+/*
+ * close_stream
+ * description:
+ *     stops draining the pipe of a child that exited.
+ * parameters:
+ *     stream: the pipe of the child.
+ */
+static void close_stream(struct output_stream *stream)
+{
+	//close alone leaves it in OUTPUT_EPOLL while a child being forked holds a copy of the fd.
+	epoll_ctl(OUTPUT_EPOLL, EPOLL_CTL_DEL, stream->fd, NULL);
+	close(stream->fd);
+	pthread_mutex_lock(&OUTPUTLOCK);
+	if (stream->prev != NULL)
+		stream->prev->next = stream->next;
+	else
+		STREAMS = stream->next;
+	if (stream->next != NULL)
+		stream->next->prev = stream->prev;
+	pthread_mutex_unlock(&OUTPUTLOCK);
+	free(stream);
+}
+
+/*
+ * output_thread
+ * description:
+ *     the thread function that drains the pipes of the children.
+ * parameters:
+ *     vargp: unused.
+ */
+void *output_thread(void *vargp)
+{
+	struct epoll_event events[64];
+
+	stats_thread("output");
+	while (1) {
+		int n = epoll_wait(OUTPUT_EPOLL, events, 64, -1);
+
+		for (int i = 0; i < n; i++) {
+			struct output_stream *stream = events[i].data.ptr;
+
+			if (drain(stream) == 0)
+				close_stream(stream);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * log_thread
+ * description:
+ *     the thread function that splices the log pipes into the log files.
+ *     it is the only thread that waits on the disk.
+ * parameters:
+ *     vargp: unused.
+ */
+void *log_thread(void *vargp)
+{
+	struct epoll_event events[64];
+
+	stats_thread("log");
+	while (1) {
+		int n = epoll_wait(LOG_EPOLL, events, 64, -1);
+
+		for (int i = 0; i < n; i++) {
+			struct output_ring *ring = events[i].data.ptr;
+
+			while (splice(ring->log_pipe[0], NULL, ring->log_fd, NULL, LOG_PIPE_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK) > 0)
+				;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * output_init
+ * description:
+ *     turns on the capture of the output of the children and starts the
+ *     threads that drain it.
+ * parameters:
+ *     ring_size: bytes of output kept for each entry of the process table.
+ *     log_dir: directory to write the log of each entry to, [index].log, NULL for none.
+ * returns:
+ *     0 if output is captured, -1 otherwise.
+ */
+int output_init(int ring_size, char *log_dir)
+{
+	pthread_t thread;
+
+	if (ring_size <= 0)
+		return -1;
+	if (log_dir != NULL && mkdir(log_dir, 0755) == -1 && errno != EEXIST) {
+		fprintf(stderr, "couldn't create log directory %s: %s\n", log_dir, strerror(errno));
+		return -1;
+	}
+	RING_SIZE = ring_size;
+	LOG_DIR = log_dir;
+	OUTPUT_EPOLL = epoll_create1(EPOLL_CLOEXEC);
+	LOG_EPOLL = epoll_create1(EPOLL_CLOEXEC);
+	if (OUTPUT_EPOLL == -1 || LOG_EPOLL == -1)
+		return -1;
+	pthread_create(&thread, NULL, output_thread, NULL);
+	pthread_detach(thread);
+	if (log_dir != NULL) {
+		pthread_create(&thread, NULL, log_thread, NULL);
+		pthread_detach(thread);
+	}
+	OUTPUT_ENABLED = 1;
+	return 0;
+}
+
+/*
+ * output_attach
+ * description:
+ *     creates the pipe the next process of an entry writes its output to.
+ * parameters:
+ *     index: the index of the entry.
+ * returns:
+ *     the write end of the pipe, to be used as stdout and stderr of the child
+ *     and closed once it is created, or -1 if output isn't captured.
+ */
+int output_attach(int index)
+{
+	int fds[2];
+
+	if (OUTPUT_ENABLED == 0)
+		return -1;
+	if (pipe2(fds, O_CLOEXEC) == -1) {
+		fprintf(stderr, "[%d] couldn't capture output: %s\n", index, strerror(errno));
+		return -1;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	struct output_stream *stream = calloc(1, sizeof(struct output_stream));
+
+	stream->fd = fds[0];
+	stream->ring = ring_of(index, 1);
+	pthread_mutex_lock(&OUTPUTLOCK);
+	stream->next = STREAMS;
+	if (STREAMS != NULL)
+		STREAMS->prev = stream;
+	STREAMS = stream;
+	pthread_mutex_unlock(&OUTPUTLOCK);
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = stream };
+
+	epoll_ctl(OUTPUT_EPOLL, EPOLL_CTL_ADD, fds[0], &event);
+	return fds[1];
+}
+
+/*
+ * output_reset
+ * description:
+ *     empties the ring of an entry, when a new process takes its index.
+ * parameters:
+ *     index: the index of the entry.
+ */
+void output_reset(int index)
+{
+	struct output_ring *ring = ring_of(index, 0);
+
+	if (ring == NULL)
+		return;
+	pthread_mutex_lock(&ring->lock);
+	ring->written = 0;
+	pthread_mutex_unlock(&ring->lock);
+}
+
+/*
+ * output_tail
+ * description:
+ *     copies the output kept in the ring of an entry, oldest first.
+ * parameters:
+ *     index: the index of the entry.
+ *     out_len: set to the number of bytes copied.
+ * returns:
+ *     the output, to be freed with free, or NULL if the entry has no ring.
+ */
+char *output_tail(int index, int *out_len)
+{
+	struct output_ring *ring = ring_of(index, 0);
+
+	if (ring == NULL)
+		return NULL;
+	pthread_mutex_lock(&ring->lock);
+	int len = ring->written < (unsigned long)RING_SIZE ? (int)ring->written : RING_SIZE;
+	int start = ring->written < (unsigned long)RING_SIZE ? 0 : ring->written % RING_SIZE;
+	char *text = malloc(len + 1);
+
+	memcpy(text, ring->data + start, len - start);
+	memcpy(text + len - start, ring->data, start);
+	pthread_mutex_unlock(&ring->lock);
+	text[len] = '\0';
+	*out_len = len;
+	return text;
+}
+
+/*
+ * output_dropped
+ * description:
+ *     the number of bytes of output missing from the log of an entry because
+ *     the disk couldn't keep up, since the last call.
+ * parameters:
+ *     index: the index of the entry.
+ * returns:
+ *     the number of bytes dropped.
+ */
+unsigned long output_dropped(int index)
+{
+	struct output_ring *ring = ring_of(index, 0);
+
+	return ring == NULL ? 0 : __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,76 @@
+/*
+ * output_thread
+ * description:
+ *     the thread function that drains the pipes of the children.
+ * parameters:
+ *     vargp: unused.
+ */
+void *output_thread(void *vargp);
+
+/*
+ * log_thread
+ * description:
+ *     the thread function that splices the log pipes into the log files.
+ *     it is the only thread that waits on the disk.
+ * parameters:
+ *     vargp: unused.
+ */
+void *log_thread(void *vargp);
+
+/*
+ * output_init
+ * description:
+ *     turns on the capture of the output of the children and starts the
+ *     threads that drain it.
+ * parameters:
+ *     ring_size: bytes of output kept for each entry of the process table.
+ *     log_dir: directory to write the log of each entry to, [index].log, NULL for none.
+ * returns:
+ *     0 if output is captured, -1 otherwise.
+ */
+int output_init(int ring_size, char *log_dir);
+
+/*
+ * output_attach
+ * description:
+ *     creates the pipe the next process of an entry writes its output to.
+ * parameters:
+ *     index: the index of the entry.
+ * returns:
+ *     the write end of the pipe, to be used as stdout and stderr of the child
+ *     and closed once it is created, or -1 if output isn't captured.
+ */
+int output_attach(int index);
+
+/*
+ * output_reset
+ * description:
+ *     empties the ring of an entry, when a new process takes its index.
+ * parameters:
+ *     index: the index of the entry.
+ */
+void output_reset(int index);
+
+/*
+ * output_tail
+ * description:
+ *     copies the output kept in the ring of an entry, oldest first.
+ * parameters:
+ *     index: the index of the entry.
+ *     out_len: set to the number of bytes copied.
+ * returns:
+ *     the output, to be freed with free, or NULL if the entry has no ring.
+ */
+char *output_tail(int index, int *out_len);
+
+/*
+ * output_dropped
+ * description:
+ *     the number of bytes of output missing from the log of an entry because
+ *     the disk couldn't keep up, since the last call.
+ * parameters:
+ *     index: the index of the entry.
+ * returns:
+ *     the number of bytes dropped.
+ */
+unsigned long output_dropped(int index);
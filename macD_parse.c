@@ -0,0 +1,355 @@
+/*
+ * macD_parse
+ * written by: Nathan Koop
+ *
+ * description:
+ *     loads the process list file. The file is memory mapped privately and
+ *     every line is split into arguments in place, so loading a file costs a
+ *     single pass over it and no copy of the text. The argv arrays of all
+ *     lines are taken from one arena that grows as the file is read.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "macD_parse.h"
+
+struct arena {
+	char **slots;
+	size_t used;
+	size_t size;
+};
+
+/*
+ * arena_push
+ * description:
+ *     appends a pointer to the arena, growing it if needed.
+ * parameters:
+ *     arena: the arena to append to.
+ *     ptr: the pointer to append.
+ */
+static void arena_push(struct arena *arena, char *ptr)
+{
+	if (arena->used == arena->size) {
+		arena->size = arena->size == 0 ? 64 : arena->size*2;
+		arena->slots = realloc(arena->slots, sizeof(char *)*arena->size);
+	}
+	arena->slots[arena->used++] = ptr;
+}
+
+/*
+ * is_blank
+ * description:
+ *     checks if c separates arguments.
+ * parameters:
+ *     c: the character to check.
+ * returns:
+ *     1 if c is a space, a tab or a carriage return, 0 otherwise.
+ */
+static int is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+ * plain_length
+ * description:
+ *     counts the characters at the start of text that have no special meaning
+ *     outside of quotes, so they can be copied as one block.
+ * parameters:
+ *     text: the text to scan.
+ *     end: end of the text.
+ * returns:
+ *     the number of plain characters at the start of text.
+ */
+static int plain_length(char *text, char *end)
+{
+	char *ptr = text;
+
+	while (ptr < end) {
+		char c = *ptr;
+
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\'' || c == '"' || c == '\\')
+			break;
+		ptr++;
+	}
+	return ptr - text;
+}
+
+/*
+ * tokenize
+ * description:
+ *     splits the line that starts at *cursor into arguments and pushes them to arena.
+ *     the arguments are written back over the line, one after the other and
+ *     terminated by a null character. Since quotes and escapes are removed an
+ *     argument never grows, so writing never passes the character being read.
+ * parameters:
+ *     cursor: start of the line, moved to the start of the next line.
+ *     end: end of the text. the byte at end must be writable.
+ *     arena: the arena to push the arguments to.
+ *     out_error: set to 1 if the line has an unterminated quote.
+ * returns:
+ *     the number of arguments in the line.
+ */
+static int tokenize(char **cursor, char *end, struct arena *arena, int *out_error)
+{
+	char *read = *cursor;
+	char *write = read;
+	int argc = 0;
+
+	*out_error = 0;
+	while (1) {
+		while (read < end && is_blank(*read))
+			read++;
+		if (read >= end)
+			break;
+		if (*read == '\n') {
+			read++;
+			break;
+		}
+		if (*read == '#') { //comment, skip the rest of the line
+			while (read < end && *read != '\n')
+				read++;
+			if (read < end)
+				read++;
+			break;
+		}
+		char *token = write;
+		char quote = 0;
+
+		while (read < end) {
+			if (quote == 0) {
+				int plain = plain_length(read, end);
+
+				if (write != read)
+					memmove(write, read, plain);
+				write += plain;
+				read += plain;
+				if (read >= end)
+					break;
+			}
+			char c = *read;
+
+			if (c == '\n' || (quote == 0 && is_blank(c)))
+				break;
+			read++;
+			if (c == quote) {
+				quote = 0;
+				continue;
+			}
+			if (quote == 0 && (c == '\'' || c == '"')) {
+				quote = c;
+				continue;
+			}
+			if (c == '\\' && quote != '\'' && read < end && *read != '\n') {
+				c = *read;
+				read++;
+			}
+			*write = c;
+			write++;
+		}
+		if (quote != 0)
+			*out_error = 1;
+		int line_end = read >= end || *read == '\n';
+
+		//step over the separator before writing the terminator, it may be overwritten.
+		if (read < end)
+			read++;
+		*write = '\0';
+		write++;
+		arena_push(arena, token);
+		argc++;
+		if (line_end == 1)
+			break;
+	}
+	*cursor = read;
+	return argc;
+}
+
+/*
+ * load_process_list
+ * description:
+ *     memory maps the given file and splits every line into arguments.
+ *     arguments are separated by spaces or tabs, can be quoted with single or double
+ *     quotes, and any character can be escaped with a backslash. a '#' at the start
+ *     of an argument starts a comment that runs to the end of the line.
+ *     empty lines and comments are skipped.
+ * parameters:
+ *     file_path: path of the file to load.
+ * pre-conditions:
+ *     file_path is initialized.
+ * returns:
+ *     the parsed file, or NULL if it couldn't be opened.
+ */
+struct process_list *load_process_list(char *file_path)
+{
+	struct stat st;
+	int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+
+	if (fd == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return NULL;
+	}
+	size_t size = st.st_size;
+	long page = sysconf(_SC_PAGESIZE);
+	//one extra byte after the file so the last argument can always be terminated.
+	size_t map_size = (size + page) / page * page;
+	char *data = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (data == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	if (size > 0 && mmap(data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(data, map_size);
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	struct process_list *list = malloc(sizeof(struct process_list));
+	struct arena arena = { NULL, 0, 0 };
+	size_t *offsets = NULL;
+	int lines_size = 0;
+	char *cursor = data;
+	int number = 0;
+
+	list->data = data;
+	list->map_size = map_size;
+	list->lines = NULL;
+	list->count = 0;
+	while (cursor < data + size) {
+		size_t first = arena.used;
+		int error;
+		int argc = tokenize(&cursor, data + size, &arena, &error);
+
+		number++;
+		if (argc == 0)
+			continue;
+		arena_push(&arena, NULL);
+		if (list->count == lines_size) {
+			lines_size = lines_size == 0 ? 64 : lines_size*2;
+			list->lines = realloc(list->lines, sizeof(struct list_line)*lines_size);
+			offsets = realloc(offsets, sizeof(size_t)*lines_size);
+		}
+		struct list_line *line = &list->lines[list->count];
+
+		line->argc = error == 1 ? -1 : argc;
+		line->len = args_length(arena.slots + first, argc);
+		line->number = number;
+		offsets[list->count] = first;
+		list->count++;
+	}
+	//the arena is done growing, so the argv arrays can point into it.
+	for (int i = 0; i < list->count; i++)
+		list->lines[i].argv = arena.slots + offsets[i];
+	list->arena = arena.slots;
+	free(offsets);
+	return list;
+}
+
+/*
+ * free_process_list
+ * description:
+ *     unmaps the file and frees all the memory of a process list.
+ * parameters:
+ *     list: the process list to free, or NULL.
+ */
+void free_process_list(struct process_list *list)
+{
+	if (list == NULL)
+		return;
+	munmap(list->data, list->map_size);
+	free(list->arena);
+	free(list->lines);
+	free(list);
+}
+
+/*
+ * parse_line
+ * description:
+ *     splits a single line into arguments, the same way lines of the process
+ *     list file are split. The line is modified in place.
+ * parameters:
+ *     line: the line to split, terminated by a null character.
+ *     out_argc: set to the number of arguments, -1 if there is an unterminated quote.
+ * pre-conditions:
+ *     line is initialized.
+ * returns:
+ *     the arguments of the line terminated by NULL, to be freed with free.
+ *     the arguments themselves point into line.
+ */
+char **parse_line(char *line, int *out_argc)
+{
+	struct arena arena = { NULL, 0, 0 };
+	char *cursor = line;
+	int error;
+	int argc = tokenize(&cursor, line + strlen(line), &arena, &error);
+
+	arena_push(&arena, NULL);
+	*out_argc = error == 1 ? -1 : argc;
+	return arena.slots;
+}
+
+/*
+ * pack_args
+ * description:
+ *     copies an argument list into a single allocation, holding both
+ *     the array and the strings.
+ * parameters:
+ *     argv: the arguments to copy, terminated by NULL.
+ * pre-conditions:
+ *     argv is initialized.
+ * returns:
+ *     a copy of argv that is freed with a single call to free.
+ */
+char **pack_args(char **argv)
+{
+	int argc = 0;
+	size_t size = 0;
+
+	while (argv[argc] != NULL) {
+		size += strlen(argv[argc]) + 1;
+		argc++;
+	}
+	char **copy = malloc(sizeof(char *)*(argc+1) + size);
+	char *strings = (char *)(copy + argc + 1);
+
+	for (int i = 0; i < argc; i++) {
+		int len = strlen(argv[i]) + 1;
+
+		memcpy(strings, argv[i], len);
+		copy[i] = strings;
+		strings += len;
+	}
+	copy[argc] = NULL;
+	return copy;
+}
+
+/*
+ * args_length
+ * description:
+ *     computes the size of the block of arguments argv[0] to argv[argc-1],
+ *     when the arguments are stored one after the other.
+ * parameters:
+ *     argv: the arguments, stored one after the other.
+ *     argc: the number of arguments.
+ * returns:
+ *     the number of bytes from the start of argv[0] to the end of argv[argc-1].
+ */
+int args_length(char **argv, int argc)
+{
+	if (argc <= 0)
+		return 0;
+	return argv[argc-1] + strlen(argv[argc-1]) + 1 - argv[0];
+}
@@ -0,0 +1,96 @@
+/*
+ * list_line
+ * description:
+ *     a line of the process list file, split into its arguments.
+ *     the arguments of a line are stored one after the other, each followed
+ *     by a null character, so the line is also the block of len bytes at argv[0].
+ */
+struct list_line {
+	char **argv; //arguments of the line, terminated by NULL
+	int argc; //number of arguments, -1 if the line has an unterminated quote
+	int len; //length of the block of arguments
+	int number; //line number in the file, starting at 1
+};
+
+/*
+ * process_list
+ * description:
+ *     the parsed contents of a process list file. The arguments point into
+ *     a private mapping of the file and the argv arrays all come from one arena.
+ */
+struct process_list {
+	char *data; //private mapping of the file, tokenized in place
+	size_t map_size; //size of the mapping
+	char **arena; //storage of every argv array
+	struct list_line *lines; //lines that have at least one argument
+	int count; //number of lines
+};
+
+/*
+ * load_process_list
+ * description:
+ *     memory maps the given file and splits every line into arguments.
+ *     arguments are separated by spaces or tabs, can be quoted with single or double
+ *     quotes, and any character can be escaped with a backslash. a '#' at the start
+ *     of an argument starts a comment that runs to the end of the line.
+ *     empty lines and comments are skipped.
+ * parameters:
+ *     file_path: path of the file to load.
+ * pre-conditions:
+ *     file_path is initialized.
+ * returns:
+ *     the parsed file, or NULL if it couldn't be opened.
+ */
+struct process_list *load_process_list(char *file_path);
+
+/*
+ * free_process_list
+ * description:
+ *     unmaps the file and frees all the memory of a process list.
+ * parameters:
+ *     list: the process list to free, or NULL.
+ */
+void free_process_list(struct process_list *list);
+
+/*
+ * parse_line
+ * description:
+ *     splits a single line into arguments, the same way lines of the process
+ *     list file are split. The line is modified in place.
+ * parameters:
+ *     line: the line to split, terminated by a null character.
+ *     out_argc: set to the number of arguments, -1 if there is an unterminated quote.
+ * pre-conditions:
+ *     line is initialized.
+ * returns:
+ *     the arguments of the line terminated by NULL, to be freed with free.
+ *     the arguments themselves point into line.
+ */
+char **parse_line(char *line, int *out_argc);
+
+/*
+ * pack_args
+ * description:
+ *     copies an argument list into a single allocation, holding both
+ *     the array and the strings.
+ * parameters:
+ *     argv: the arguments to copy, terminated by NULL.
+ * pre-conditions:
+ *     argv is initialized.
+ * returns:
+ *     a copy of argv that is freed with a single call to free.
+ */
+char **pack_args(char **argv);
+
+/*
+ * args_length
+ * description:
+ *     computes the size of the block of arguments argv[0] to argv[argc-1],
+ *     when the arguments are stored one after the other.
+ * parameters:
+ *     argv: the arguments, stored one after the other.
+ *     argc: the number of arguments.
+ * returns:
+ *     the number of bytes from the start of argv[0] to the end of argv[argc-1].
+ */
+int args_length(char **argv, int argc);
@@ -0,0 +1,487 @@
+/*
+ * macD_probe
+ * written by: Nathan Koop
+ *
+ * description:
+ *     readiness probes. A process given @ready=[probe] is started once its
+ *     probe passes instead of when it survives the start check: it writes to
+ *     its notify descriptor, a socket accepts a connection, a file appears or
+ *     a command succeeds. Probes are run by the supervisor thread, the notify
+ *     pipes and connecting sockets are in an epoll set it polls along with its
+ *     other descriptors and the other probes are retried on its timers, so a
+ *     pending probe never blocks macD.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "macD.h"
+#include "macD_parse.h"
+#include "macD_socket.h"
+#include "macD_supervisor.h"
+#include "macD_probe.h"
+
+/*
+ * probe
+ * description:
+ *     the pending probe of an entry of the process table.
+ */
+struct probe {
+	int pid; //process being probed, 0 if no probe is pending
+	int fd; //notify pipe or connecting socket, -1 if none
+	int check_pid; //command being run, -1 if none
+	struct timespec deadline; //when the process is given up on
+	struct timespec retry; //when the next attempt is due
+};
+
+struct probe *PROBES = NULL; //indexed like PIDS
+int PROBES_CAPACITY = 0;
+int PROBES_PENDING = 0;
+int PROBE_EPOLL = -1;
+
+/*
+ * probe_kind
+ * description:
+ *     reads the kind of a probe given with @ready.
+ * parameters:
+ *     spec: the value of the directive.
+ *     arg: set to what follows the kind.
+ * returns:
+ *     one of the PROBE_ kinds, or -1 if spec is invalid.
+ */
+static int probe_kind(char *spec, char **arg)
+{
+	char *prefixes[] = { "notify", "tcp:", "unix:", "file:", "cmd:" };
+
+	*arg = spec;
+	if (strcmp(spec, prefixes[PROBE_NOTIFY]) == 0)
+		return PROBE_NOTIFY;
+	for (int kind = PROBE_TCP; kind <= PROBE_CMD; kind++) {
+		int len = strlen(prefixes[kind]);
+
+		if (strncmp(spec, prefixes[kind], len) == 0 && spec[len] != '\0') {
+			*arg = spec+len;
+			return kind;
+		}
+	}
+	return -1;
+}
+
+/*
+ * tcp_address
+ * description:
+ *     fills the address of a tcp probe, [host:]port where host defaults to 127.0.0.1.
+ * parameters:
+ *     arg: the address.
+ *     address: the address to fill.
+ * returns:
+ *     0 if arg is a valid address, -1 otherwise.
+ */
+static int tcp_address(char *arg, struct sockaddr_in *address)
+{
+	char host[INET_ADDRSTRLEN] = "127.0.0.1";
+	char *colon = strrchr(arg, ':');
+	char *port = arg;
+
+	if (colon != NULL) {
+		if (colon - arg >= (long)sizeof(host))
+			return -1;
+		memcpy(host, arg, colon - arg);
+		host[colon - arg] = '\0';
+		port = colon+1;
+	}
+	int number = convert_str_to_int(port);
+
+	memset(address, 0, sizeof(struct sockaddr_in));
+	address->sin_family = AF_INET;
+	address->sin_port = htons(number);
+	if (number <= 0 || number > 65535 || inet_pton(AF_INET, host, &address->sin_addr) != 1)
+		return -1;
+	return 0;
+}
+
+/*
+ * probe_valid
+ * description:
+ *     checks a probe given with @ready: notify, tcp:[host:]port, unix:path,
+ *     file:path or cmd:command.
+ * parameters:
+ *     spec: the value of the directive.
+ * returns:
+ *     0 if the probe is valid, -1 otherwise.
+ */
+int probe_valid(char *spec)
+{
+	struct sockaddr_in tcp;
+	struct sockaddr_un unix_address;
+	char *arg;
+	int kind = probe_kind(spec, &arg);
+
+	if (kind == -1)
+		return -1;
+	if (kind == PROBE_TCP)
+		return tcp_address(arg, &tcp);
+	if (kind == PROBE_UNIX && socket_address(arg, &unix_address) == -1)
+		return -1;
+	return 0;
+}
+
+/*
+ * probe_init
+ * description:
+ *     creates the epoll set of the notify pipes and connecting sockets of the pending probes.
+ * returns:
+ *     the descriptor of the set, for the supervisor to poll.
+ */
+int probe_init(void)
+{
+	PROBE_EPOLL = epoll_create1(EPOLL_CLOEXEC);
+	if (PROBE_EPOLL == -1) {
+		fprintf(stderr, "probe error %s\n", strerror(errno));
+		exit(1);
+	}
+	return PROBE_EPOLL;
+}
+
+/*
+ * probe_slot
+ * description:
+ *     the probe of an entry, growing the probes to the size of the process table.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+static struct probe *probe_slot(int index)
+{
+	if (index >= PROBES_CAPACITY) {
+		int capacity = PROBES_CAPACITY == 0 ? 16 : PROBES_CAPACITY;
+
+		while (capacity <= index)
+			capacity *= 2;
+		PROBES = realloc(PROBES, sizeof(struct probe)*capacity);
+		for (int i = PROBES_CAPACITY; i < capacity; i++) {
+			PROBES[i].pid = 0;
+			PROBES[i].fd = -1;
+			PROBES[i].check_pid = -1;
+		}
+		PROBES_CAPACITY = capacity;
+	}
+	return &PROBES[index];
+}
+
+/*
+ * close_fd
+ * description:
+ *     closes the notify pipe or socket of a probe. It is removed from the epoll
+ *     set first, a child being created may hold a copy that would keep it registered.
+ * parameters:
+ *     probe: the probe.
+ */
+static void close_fd(struct probe *probe)
+{
+	if (probe->fd == -1)
+		return;
+	epoll_ctl(PROBE_EPOLL, EPOLL_CTL_DEL, probe->fd, NULL);
+	close(probe->fd);
+	probe->fd = -1;
+}
+
+/*
+ * probe_prepare
+ * description:
+ *     creates the notify pipe of an entry probed with @ready=notify, before its process is created.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the end of the pipe to hand to the process as PROBE_NOTIFY_FD,
+ *     to be closed once it is created, or -1 if there is none.
+ */
+int probe_prepare(int index)
+{
+	char *arg;
+	int fds[2];
+
+	if (PROC_INFO[index].probe == NULL || probe_kind(PROC_INFO[index].probe, &arg) != PROBE_NOTIFY)
+		return -1;
+	struct probe *probe = probe_slot(index);
+
+	close_fd(probe);
+	if (pipe2(fds, O_CLOEXEC) == -1)
+		return -1;
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	probe->fd = fds[0];
+	return fds[1];
+}
+
+/*
+ * probe_start
+ * description:
+ *     starts the probe of an entry whose process was just created.
+ *     the first attempt is made by the next call to probe_timers.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the entry has a probe and PIDS[index] is its new process.
+ */
+void probe_start(int index)
+{
+	struct probe *probe = probe_slot(index);
+
+	if (probe->pid == 0)
+		PROBES_PENDING++;
+	probe->pid = PIDS[index];
+	set_deadline(&probe->deadline, PROC_INFO[index].probe_timeout);
+	set_deadline(&probe->retry, 0);
+	if (probe->fd != -1) {
+		struct epoll_event event = { .events = EPOLLIN, .data.u64 = index };
+
+		epoll_ctl(PROBE_EPOLL, EPOLL_CTL_ADD, probe->fd, &event);
+	}
+}
+
+/*
+ * probe_cancel
+ * description:
+ *     stops the pending probe of an entry, if it has one.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void probe_cancel(int index)
+{
+	if (index >= PROBES_CAPACITY)
+		return;
+	struct probe *probe = &PROBES[index];
+
+	close_fd(probe);
+	if (probe->check_pid != -1)
+		kill(probe->check_pid, SIGKILL); //the supervisor reaps it
+	probe->check_pid = -1;
+	if (probe->pid != 0)
+		PROBES_PENDING--;
+	probe->pid = 0;
+}
+
+/*
+ * probe_passed
+ * description:
+ *     the process of an entry is ready.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+static void probe_passed(int index)
+{
+	probe_cancel(index);
+	mark_started(index, PROC_READY);
+}
+
+/*
+ * probe_failed
+ * description:
+ *     gives up on the process of an entry, it is killed and the supervisor
+ *     handles its exit like one during its start check.
+ * parameters:
+ *     index: the index of the entry.
+ *     reason: why, for the report.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+static void probe_failed(int index, char *reason)
+{
+	fprintf(OUTPUT_FILE, "[%d] %s, %s\n", index, PROC_INFO[index].argv[0], reason);
+	kill(PIDS[index], SIGKILL);
+	probe_cancel(index);
+}
+
+/*
+ * probe_attempt
+ * description:
+ *     runs the probe of an entry once, unless an attempt is still in progress.
+ *     a notify probe has nothing to do until the process writes to its pipe.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+static void probe_attempt(int index)
+{
+	struct probe *probe = &PROBES[index];
+	char *arg;
+	int kind = probe_kind(PROC_INFO[index].probe, &arg);
+
+	if (kind == PROBE_NOTIFY) {
+		probe->retry = probe->deadline;
+		return;
+	}
+	set_deadline(&probe->retry, PROBE_INTERVAL_MS);
+	if (probe->fd != -1 || probe->check_pid != -1)
+		return;
+	if (kind == PROBE_FILE) {
+		if (access(arg, F_OK) == 0)
+			probe_passed(index);
+	} else if (kind == PROBE_CMD) {
+		char *command[] = { "/bin/sh", "-c", arg, NULL };
+		char **argv = pack_args(command);
+
+		create_process(argv, &probe->check_pid, 1, -1, -1, -1);
+		free(argv);
+	} else {
+		struct sockaddr_in tcp;
+		struct sockaddr_un unix_address;
+		struct sockaddr *address = (struct sockaddr *)&tcp;
+		int len = sizeof(tcp);
+		int family = AF_INET;
+
+		if (kind == PROBE_UNIX) {
+			address = (struct sockaddr *)&unix_address;
+			len = socket_address(arg, &unix_address);
+			family = AF_UNIX;
+		} else {
+			tcp_address(arg, &tcp);
+		}
+		int sock = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+		if (sock == -1)
+			return;
+		if (connect(sock, address, len) == 0) {
+			close(sock);
+			probe_passed(index);
+		} else if (errno == EINPROGRESS) {
+			struct epoll_event event = { .events = EPOLLOUT, .data.u64 = index };
+
+			probe->fd = sock;
+			epoll_ctl(PROBE_EPOLL, EPOLL_CTL_ADD, sock, &event);
+		} else {
+			close(sock);
+		}
+	}
+}
+
+/*
+ * probe_timers
+ * description:
+ *     gives up on the processes whose probe timed out and retries the probes that are due.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of ms until the next attempt or timeout, or -1 if no probe is pending.
+ */
+long probe_timers(void)
+{
+	long next = -1;
+
+	for (int i = 0; i < PROBES_CAPACITY && PROBES_PENDING > 0; i++) {
+		struct probe *probe = &PROBES[i];
+
+		if (probe->pid == 0)
+			continue;
+		if (ms_since(&probe->deadline) >= 0) {
+			char reason[64];
+
+			sprintf(reason, "not ready after %d ms", PROC_INFO[i].probe_timeout);
+			probe_failed(i, reason);
+			continue;
+		}
+		if (ms_since(&probe->retry) >= 0) {
+			probe_attempt(i);
+			if (probe->pid == 0)
+				continue;
+		}
+		long remaining = -ms_since(&probe->retry);
+
+		if (remaining < 0)
+			remaining = 0;
+		if (next == -1 || remaining < next)
+			next = remaining;
+	}
+	return next;
+}
+
+/*
+ * probe_events
+ * description:
+ *     handles the notify pipes that became readable and the sockets that connected.
+ *     a socket that failed to connect is retried at the next attempt.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     called by the supervisor.
+ */
+void probe_events(void)
+{
+	struct epoll_event events[16];
+	int count;
+
+	while ((count = epoll_wait(PROBE_EPOLL, events, 16, 0)) > 0) {
+		for (int k = 0; k < count; k++) {
+			int index = events[k].data.u64;
+			struct probe *probe = &PROBES[index];
+			char *arg;
+
+			if (probe->pid == 0 || probe->fd == -1)
+				continue; //cancelled by an earlier event of this batch
+			if (probe_kind(PROC_INFO[index].probe, &arg) == PROBE_NOTIFY) {
+				char buffer[256];
+				int len = read(probe->fd, buffer, sizeof(buffer));
+
+				if (len > 0)
+					probe_passed(index);
+				else if (len == 0)
+					probe_failed(index, "closed its notify descriptor before it was ready");
+				continue;
+			}
+			int error = 0;
+			socklen_t error_len = sizeof(error);
+
+			getsockopt(probe->fd, SOL_SOCKET, SO_ERROR, &error, &error_len);
+			close_fd(probe);
+			if (error == 0)
+				probe_passed(index);
+		}
+		if (count < 16)
+			break;
+	}
+}
+
+/*
+ * probe_reaped
+ * description:
+ *     records the exit of a command run by a probe. A command that failed
+ *     is run again at the next attempt.
+ * parameters:
+ *     pid: the pid of a child that isn't in the process table.
+ *     status: its wait status.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void probe_reaped(int pid, int status)
+{
+	for (int i = 0; i < PROBES_CAPACITY && PROBES_PENDING > 0; i++) {
+		if (PROBES[i].check_pid != pid)
+			continue;
+		PROBES[i].check_pid = -1;
+		if (PROBES[i].pid != 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			probe_passed(i);
+		return;
+	}
+}
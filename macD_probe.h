@@ -0,0 +1,104 @@
+//descriptor a process probed with @ready=notify writes to once it is ready.
+#define PROBE_NOTIFY_FD 3
+//time a probe may take before the process is given up on, unless set with @ready-timeout.
+#define PROBE_TIMEOUT_MS 30000
+//delay between two attempts of a probe that failed.
+#define PROBE_INTERVAL_MS 100
+
+//kinds of readiness probes.
+#define PROBE_NOTIFY 0 //the process writes to PROBE_NOTIFY_FD
+#define PROBE_TCP 1 //a tcp connection to [host:]port is accepted
+#define PROBE_UNIX 2 //a connection to a unix socket is accepted
+#define PROBE_FILE 3 //a file exists
+#define PROBE_CMD 4 //a shell command exits with status 0
+
+/*
+ * probe_valid
+ * description:
+ *     checks a probe given with @ready: notify, tcp:[host:]port, unix:path,
+ *     file:path or cmd:command.
+ * parameters:
+ *     spec: the value of the directive.
+ * returns:
+ *     0 if the probe is valid, -1 otherwise.
+ */
+int probe_valid(char *spec);
+
+/*
+ * probe_init
+ * description:
+ *     creates the epoll set of the notify pipes and connecting sockets of the pending probes.
+ * returns:
+ *     the descriptor of the set, for the supervisor to poll.
+ */
+int probe_init(void);
+
+/*
+ * probe_prepare
+ * description:
+ *     creates the notify pipe of an entry probed with @ready=notify, before its process is created.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the end of the pipe to hand to the process as PROBE_NOTIFY_FD,
+ *     to be closed once it is created, or -1 if there is none.
+ */
+int probe_prepare(int index);
+
+/*
+ * probe_start
+ * description:
+ *     starts the probe of an entry whose process was just created.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the entry has a probe and PIDS[index] is its new process.
+ */
+void probe_start(int index);
+
+/*
+ * probe_cancel
+ * description:
+ *     stops the pending probe of an entry, if it has one.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void probe_cancel(int index);
+
+/*
+ * probe_timers
+ * description:
+ *     gives up on the processes whose probe timed out and retries the probes that are due.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of ms until the next attempt or timeout, or -1 if no probe is pending.
+ */
+long probe_timers(void);
+
+/*
+ * probe_events
+ * description:
+ *     handles the notify pipes that became readable and the sockets that connected.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     called by the supervisor.
+ */
+void probe_events(void);
+
+/*
+ * probe_reaped
+ * description:
+ *     records the exit of a command run by a probe.
+ * parameters:
+ *     pid: the pid of a child that isn't in the process table.
+ *     status: its wait status.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void probe_reaped(int pid, int status);
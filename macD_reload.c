@@ -0,0 +1,232 @@
+/*
+ * macD_reload
+ * written by: Nathan Koop
+ *
+ * description:
+ *     reloads the process list file while macD is running, either on SIGHUP
+ *     or whenever inotify reports that the file changed. The new lines are
+ *     diffed against the lines the running processes were started from, so
+ *     only added lines are started and only removed lines are stopped.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <limits.h>
+#include <libgen.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/inotify.h>
+#include "macD.h"
+#include "macD_stats.h"
+#include "macD_reload.h"
+#include "macD_parse.h"
+#include "macD_supervisor.h"
+
+char *RELOAD_PATH = NULL;
+char *RELOAD_NAME = NULL; //name of the file inside its directory, used to filter events
+int WATCH_FD = -1;
+
+/*
+ * reload_init
+ * description:
+ *     remembers the process list file so that it can be reloaded on SIGHUP,
+ *     and starts watching it with inotify if watch is 1.
+ * parameters:
+ *     file_path: path of the process list file.
+ *     watch: 1 if the file should be reloaded whenever it changes.
+ * pre-conditions:
+ *     file_path is initialized.
+ */
+void reload_init(char *file_path, int watch)
+{
+	char *copy = strdup(file_path);
+
+	RELOAD_PATH = strdup(file_path);
+	RELOAD_NAME = strdup(basename(copy));
+	free(copy);
+	if (watch == 0)
+		return;
+	//watch the directory, editors often replace the file instead of writing to it.
+	copy = strdup(file_path);
+	WATCH_FD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (WATCH_FD == -1 || inotify_add_watch(WATCH_FD, dirname(copy), IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+		fprintf(stderr, "couldn't watch %s: %s\n", file_path, strerror(errno));
+		if (WATCH_FD != -1)
+			close(WATCH_FD);
+		WATCH_FD = -1;
+	}
+	free(copy);
+}
+
+/*
+ * reload_watch_fd
+ * description:
+ *     gives the inotify file descriptor watching the process list file.
+ * returns:
+ *     the inotify file descriptor, or -1 if the file isn't watched.
+ */
+int reload_watch_fd(void)
+{
+	return WATCH_FD;
+}
+
+/*
+ * reload_watch_event
+ * description:
+ *     reads all pending inotify events.
+ * returns:
+ *     1 if one of the events is a change of the process list file, 0 otherwise.
+ */
+int reload_watch_event(void)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	int changed = 0;
+	int len;
+
+	while ((len = read(WATCH_FD, buffer, sizeof(buffer))) > 0) {
+		for (char *ptr = buffer; ptr < buffer + len; ) {
+			struct inotify_event *event = (struct inotify_event *)ptr;
+
+			if (event->len > 0 && strcmp(event->name, RELOAD_NAME) == 0)
+				changed = 1;
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	return changed;
+}
+
+/*
+ * hash_line
+ * description:
+ *     computes the FNV-1a hash of the arguments of a line.
+ * parameters:
+ *     line: the arguments of the line, stored one after the other.
+ *     len: the length of the arguments.
+ * returns:
+ *     the hash of line.
+ */
+static unsigned int hash_line(char *line, int len)
+{
+	unsigned int hash = 2166136261u;
+
+	for (int i = 0; i < len; i++) {
+		hash ^= (unsigned char)line[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * reload_file
+ * description:
+ *     reads the process list file again and compares it with the process table.
+ *     processes of lines that were removed are sent their stop signal and killed
+ *     if they outlive the grace period, processes of new lines are started,
+ *     and processes of unchanged lines are left running.
+ *     removed entries keep their index and a changed line gets a new one, so a
+ *     client never reaches another process with an old index: the table only grows.
+ *     lines are matched by their arguments, including directives, so changes
+ *     in spacing or quoting that don't change the arguments keep the process running.
+ * post-conditions:
+ *     the process table matches the process list file.
+ */
+void reload_file(void)
+{
+	struct process_list *list = load_process_list(RELOAD_PATH);
+	int removed = 0;
+	int added = 0;
+
+	if (list == NULL) {
+		fprintf(OUTPUT_FILE, "macD: %s not found, reload skipped\n", RELOAD_PATH);
+		return;
+	}
+	struct list_line *lines = list->lines;
+	int count = list->count;
+
+	//the time limit is only read at startup.
+	if (count > 0 && read_timer(lines[0].argv) != -1) {
+		lines++;
+		count--;
+	}
+	fprintf(OUTPUT_FILE, "%s", "Reloading, ");
+	display_date();
+	stats_lock(&PIDLOCK);
+	//hash table of the entries created from the file, chained through next.
+	int num_pids = len_pids(PIDS);
+	int buckets = 1;
+
+	while (buckets < 2*num_pids)
+		buckets *= 2;
+	int *heads = malloc(sizeof(int)*buckets);
+	int *next = malloc(sizeof(int)*(num_pids+1));
+
+	memset(heads, -1, sizeof(int)*buckets);
+	for (int i = num_pids-1; i >= 0; i--) {
+		if (PROC_INFO[i].source == NULL || PROC_INFO[i].removed == 1 || PROC_INFO[i].spawned == 1)
+			continue;
+		int bucket = hash_line(PROC_INFO[i].source, PROC_INFO[i].source_len) & (buckets-1);
+
+		next[i] = heads[bucket];
+		heads[bucket] = i;
+	}
+	//unchanged lines take their entry out of the table, so duplicates match one to one.
+	for (int k = 0; k < count; k++) {
+		int bucket = hash_line(lines[k].argv[0], lines[k].len) & (buckets-1);
+		int *link = &heads[bucket];
+
+		while (*link != -1 && (PROC_INFO[*link].source_len != lines[k].len ||
+		       memcmp(PROC_INFO[*link].source, lines[k].argv[0], lines[k].len) != 0))
+			link = &next[*link];
+		if (*link != -1) {
+			*link = next[*link];
+			lines[k].argc = 0; //unchanged
+		}
+	}
+	//entries left in the table were removed from the file.
+	for (int bucket = 0; bucket < buckets; bucket++) {
+		for (int i = heads[bucket]; i != -1; i = next[i]) {
+			struct process_info *info = &PROC_INFO[i];
+
+			info->removed = 1;
+			info->stopped = 1;
+			if (info->state == PROC_RUNNING || info->state == PROC_READY || info->state == PROC_STARTING)
+				stop_with_grace(i, PIDS[i], info->stop_signal);
+			else if (info->state == PROC_BACKOFF || info->state == PROC_WAITING)
+				info->state = PROC_EXITED;
+			fprintf(OUTPUT_FILE, "[%d] %s, removed\n", i, info->argv[0]);
+			removed++;
+		}
+	}
+	pthread_mutex_unlock(&PIDLOCK);
+	free(heads);
+	free(next);
+	for (int k = 0; k < count; k++) {
+		struct process_info info;
+
+		if (lines[k].argc == 0)
+			continue;
+		if (lines[k].argc == -1) {
+			fprintf(stderr, "macD: %s:%d: unterminated quote\n", RELOAD_PATH, lines[k].number);
+			continue;
+		}
+		char **command = parse_directives(lines[k].argv, &info);
+
+		if (command != NULL && command[0] != NULL) {
+			info.source = lines[k].argv[0];
+			info.source_len = lines[k].len;
+			info.announce = 1;
+			if (add_process(command, &info) == -1)
+				fprintf(OUTPUT_FILE, "[-] badprogram %s, failed to start\n", command[0]);
+			else
+				added++;
+		}
+	}
+	free_process_list(list);
+	fprintf(OUTPUT_FILE, "Reloaded: %d added, %d removed\n", added, removed);
+}
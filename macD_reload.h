@@ -0,0 +1,42 @@
+/*
+ * reload_init
+ * description:
+ *     remembers the process list file so that it can be reloaded on SIGHUP,
+ *     and starts watching it with inotify if watch is 1.
+ * parameters:
+ *     file_path: path of the process list file.
+ *     watch: 1 if the file should be reloaded whenever it changes.
+ * pre-conditions:
+ *     file_path is initialized.
+ */
+void reload_init(char *file_path, int watch);
+
+/*
+ * reload_watch_fd
+ * description:
+ *     gives the inotify file descriptor watching the process list file.
+ * returns:
+ *     the inotify file descriptor, or -1 if the file isn't watched.
+ */
+int reload_watch_fd(void);
+
+/*
+ * reload_watch_event
+ * description:
+ *     reads all pending inotify events.
+ * returns:
+ *     1 if one of the events is a change of the process list file, 0 otherwise.
+ */
+int reload_watch_event(void);
+
+/*
+ * reload_file
+ * description:
+ *     reads the process list file again and compares it with the process table.
+ *     processes of lines that were removed are killed, processes of new lines
+ *     are started, and processes of unchanged lines are left running.
+ *     lines are matched by their full text, including directives.
+ * post-conditions:
+ *     the process table matches the process list file.
+ */
+void reload_file(void);
@@ -0,0 +1,555 @@
+/*
+ * macD_rules
+ * written by: Nathan Koop
+ *
+ * description:
+ *     rules that act on runaway processes without waiting for a human,
+ *     ie "cpu > 90 for 3 throttle 50" or "mem > 2G kill". The rules file is
+ *     compiled once at startup into a small array of struct rule, and the
+ *     report thread evaluates it right after sampling each process, so a
+ *     rule costs a comparison and a counter per process per cycle.
+ *     throttled processes are stopped and continued by the throttle thread
+ *     so that they only run for their share of every THROTTLE_PERIOD_MS, until
+ *     the rule that throttled them no longer matches for as many cycles.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "macD.h"
+#include "macD_parse.h"
+#include "macD_stats.h"
+#include "macD_rules.h"
+#include "macD_group.h"
+
+/*
+ * throttle
+ * description:
+ *     a process the throttle thread stops and continues.
+ */
+struct throttle {
+	int index;
+	int pid;
+	int duty; //share of every period the process runs for, in percent
+	int rule; //index in RULES of the rule that throttled the process
+	int calm; //cycles in a row the rule didn't match since
+};
+
+/*
+ * signal_name
+ * description:
+ *     a signal that can be given by name in a rule or a directive.
+ */
+struct signal_name {
+	char *name;
+	int sig;
+};
+
+struct signal_name SIGNAL_NAMES[] = {
+	{ "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+	{ "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "TERM", SIGTERM }, { "STOP", SIGSTOP },
+	{ "CONT", SIGCONT }
+};
+
+struct rule RULES[MAX_RULES];
+int RULE_COUNT = 0;
+unsigned char *RULE_HITS = NULL; //cycles in a row each rule matched each entry, RULE_COUNT per entry
+int HITS_CAPACITY = 0; //entries RULE_HITS has room for
+struct throttle *THROTTLES = NULL;
+int THROTTLE_COUNT = 0;
+int THROTTLE_CAPACITY = 0;
+pthread_mutex_t THROTTLELOCK = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t THROTTLECOND = PTHREAD_COND_INITIALIZER;
+
+/*
+ * parse_int
+ * description:
+ *     converts an argument of a rule to an int.
+ * parameters:
+ *     arg: the argument, or NULL if the rule ended.
+ *     suffix: a character allowed after the number, 0 for none.
+ *     out_suffix: set to 1 if the number was followed by suffix.
+ *     out_value: set to the value.
+ * returns:
+ *     0 if arg is a number, -1 otherwise.
+ */
+static int parse_int(char *arg, char suffix, int *out_suffix, int *out_value)
+{
+	char *end;
+
+	if (arg == NULL)
+		return -1;
+	long value = strtol(arg, &end, 10);
+
+	*out_suffix = 0;
+	if (suffix != 0 && (*end == suffix || *end == suffix + 'a' - 'A')) {
+		*out_suffix = 1;
+		end++;
+	}
+	if (end == arg || *end != '\0' || value < -1000000 || value > 1000000)
+		return -1;
+	*out_value = value;
+	return 0;
+}
+
+/*
+ * parse_signal
+ * description:
+ *     reads a signal given by name, with or without SIG, or by number.
+ * parameters:
+ *     arg: the argument, or NULL if the rule ended.
+ * returns:
+ *     the signal, or -1 if arg isn't a signal.
+ */
+int parse_signal(char *arg)
+{
+	int value;
+	int suffix;
+
+	if (arg == NULL)
+		return -1;
+	if (parse_int(arg, 0, &suffix, &value) == 0)
+		return value > 0 && value < NSIG ? value : -1;
+	if (strncasecmp(arg, "SIG", 3) == 0)
+		arg += 3;
+	for (int i = 0; i < sizeof(SIGNAL_NAMES)/sizeof(SIGNAL_NAMES[0]); i++) {
+		if (strcasecmp(arg, SIGNAL_NAMES[i].name) == 0)
+			return SIGNAL_NAMES[i].sig;
+	}
+	return -1;
+}
+
+/*
+ * compile_rule
+ * description:
+ *     compiles the arguments of a line of the rules file.
+ * parameters:
+ *     argv: the arguments of the line, terminated by NULL.
+ *     rule: the rule to fill.
+ * returns:
+ *     0 if the line is a valid rule, -1 otherwise.
+ */
+static int compile_rule(char **argv, struct rule *rule)
+{
+	int suffix;
+	int value;
+
+	memset(rule, 0, sizeof(struct rule));
+	rule->samples = 1;
+	rule->group = -1;
+	if (strncmp(argv[0], "@group=", 7) == 0) {
+		if (argv[0][7] == '\0' || strlen(argv[0] + 7) >= MAX_GROUP_LENGTH)
+			return -1;
+		//the group is created if no process belongs to it yet, so the rule is compiled to its id.
+		rule->group = group_intern(argv[0] + 7);
+		argv++;
+	}
+	if (argv[0] == NULL || argv[1] == NULL)
+		return -1;
+	if (strcmp(argv[0], "cpu") == 0)
+		rule->metric = METRIC_CPU;
+	else if (strcmp(argv[0], "mem") == 0)
+		rule->metric = METRIC_MEM;
+	else
+		return -1;
+	if (strcmp(argv[1], ">") != 0 && strcmp(argv[1], "<") != 0)
+		return -1;
+	rule->above = argv[1][0] == '>';
+	if (parse_int(argv[2], rule->metric == METRIC_MEM ? 'G' : 0, &suffix, &value) == -1)
+		return -1;
+	rule->threshold = suffix == 1 ? value*1024 : value;
+	argv += 3;
+	if (argv[0] != NULL && strcmp(argv[0], "for") == 0) {
+		if (parse_int(argv[1], 0, &suffix, &value) == -1 || value < 1 || value > 255)
+			return -1;
+		rule->samples = value;
+		argv += 2;
+	}
+	if (argv[0] == NULL)
+		return -1;
+	if (strcmp(argv[0], "kill") == 0) {
+		rule->action = ACTION_KILL;
+	} else if (strcmp(argv[0], "restart") == 0) {
+		rule->action = ACTION_RESTART;
+	} else if (strcmp(argv[0], "signal") == 0) {
+		rule->action = ACTION_SIGNAL;
+		rule->arg = parse_signal(argv[1]);
+		if (rule->arg == -1)
+			return -1;
+		argv++;
+	} else if (strcmp(argv[0], "throttle") == 0) {
+		rule->action = ACTION_THROTTLE;
+		if (parse_int(argv[1], '%', &suffix, &rule->arg) == -1 || rule->arg < 1 || rule->arg > 99)
+			return -1;
+		argv++;
+	} else if (strcmp(argv[0], "nice") == 0) {
+		rule->action = ACTION_NICE;
+		if (parse_int(argv[1], 0, &suffix, &rule->arg) == -1 || rule->arg < 1 || rule->arg > 39)
+			return -1;
+		argv++;
+	} else {
+		return -1;
+	}
+	return argv[1] == NULL ? 0 : -1;
+}
+
+/*
+ * rules_init
+ * description:
+ *     compiles the rules file and starts the throttle thread. A rule is a line
+ *         [@group=name] cpu|mem >|< value [for samples] action [argument]
+ *     where cpu is a percent and mem is in MB, or in GB with a G suffix, and action is
+ *     kill, restart, signal [name|number], throttle [percent] or nice [increment].
+ * parameters:
+ *     file_path: path of the rules file.
+ * returns:
+ *     0 if every rule is valid, -1 otherwise.
+ */
+int rules_init(char *file_path)
+{
+	struct process_list *list = load_process_list(file_path);
+	int rc = 0;
+
+	if (list == NULL) {
+		fprintf(stderr, "couldn't open rules file %s\n", file_path);
+		return -1;
+	}
+	for (int i = 0; i < list->count && rc == 0; i++) {
+		struct list_line *line = &list->lines[i];
+
+		if (RULE_COUNT == MAX_RULES) {
+			fprintf(stderr, "%s:%d: more than %d rules\n", file_path, line->number, MAX_RULES);
+			rc = -1;
+		} else if (line->argc == -1 || compile_rule(line->argv, &RULES[RULE_COUNT]) == -1) {
+			fprintf(stderr, "%s:%d: invalid rule\n", file_path, line->number);
+			rc = -1;
+		} else {
+			RULES[RULE_COUNT++].line = line->number;
+		}
+	}
+	free_process_list(list);
+	if (rc == 0) {
+		pthread_t thread;
+
+		pthread_create(&thread, NULL, throttle_thread, NULL);
+		pthread_detach(thread);
+	}
+	return rc;
+}
+
+/*
+ * throttle_set
+ * description:
+ *     throttles a process, or changes its share of the time if it already is.
+ * parameters:
+ *     index: the index of the process.
+ *     pid: the pid of the process.
+ *     duty: share of the time the process runs for, in percent.
+ *     rule: the index in RULES of the rule that throttles it.
+ */
+static void throttle_set(int index, int pid, int duty, int rule)
+{
+	int i = 0;
+
+	pthread_mutex_lock(&THROTTLELOCK);
+	while (i < THROTTLE_COUNT && THROTTLES[i].index != index)
+		i++;
+	if (i == THROTTLE_COUNT) {
+		if (THROTTLE_COUNT == THROTTLE_CAPACITY) {
+			THROTTLE_CAPACITY = THROTTLE_CAPACITY == 0 ? 16 : THROTTLE_CAPACITY*2;
+			THROTTLES = realloc(THROTTLES, sizeof(struct throttle)*THROTTLE_CAPACITY);
+		}
+		THROTTLE_COUNT++;
+	}
+	THROTTLES[i].index = index;
+	THROTTLES[i].pid = pid;
+	THROTTLES[i].duty = duty;
+	THROTTLES[i].rule = rule;
+	THROTTLES[i].calm = 0;
+	pthread_cond_signal(&THROTTLECOND);
+	pthread_mutex_unlock(&THROTTLELOCK);
+}
+
+/*
+ * throttle_release
+ * description:
+ *     releases the throttle of a process once the rule that throttled it
+ *     didn't match for as many cycles in a row as it needed to match.
+ * parameters:
+ *     index: the index of the process.
+ *     values: the cpu and mem usage of its last sample.
+ * pre-conditions:
+ *     PIDLOCK is held, so the throttle thread isn't signaling the process.
+ */
+static void throttle_release(int index, int *values)
+{
+	int i = 0;
+
+	pthread_mutex_lock(&THROTTLELOCK);
+	while (i < THROTTLE_COUNT && THROTTLES[i].index != index)
+		i++;
+	if (i == THROTTLE_COUNT) {
+		pthread_mutex_unlock(&THROTTLELOCK);
+		return;
+	}
+	struct throttle *throttle = &THROTTLES[i];
+	struct rule *rule = &RULES[throttle->rule];
+	int value = values[rule->metric];
+
+	//a throttled process can't use more than its share, its cpu is scaled to what it would use unthrottled.
+	if (rule->metric == METRIC_CPU && value > 0)
+		value = value*100/throttle->duty;
+	if (value < 0 || (rule->above ? value > rule->threshold : value < rule->threshold)) {
+		throttle->calm = 0;
+		pthread_mutex_unlock(&THROTTLELOCK);
+		return;
+	}
+	if (++throttle->calm < rule->samples) {
+		pthread_mutex_unlock(&THROTTLELOCK);
+		return;
+	}
+	THROTTLES[i] = THROTTLES[--THROTTLE_COUNT];
+	pthread_mutex_unlock(&THROTTLELOCK);
+	//the process may have been stopped for the rest of the period.
+	kill(PIDS[index], SIGCONT);
+	fprintf(OUTPUT_FILE, "[%d] rule of line %d no longer matches, %s usage: %d%s, throttle released\n", index, rule->line,
+		rule->metric == METRIC_CPU ? "cpu" : "mem", value, rule->metric == METRIC_CPU ? "%" : " MB");
+}
+
+/*
+ * rule_act
+ * description:
+ *     takes the action of a rule on a process and reports it.
+ * parameters:
+ *     index: the index of the process.
+ *     rule: the rule that matched.
+ *     value: the value of the metric that matched.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     1 if the process was killed, 0 otherwise.
+ */
+static int rule_act(int index, struct rule *rule, int value)
+{
+	struct process_info *info = &PROC_INFO[index];
+	int pid = PIDS[index];
+
+	fprintf(OUTPUT_FILE, "[%d] rule of line %d matched, %s usage: %d%s, ", index, rule->line,
+		rule->metric == METRIC_CPU ? "cpu" : "mem", value, rule->metric == METRIC_CPU ? "%" : " MB");
+	if (rule->action == ACTION_KILL) {
+		info->stopped = 1;
+		kill(pid, SIGKILL);
+		fprintf(OUTPUT_FILE, "killed\n");
+		return 1;
+	}
+	if (rule->action == ACTION_RESTART) {
+		info->forced = 1;
+		kill(pid, SIGKILL);
+		fprintf(OUTPUT_FILE, "restarting\n");
+		return 1;
+	}
+	if (rule->action == ACTION_SIGNAL) {
+		kill(pid, rule->arg);
+		fprintf(OUTPUT_FILE, "sent signal %d\n", rule->arg);
+	} else if (rule->action == ACTION_THROTTLE) {
+		throttle_set(index, pid, rule->arg, rule - RULES);
+		fprintf(OUTPUT_FILE, "throttled to %d%% of the time\n", rule->arg);
+	} else {
+		errno = 0;
+		int nice = getpriority(PRIO_PROCESS, pid);
+
+		if (errno == 0) {
+			nice = nice + rule->arg > 19 ? 19 : nice + rule->arg;
+			setpriority(PRIO_PROCESS, pid, nice);
+		}
+		fprintf(OUTPUT_FILE, "niced to %d\n", nice);
+	}
+	return 0;
+}
+
+/*
+ * rules_apply
+ * description:
+ *     evaluates every rule against the last sample of a running process and
+ *     takes the action of the rules that matched for as many cycles in a row
+ *     as they require. A rule that acted starts counting again from zero.
+ *     the throttle of the process is released if its rule stopped matching.
+ * parameters:
+ *     index: the index of the process.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the process was sampled in this report cycle.
+ */
+void rules_apply(int index)
+{
+	if (RULE_COUNT == 0)
+		return;
+	if (index >= HITS_CAPACITY) {
+		int capacity = HITS_CAPACITY == 0 ? 64 : HITS_CAPACITY;
+
+		while (capacity <= index)
+			capacity *= 2;
+		RULE_HITS = realloc(RULE_HITS, capacity*RULE_COUNT);
+		memset(RULE_HITS + HITS_CAPACITY*RULE_COUNT, 0, (capacity - HITS_CAPACITY)*RULE_COUNT);
+		HITS_CAPACITY = capacity;
+	}
+	struct process_info *info = &PROC_INFO[index];
+	unsigned char *hits = RULE_HITS + index*RULE_COUNT;
+	int values[2] = { info->cpu, info->mem };
+
+	throttle_release(index, values);
+	for (int i = 0; i < RULE_COUNT; i++) {
+		struct rule *rule = &RULES[i];
+		int value = values[rule->metric];
+
+		if (value < 0 || (rule->above ? value <= rule->threshold : value >= rule->threshold)) {
+			hits[i] = 0;
+			continue;
+		}
+		if (rule->group != -1 && rule->group != info->group_id)
+			continue;
+		if (++hits[i] < rule->samples)
+			continue;
+		hits[i] = 0;
+		if (rule_act(index, rule, value) == 1)
+			return;
+	}
+}
+
+/*
+ * rules_reset
+ * description:
+ *     forgets the matches and the throttle of an entry, when a new process takes its index.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void rules_reset(int index)
+{
+	if (index < HITS_CAPACITY)
+		memset(RULE_HITS + index*RULE_COUNT, 0, RULE_COUNT);
+	pthread_mutex_lock(&THROTTLELOCK);
+	for (int i = 0; i < THROTTLE_COUNT; i++) {
+		if (THROTTLES[i].index == index) {
+			THROTTLES[i] = THROTTLES[--THROTTLE_COUNT];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&THROTTLELOCK);
+}
+
+/*
+ * throttle_signal
+ * description:
+ *     sends a signal to the throttled processes whose share of the time is
+ *     above low and at most high, if they are still running.
+ * parameters:
+ *     sig: the signal to send.
+ *     low: the share, in percent, above which processes are signaled.
+ *     high: the share, in percent, up to which processes are signaled.
+ */
+static void throttle_signal(int sig, int low, int high)
+{
+	//PIDLOCK keeps the supervisor from recording the exit, and a restart from reusing the index, meanwhile.
+	stats_lock(&PIDLOCK);
+	if (SHUTTING_DOWN == 1 && sig == SIGSTOP) { //the processes were continued to handle their stop signal
+		pthread_mutex_unlock(&PIDLOCK);
+		return;
+	}
+	pthread_mutex_lock(&THROTTLELOCK);
+	for (int i = 0; i < THROTTLE_COUNT; i++) {
+		struct throttle *throttle = &THROTTLES[i];
+
+		if (throttle->duty <= low || throttle->duty > high)
+			continue;
+		int state = PROC_INFO[throttle->index].state;
+
+		if (PIDS[throttle->index] == throttle->pid && (state == PROC_RUNNING || state == PROC_READY))
+			kill(throttle->pid, sig);
+	}
+	pthread_mutex_unlock(&THROTTLELOCK);
+	pthread_mutex_unlock(&PIDLOCK);
+}
+
+/*
+ * next_duty
+ * description:
+ *     the smallest share of the time, among the throttled processes, above done.
+ * parameters:
+ *     done: the share of the time, in percent, whose processes were already stopped.
+ * returns:
+ *     the share, in percent, or 100 if there is none.
+ */
+static int next_duty(int done)
+{
+	int next = 100;
+
+	pthread_mutex_lock(&THROTTLELOCK);
+	for (int i = 0; i < THROTTLE_COUNT; i++) {
+		if (THROTTLES[i].duty > done && THROTTLES[i].duty < next)
+			next = THROTTLES[i].duty;
+	}
+	pthread_mutex_unlock(&THROTTLELOCK);
+	return next;
+}
+
+/*
+ * sleep_until
+ * description:
+ *     sleeps until the monotonic clock reaches a time.
+ * parameters:
+ *     when: the time, in ns, as returned by stats_now.
+ */
+static void sleep_until(unsigned long when)
+{
+	struct timespec deadline = { when / 1000000000UL, when % 1000000000UL };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+		continue;
+}
+
+/*
+ * throttle_thread
+ * description:
+ *     the thread function that enforces the throttles. Every THROTTLE_PERIOD_MS
+ *     the throttled processes are continued, then each is stopped once its
+ *     share of the period is over.
+ * parameters:
+ *     vargp: unused.
+ */
+void *throttle_thread(void *vargp)
+{
+	unsigned long period = THROTTLE_PERIOD_MS*1000000UL;
+
+	stats_thread("throttle");
+	while (1) {
+		pthread_mutex_lock(&THROTTLELOCK);
+		while (THROTTLE_COUNT == 0)
+			pthread_cond_wait(&THROTTLECOND, &THROTTLELOCK);
+		pthread_mutex_unlock(&THROTTLELOCK);
+		unsigned long start = stats_now();
+		int done = 0;
+
+		throttle_signal(SIGCONT, 0, 100);
+		while (done < 100) {
+			int next = next_duty(done);
+
+			sleep_until(start + next*period/100);
+			if (next < 100)
+				throttle_signal(SIGSTOP, done, next);
+			done = next;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,93 @@
+//most rules a rules file can hold.
+#define MAX_RULES 64
+//length of a throttle cycle, a throttled process runs for its share of it.
+#define THROTTLE_PERIOD_MS 100
+
+//metrics a rule compares.
+#define METRIC_CPU 0 //cpu usage, as a percent
+#define METRIC_MEM 1 //memory usage, in MB
+
+//actions of a rule.
+#define ACTION_KILL 0 //kill the process, it isn't restarted
+#define ACTION_SIGNAL 1 //send a signal
+#define ACTION_THROTTLE 2 //stop and continue the process so it only runs a share of the time
+#define ACTION_NICE 3 //lower the priority of the process
+#define ACTION_RESTART 4 //kill the process and restart it, whatever its restart policy
+
+/*
+ * rule
+ * description:
+ *     a compiled line of the rules file. Evaluating it is a comparison of two ints.
+ */
+struct rule {
+	unsigned char metric; //one of the METRIC_ values
+	unsigned char above; //1 if the rule matches values above threshold, 0 for below
+	unsigned char samples; //report cycles in a row the rule must match before it acts
+	unsigned char action; //one of the ACTION_ values
+	int threshold;
+	int arg; //signal, share of the time in percent, or nice increment
+	int line; //line of the rules file, to report the rule
+	int group; //id of the group the rule applies to, -1 for every process
+};
+
+/*
+ * parse_signal
+ * description:
+ *     reads a signal given by name, with or without SIG, or by number.
+ * parameters:
+ *     arg: the argument, or NULL if the rule ended.
+ * returns:
+ *     the signal, or -1 if arg isn't a signal.
+ */
+int parse_signal(char *arg);
+
+/*
+ * rules_init
+ * description:
+ *     compiles the rules file and starts the throttle thread. A rule is a line
+ *         [@group=name] cpu|mem >|< value [for samples] action [argument]
+ *     where cpu is a percent and mem is in MB, or in GB with a G suffix, and action is
+ *     kill, restart, signal [name|number], throttle [percent] or nice [increment].
+ * parameters:
+ *     file_path: path of the rules file.
+ * returns:
+ *     0 if every rule is valid, -1 otherwise.
+ */
+int rules_init(char *file_path);
+
+/*
+ * rules_apply
+ * description:
+ *     evaluates every rule against the last sample of a running process and
+ *     takes the action of the rules that matched for as many cycles in a row
+ *     as they require. A rule that acted starts counting again from zero.
+ *     the throttle of the process is released if its rule stopped matching.
+ * parameters:
+ *     index: the index of the process.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the process was sampled in this report cycle.
+ */
+void rules_apply(int index);
+
+/*
+ * rules_reset
+ * description:
+ *     forgets the matches and the throttle of an entry, when a new process takes its index.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void rules_reset(int index);
+
+/*
+ * throttle_thread
+ * description:
+ *     the thread function that enforces the throttles. Every THROTTLE_PERIOD_MS
+ *     the throttled processes are continued, then each is stopped once its
+ *     share of the period is over.
+ * parameters:
+ *     vargp: unused.
+ */
+void *throttle_thread(void *vargp);
@@ -0,0 +1,905 @@
+/*
+ * macD_sample
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the sampler of the reports. The /proc files of every sampled process are
+ *     opened once and read again with pread at each report, so a sample is two
+ *     reads instead of opening, parsing and closing the files byte by byte. The
+ *     descriptors also stay bound to the process they were opened for, a pid
+ *     that is reused after it exits can't be sampled by mistake through them. A
+ *     file that couldn't be kept open, when there are too many open files, is
+ *     opened by pid at each read and can read the process that took the pid.
+ *     with -I the storage io, context switch and run queue counters are read in the
+ *     same pass from /proc/[pid]/io, status and schedstat, and kept as the growth
+ *     since the last report. The context switches and the run queue wait are those
+ *     of the main thread, or of every thread with @threads.
+ *     with -T each child is sampled with its whole process tree: the children of
+ *     every process already in the tree are read from /proc/[pid]/task/[tid]/children
+ *     during the same pass, so descendants forked since the last report are found
+ *     without scanning /proc, and their cpu and memory are added to the child.
+ *     with @threads the threads of the child are sampled through descriptors kept
+ *     open on /proc/[pid]/task/[tid]/stat in the same way. The task directory
+ *     is only listed again when the number of threads changed or a thread exited.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "macD.h"
+#include "macD_sample.h"
+
+//descriptor of a file that can't be read, it isn't opened again at each sample.
+#define UNREADABLE -2
+
+/*
+ * member
+ * description:
+ *     a process of the tree of an entry, the first one is the process of the entry.
+ */
+struct member {
+	int pid;
+	int parent; //pid of the process it was found as a child of, 0 for the process of the entry
+	int stat_fd; //-1 if it couldn't be kept open
+	int statm_fd;
+	int children_fd; //children of the main thread, -1 if the tree isn't sampled
+	int io_fd; //UNREADABLE if the process can't be traced or the counters aren't read
+	int status_fd;
+	int schedstat_fd;
+	unsigned long ticks; //cpu ticks used at the last sample
+	struct proc_counters counters; //counters at the last sample
+	int threads; //number of threads at the last sample
+	int listed; //last pass the member was found in the tree
+	int added; //pass the member was added in
+};
+
+/*
+ * task
+ * description:
+ *     a thread of the process of an entry sampled with @threads.
+ */
+struct task {
+	int tid;
+	int stat_fd; //-1 if it couldn't be kept open
+	int status_fd; //UNREADABLE for the main thread, read with its member, or if the counters aren't read
+	int schedstat_fd;
+	unsigned long ticks; //cpu ticks used at the last sample
+	unsigned long delta; //cpu ticks used since the sample before
+	struct proc_counters counters; //context switches and run queue wait at the last sample
+	int listed; //last pass the thread was read in
+	char name[THREAD_NAME_LENGTH];
+};
+
+/*
+ * tree
+ * description:
+ *     the processes sampled for an entry of the process table.
+ *     a member is always after the member it was found as a child of.
+ */
+struct tree {
+	struct member *members;
+	int count;
+	int capacity;
+	int pass; //number of the current sampling pass
+	unsigned long total; //cpu ticks used by the tree, members that exited included
+	struct proc_counters sum; //counters of the tree, members that exited included
+	struct proc_counters reported; //sum at the last sample
+	struct task *tasks; //threads of the first member, with @threads
+	int task_count;
+	int task_capacity;
+};
+
+int SAMPLE_TREE = 0;
+int SAMPLE_COUNTERS = 0;
+struct tree *TREES = NULL; //indexed like PIDS
+int TREES_CAPACITY = 0;
+char *CHILDREN_BUFFER = NULL; //holds a children file while it is parsed
+int CHILDREN_BUFFER_SIZE = 0;
+
+/*
+ * sample_init
+ * description:
+ *     sets what the sampler reads. Every sampled process keeps up to six
+ *     descriptors open, so the limit of open files is raised as far as allowed.
+ * parameters:
+ *     tree: 1 to sample the whole process tree of each child, 0 for only the child.
+ *     counters: 1 to read the io, context switch and run queue counters, 0 to leave them at 0.
+ */
+void sample_init(int tree, int counters)
+{
+	struct rlimit limit;
+
+	SAMPLE_TREE = tree;
+	SAMPLE_COUNTERS = counters;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+/*
+ * sample_counters_enabled
+ * description:
+ *     checks if the io, context switch and run queue counters are read.
+ * returns:
+ *     1 if they are read, 0 otherwise.
+ */
+int sample_counters_enabled(void)
+{
+	return SAMPLE_COUNTERS;
+}
+
+/*
+ * open_proc
+ * description:
+ *     opens a file of /proc/[pid].
+ * parameters:
+ *     pid: the pid of the process.
+ *     name: the path of the file under /proc/[pid].
+ * returns:
+ *     the descriptor, UNREADABLE if macD isn't allowed to read the file,
+ *     or -1 if it couldn't be opened otherwise.
+ */
+static int open_proc(int pid, char *name)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path), "/proc/%d/%s", pid, name);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	return fd == -1 && errno == EACCES ? UNREADABLE : fd;
+}
+
+/*
+ * read_proc
+ * description:
+ *     reads a file of /proc/[pid] from its start, through its cached descriptor
+ *     or, if there are too many open files to keep one, by opening it for this read.
+ * parameters:
+ *     fd: the cached descriptor, -1 if there is none.
+ *     pid: the pid of the process.
+ *     name: the path of the file under /proc/[pid].
+ *     buffer: the buffer to read to, the contents are terminated by a null character.
+ *     size: the size of buffer.
+ * returns:
+ *     the number of bytes read, or -1 if the process exited or the file is UNREADABLE.
+ */
+static int read_proc(int fd, int pid, char *name, char *buffer, int size)
+{
+	int own = fd == -1;
+
+	if (fd == UNREADABLE)
+		return -1;
+	if (own)
+		fd = open_proc(pid, name);
+	if (fd == -1)
+		return -1;
+	int len = pread(fd, buffer, size-1, 0);
+
+	if (own)
+		close(fd);
+	if (len <= 0)
+		return -1;
+	buffer[len] = '\0';
+	return len;
+}
+
+/*
+ * close_member
+ * description:
+ *     closes the descriptors of a member.
+ * parameters:
+ *     member: the member.
+ */
+static void close_member(struct member *member)
+{
+	int fds[] = {member->stat_fd, member->statm_fd, member->children_fd,
+		     member->io_fd, member->status_fd, member->schedstat_fd};
+
+	for (int k = 0; k < 6; k++) {
+		if (fds[k] >= 0)
+			close(fds[k]);
+	}
+}
+
+/*
+ * add_member
+ * description:
+ *     appends a process to a tree and opens its files.
+ * parameters:
+ *     tree: the tree.
+ *     pid: the pid of the process.
+ *     parent: the pid of the process it was found as a child of, 0 for the process of the entry.
+ * returns:
+ *     the index of the member in the tree.
+ */
+static int add_member(struct tree *tree, int pid, int parent)
+{
+	if (tree->count == tree->capacity) {
+		tree->capacity = tree->capacity == 0 ? 4 : tree->capacity*2;
+		tree->members = realloc(tree->members, sizeof(struct member)*tree->capacity);
+	}
+	struct member *member = &tree->members[tree->count];
+	char name[64];
+
+	member->pid = pid;
+	member->parent = parent;
+	member->stat_fd = open_proc(pid, "stat");
+	member->statm_fd = open_proc(pid, "statm");
+	member->io_fd = UNREADABLE;
+	member->status_fd = UNREADABLE;
+	member->schedstat_fd = UNREADABLE;
+	if (SAMPLE_COUNTERS == 1) {
+		member->io_fd = open_proc(pid, "io");
+		member->status_fd = open_proc(pid, "status");
+		member->schedstat_fd = open_proc(pid, "schedstat");
+	}
+	member->children_fd = -1;
+	if (SAMPLE_TREE == 1) {
+		sprintf(name, "task/%d/children", pid);
+		member->children_fd = open_proc(pid, name);
+	}
+	member->ticks = 0;
+	memset(&member->counters, 0, sizeof(struct proc_counters));
+	member->threads = 1;
+	member->listed = tree->pass;
+	member->added = tree->pass;
+	return tree->count++;
+}
+
+/*
+ * read_stat
+ * description:
+ *     reads the cpu ticks, the parent and the number of threads of a member.
+ * parameters:
+ *     member: the member.
+ *     ticks: set to the user and system ticks used by the process.
+ *     ppid: set to the pid of its parent.
+ * returns:
+ *     0 if the process was read, -1 if it exited.
+ */
+static int read_stat(struct member *member, unsigned long *ticks, int *ppid)
+{
+	char buffer[1024];
+	unsigned long user;
+	unsigned long system;
+
+	if (read_proc(member->stat_fd, member->pid, "stat", buffer, sizeof(buffer)) == -1)
+		return -1;
+	//the name of the process can hold spaces and parentheses, the fields start after the last one.
+	char *fields = strrchr(buffer, ')');
+
+	//fields 3 to 20: state, ppid, ..., utime (14), stime (15), ..., num_threads (20).
+	if (fields == NULL || sscanf(fields+2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %d",
+				     ppid, &user, &system, &member->threads) != 4)
+		return -1;
+	*ticks = user + system;
+	return 0;
+}
+
+/*
+ * read_mem
+ * description:
+ *     reads the memory usage of a member, the same way as get_mem_usage.
+ * parameters:
+ *     member: the member.
+ * returns:
+ *     the sum of the fields of /proc/[pid]/statm, in pages.
+ */
+static long read_mem(struct member *member)
+{
+	char buffer[256];
+	long sum = 0;
+	char *cursor = buffer;
+	char *end;
+
+	if (read_proc(member->statm_fd, member->pid, "statm", buffer, sizeof(buffer)) == -1)
+		return 0;
+	for (long value = strtol(cursor, &end, 10); end != cursor; value = strtol(cursor, &end, 10)) {
+		sum += value;
+		cursor = end;
+	}
+	return sum;
+}
+
+/*
+ * read_field
+ * description:
+ *     reads the value of a field of a /proc file made of lines "name: value".
+ * parameters:
+ *     buffer: the contents of the file.
+ *     name: the name of the field, preceded by a newline and followed by ':'.
+ *     value: set to the value, left unchanged if the field isn't in the file.
+ */
+static void read_field(char *buffer, char *name, unsigned long long *value)
+{
+	char *field = strstr(buffer, name);
+
+	if (field != NULL)
+		*value = strtoull(field + strlen(name), NULL, 10);
+}
+
+/*
+ * read_sched
+ * description:
+ *     reads the context switches and the run queue wait of a thread. A counter
+ *     that can't be read keeps its value, so it doesn't grow.
+ * parameters:
+ *     status_fd: the descriptor of its status file.
+ *     schedstat_fd: the descriptor of its schedstat file.
+ *     pid: the pid of its process.
+ *     dir: the directory of the thread under /proc/[pid], "" for the main thread.
+ *     counters: the counters to set.
+ */
+static void read_sched(int status_fd, int schedstat_fd, int pid, char *dir, struct proc_counters *counters)
+{
+	char buffer[4096];
+	char name[64];
+
+	sprintf(name, "%sstatus", dir);
+	if (read_proc(status_fd, pid, name, buffer, sizeof(buffer)) != -1) {
+		read_field(buffer, "\nvoluntary_ctxt_switches:", &counters->voluntary);
+		read_field(buffer, "\nnonvoluntary_ctxt_switches:", &counters->involuntary);
+	}
+	//schedstat is the time on the cpu, the time waiting on a run queue, both in ns, and the number of timeslices.
+	sprintf(name, "%sschedstat", dir);
+	if (read_proc(schedstat_fd, pid, name, buffer, sizeof(buffer)) != -1)
+		sscanf(buffer, "%*u %llu", &counters->wait_ns);
+}
+
+/*
+ * read_counters
+ * description:
+ *     reads the storage io, context switch and run queue counters of a member. A
+ *     counter that can't be read keeps its last value, so it doesn't grow.
+ *     io counts the whole process, the other counters only its main thread.
+ * parameters:
+ *     member: the member.
+ *     counters: set to the counters of the member.
+ */
+static void read_counters(struct member *member, struct proc_counters *counters)
+{
+	char buffer[4096];
+
+	*counters = member->counters;
+	//read_bytes and write_bytes are what went to the storage, rchar and wchar also count pipes, sockets and the page cache.
+	if (read_proc(member->io_fd, member->pid, "io", buffer, sizeof(buffer)) != -1) {
+		read_field(buffer, "\nread_bytes:", &counters->read_bytes);
+		read_field(buffer, "\nwrite_bytes:", &counters->write_bytes);
+	}
+	read_sched(member->status_fd, member->schedstat_fd, member->pid, "", counters);
+}
+
+/*
+ * add_counters
+ * description:
+ *     adds the growth of the counters of a member to the counters of its tree.
+ * parameters:
+ *     sum: the counters of the tree.
+ *     now: the counters of the member.
+ *     last: the counters of the member at the last sample.
+ */
+static void add_counters(struct proc_counters *sum, struct proc_counters *now, struct proc_counters *last)
+{
+	sum->read_bytes += now->read_bytes - last->read_bytes;
+	sum->write_bytes += now->write_bytes - last->write_bytes;
+	sum->voluntary += now->voluntary - last->voluntary;
+	sum->involuntary += now->involuntary - last->involuntary;
+	sum->wait_ns += now->wait_ns - last->wait_ns;
+}
+
+/*
+ * read_children
+ * description:
+ *     reads a children file of /proc into CHILDREN_BUFFER.
+ * parameters:
+ *     fd: the descriptor of the file, -1 to open it.
+ *     pid: the pid of the process.
+ *     name: the path of the file under /proc/[pid].
+ * returns:
+ *     0 if it was read, -1 otherwise.
+ */
+static int read_children(int fd, int pid, char *name)
+{
+	int len;
+
+	if (CHILDREN_BUFFER == NULL) {
+		CHILDREN_BUFFER_SIZE = 4096;
+		CHILDREN_BUFFER = malloc(CHILDREN_BUFFER_SIZE);
+	}
+	//the file is read again into a bigger buffer until it fits.
+	while ((len = read_proc(fd, pid, name, CHILDREN_BUFFER, CHILDREN_BUFFER_SIZE)) >= CHILDREN_BUFFER_SIZE-1) {
+		CHILDREN_BUFFER_SIZE *= 2;
+		CHILDREN_BUFFER = realloc(CHILDREN_BUFFER, CHILDREN_BUFFER_SIZE);
+	}
+	return len == -1 ? -1 : 0;
+}
+
+/*
+ * list_children
+ * description:
+ *     marks the children in CHILDREN_BUFFER as members of the tree, adding the new ones.
+ * parameters:
+ *     tree: the tree.
+ *     parent: the index of the member they are children of.
+ */
+static void list_children(struct tree *tree, int parent)
+{
+	char *cursor = CHILDREN_BUFFER;
+	char *end;
+	int hint = parent+1; //children usually come in the same order as in the last pass
+
+	for (long pid = strtol(cursor, &end, 10); end != cursor; pid = strtol(cursor, &end, 10)) {
+		int found = -1;
+
+		cursor = end;
+		if (hint < tree->count && tree->members[hint].pid == pid)
+			found = hint;
+		for (int k = parent+1; found == -1 && k < tree->count; k++) {
+			if (tree->members[k].pid == pid)
+				found = k;
+		}
+		if (found == -1)
+			found = add_member(tree, pid, tree->members[parent].pid);
+		tree->members[found].listed = tree->pass;
+		hint = found+1;
+	}
+}
+
+/*
+ * find_children
+ * description:
+ *     finds the children of a member. Children are listed by the thread that
+ *     forked them, the other threads are only read if the process has more than one.
+ * parameters:
+ *     tree: the tree.
+ *     index: the index of the member.
+ */
+static void find_children(struct tree *tree, int index)
+{
+	struct member *member = &tree->members[index];
+	int pid = member->pid;
+	char name[64];
+
+	sprintf(name, "task/%d/children", pid);
+	if (read_children(member->children_fd, pid, name) == 0)
+		list_children(tree, index);
+	if (tree->members[index].threads <= 1)
+		return;
+	sprintf(name, "/proc/%d/task", pid);
+	DIR *tasks = opendir(name);
+	struct dirent *task;
+
+	if (tasks == NULL)
+		return;
+	while ((task = readdir(tasks)) != NULL) {
+		int tid = atoi(task->d_name);
+
+		if (tid <= 0 || tid == pid)
+			continue;
+		sprintf(name, "task/%d/children", tid);
+		if (read_children(-1, pid, name) == 0)
+			list_children(tree, index);
+	}
+	closedir(tasks);
+}
+
+/*
+ * read_task
+ * description:
+ *     reads the name and the cpu ticks of a thread.
+ * parameters:
+ *     task: the thread.
+ *     pid: the pid of its process.
+ *     pass: the current sampling pass.
+ * returns:
+ *     0 if the thread was read, -1 if it exited.
+ */
+static int read_task(struct task *task, int pid, int pass)
+{
+	char buffer[1024];
+	char name[64];
+	unsigned long user;
+	unsigned long system;
+
+	sprintf(name, "task/%d/stat", task->tid);
+	if (read_proc(task->stat_fd, pid, name, buffer, sizeof(buffer)) == -1)
+		return -1;
+	//the name is between the first '(' and the last ')', it can hold both.
+	char *start = strchr(buffer, '(');
+	char *end = strrchr(buffer, ')');
+
+	if (start == NULL || end == NULL || end < start ||
+	    sscanf(end+2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2)
+		return -1;
+	int len = end - start - 1;
+
+	if (len >= THREAD_NAME_LENGTH)
+		len = THREAD_NAME_LENGTH-1;
+	memcpy(task->name, start+1, len);
+	task->name[len] = '\0';
+	task->delta = user + system - task->ticks;
+	task->ticks = user + system;
+	task->listed = pass;
+	return 0;
+}
+
+/*
+ * close_task
+ * description:
+ *     closes the descriptors of a thread.
+ * parameters:
+ *     task: the thread.
+ */
+static void close_task(struct task *task)
+{
+	int fds[] = {task->stat_fd, task->status_fd, task->schedstat_fd};
+
+	for (int k = 0; k < 3; k++) {
+		if (fds[k] >= 0)
+			close(fds[k]);
+	}
+}
+
+/*
+ * list_tasks
+ * description:
+ *     reads the task directory of the process of a tree and adds the threads
+ *     that aren't sampled yet. A new thread is read once to start counting
+ *     from, its ticks before it was found aren't counted in this pass.
+ * parameters:
+ *     tree: the tree.
+ */
+static void list_tasks(struct tree *tree)
+{
+	int pid = tree->members[0].pid;
+	char name[64];
+
+	sprintf(name, "/proc/%d/task", pid);
+	DIR *dir = opendir(name);
+	struct dirent *entry;
+
+	if (dir == NULL)
+		return;
+	while ((entry = readdir(dir)) != NULL) {
+		int tid = atoi(entry->d_name);
+		int found = 0;
+
+		if (tid <= 0)
+			continue;
+		for (int k = 0; k < tree->task_count && found == 0; k++)
+			found = tree->tasks[k].tid == tid;
+		if (found == 1)
+			continue;
+		if (tree->task_count == tree->task_capacity) {
+			tree->task_capacity = tree->task_capacity == 0 ? 8 : tree->task_capacity*2;
+			tree->tasks = realloc(tree->tasks, sizeof(struct task)*tree->task_capacity);
+		}
+		struct task *task = &tree->tasks[tree->task_count];
+
+		sprintf(name, "task/%d/stat", tid);
+		task->tid = tid;
+		task->stat_fd = open_proc(pid, name);
+		task->status_fd = UNREADABLE;
+		task->schedstat_fd = UNREADABLE;
+		if (SAMPLE_COUNTERS == 1 && tid != pid) {
+			sprintf(name, "task/%d/status", tid);
+			task->status_fd = open_proc(pid, name);
+			sprintf(name, "task/%d/schedstat", tid);
+			task->schedstat_fd = open_proc(pid, name);
+		}
+		task->ticks = 0;
+		memset(&task->counters, 0, sizeof(struct proc_counters));
+		sprintf(name, "task/%d/", tid);
+		read_sched(task->status_fd, task->schedstat_fd, pid, name, &task->counters);
+		if (read_task(task, pid, tree->pass) == 0) {
+			task->delta = 0;
+			tree->task_count++;
+		} else {
+			close_task(task);
+		}
+	}
+	closedir(dir);
+}
+
+/*
+ * sample_threads
+ * description:
+ *     samples the threads of the process of an entry and keeps the hottest
+ *     ones in its process_info. With -I the context switches and run queue
+ *     wait of the threads other than the main one are added to the tree.
+ * parameters:
+ *     tree: the tree of the entry.
+ *     info: the process_info of the entry.
+ */
+static void sample_threads(struct tree *tree, struct process_info *info)
+{
+	int pid = tree->members[0].pid;
+	int kept = 0;
+	char name[64];
+
+	for (int k = 0; k < tree->task_count; k++) {
+		struct task *task = &tree->tasks[k];
+		struct proc_counters counters = task->counters;
+
+		if (read_task(task, pid, tree->pass) == -1 || task->status_fd == UNREADABLE)
+			continue;
+		sprintf(name, "task/%d/", task->tid);
+		read_sched(task->status_fd, task->schedstat_fd, pid, name, &counters);
+		add_counters(&tree->sum, &counters, &task->counters);
+		task->counters = counters;
+	}
+	//the directory is only listed again when threads were created or exited.
+	for (int k = 0; k < tree->task_count; k++) {
+		if (tree->tasks[k].listed == tree->pass)
+			tree->tasks[kept++] = tree->tasks[k];
+		else
+			close_task(&tree->tasks[k]);
+	}
+	tree->task_count = kept;
+	if (kept != tree->members[0].threads)
+		list_tasks(tree);
+	if (info->threads == NULL)
+		info->threads = malloc(sizeof(struct thread_usage)*info->hot_threads);
+	info->thread_count = 0;
+	//a selection of the hottest threads, hot_threads is small.
+	for (int k = 0; k < tree->task_count; k++) {
+		struct task *task = &tree->tasks[k];
+		int at = info->thread_count;
+
+		while (at > 0 && info->threads[at-1].ticks < (int)task->delta)
+			at--;
+		if (at == info->hot_threads)
+			continue;
+		if (info->thread_count < info->hot_threads)
+			info->thread_count++;
+		memmove(&info->threads[at+1], &info->threads[at], sizeof(struct thread_usage)*(info->thread_count-at-1));
+		info->threads[at].tid = task->tid;
+		info->threads[at].ticks = (int)task->delta;
+		info->threads[at].cpu = 0;
+		strcpy(info->threads[at].name, task->name);
+	}
+}
+
+/*
+ * sample_forget
+ * description:
+ *     closes the files of the processes sampled for an entry.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void sample_forget(int index)
+{
+	if (index >= TREES_CAPACITY)
+		return;
+	struct tree *tree = &TREES[index];
+
+	for (int k = 0; k < tree->count; k++)
+		close_member(&tree->members[k]);
+	tree->count = 0;
+	for (int k = 0; k < tree->task_count; k++)
+		close_task(&tree->tasks[k]);
+	tree->task_count = 0;
+	PROC_INFO[index].thread_count = 0;
+}
+
+/*
+ * sample_process
+ * description:
+ *     samples the process of an entry, and its descendants with -T. Descendants
+ *     that are no longer in the tree are dropped, their cpu time until the last
+ *     report stays counted, the time they used since is lost.
+ *     the threads of the process are sampled if the entry has @threads.
+ *     with -I the growth of the io, context switch and run queue counters since
+ *     the last sample is set in the process_info of the entry.
+ * parameters:
+ *     index: the index of the entry.
+ *     out_mem: set to the memory usage of the process, or of its tree, in MB.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the process of the entry is running.
+ * returns:
+ *     the number of ticks the process, or its tree, has been on the cpu for,
+ *     or -1 if the process exited.
+ */
+int sample_process(int index, int *out_mem)
+{
+	if (index >= TREES_CAPACITY) {
+		int capacity = TREES_CAPACITY == 0 ? 16 : TREES_CAPACITY;
+
+		while (capacity <= index)
+			capacity *= 2;
+		TREES = realloc(TREES, sizeof(struct tree)*capacity);
+		memset(TREES+TREES_CAPACITY, 0, sizeof(struct tree)*(capacity-TREES_CAPACITY));
+		TREES_CAPACITY = capacity;
+	}
+	struct tree *tree = &TREES[index];
+	int fresh = tree->count == 0 || tree->members[0].pid != PIDS[index];
+	long pages = 0;
+	int live = 0;
+
+	if (fresh) { //a new process took the entry
+		sample_forget(index);
+		tree->total = 0;
+		memset(&tree->sum, 0, sizeof(struct proc_counters));
+		memset(&tree->reported, 0, sizeof(struct proc_counters));
+		add_member(tree, PIDS[index], 0);
+	}
+	tree->pass++;
+	tree->members[0].listed = tree->pass;
+	//members found in this pass are appended and visited by this same loop.
+	for (int k = 0; k < tree->count; k++) {
+		struct member *member = &tree->members[k];
+		struct proc_counters counters;
+		unsigned long ticks;
+		int ppid;
+
+		if (member->listed != tree->pass || read_stat(member, &ticks, &ppid) == -1) {
+			member->listed = -1;
+			continue;
+		}
+		//a child that exited and whose pid was reused before it was opened is another process.
+		if (member->added == tree->pass && member->parent != 0 && ppid != member->parent) {
+			member->listed = -1;
+			continue;
+		}
+		tree->total += ticks - member->ticks;
+		member->ticks = ticks;
+		if (SAMPLE_COUNTERS == 1) {
+			read_counters(member, &counters);
+			add_counters(&tree->sum, &counters, &member->counters);
+			member->counters = counters;
+		}
+		pages += read_mem(member);
+		live++;
+		if (SAMPLE_TREE == 1)
+			find_children(tree, k);
+	}
+	if (tree->members[0].listed != tree->pass) {
+		sample_forget(index);
+		return -1;
+	}
+	//drops the members that weren't found, the order of the others is kept.
+	if (live < tree->count) {
+		int kept = 0;
+
+		for (int k = 0; k < tree->count; k++) {
+			if (tree->members[k].listed == tree->pass)
+				tree->members[kept++] = tree->members[k];
+			else
+				close_member(&tree->members[k]);
+		}
+		tree->count = kept;
+	}
+	if (PROC_INFO[index].hot_threads > 0)
+		sample_threads(tree, &PROC_INFO[index]);
+	memset(&PROC_INFO[index].counters, 0, sizeof(struct proc_counters));
+	add_counters(&PROC_INFO[index].counters, &tree->sum, &tree->reported);
+	tree->reported = tree->sum;
+	*out_mem = pages/1024;
+	return (int)tree->total;
+}
+
+/*
+ * sample_size
+ * description:
+ *     the number of processes sampled for an entry in the last pass.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of processes in the tree of the entry, 0 if it wasn't sampled.
+ */
+int sample_size(int index)
+{
+	if (index >= TREES_CAPACITY)
+		return 0;
+	return TREES[index].count;
+}
+
+/*
+ * valid_index
+ * description:
+ *     checks that an index sent by a client is in the process table.
+ * parameters:
+ *     index: the index.
+ * returns:
+ *     1 if the index is valid, 0 otherwise.
+ */
+static int valid_index(int index)
+{
+	int count = 0;
+
+	while (count <= index && PIDS[count] != -1)
+		count++;
+	return index >= 0 && count > index;
+}
+
+/*
+ * sample_threads_text
+ * description:
+ *     renders the hottest threads of an entry in the last report cycle, a line
+ *         index=[index] pid=[pid] threads=[count]
+ *     followed by a line per thread, hottest first:
+ *         tid=[tid] cpu=[percent] name=[name]
+ * parameters:
+ *     index: the index of the entry.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the index is invalid,
+ *     the entry isn't sampled with @threads or its process isn't running.
+ */
+char *sample_threads_text(int index, int *out_len)
+{
+	if (valid_index(index) == 0)
+		return NULL;
+	struct process_info *info = &PROC_INFO[index];
+
+	if (info->hot_threads == 0 || (info->state != PROC_RUNNING && info->state != PROC_READY))
+		return NULL;
+	char *text = NULL;
+	size_t len = 0;
+	FILE *file = open_memstream(&text, &len);
+
+	fprintf(file, "index=%d pid=%d threads=%d\n", index, PIDS[index], info->thread_count);
+	for (int k = 0; k < info->thread_count; k++)
+		fprintf(file, "tid=%d cpu=%d name=%s\n", info->threads[k].tid, info->threads[k].cpu, info->threads[k].name);
+	fclose(file);
+	*out_len = len;
+	return text;
+}
+
+/*
+ * sample_metrics_text
+ * description:
+ *     renders the usage of an entry in the last report cycle, a line
+ *         index=[index] pid=[pid] cpu=[percent] mem=[MB]
+ *     followed with -I by
+ *         storage_read=[bytes] storage_write=[bytes] voluntary=[switches] involuntary=[switches] wait=[us]
+ *     where the counters are their growth in the cycle, storage_read and storage_write are the bytes
+ *     read from and written to the storage, and wait is the time spent waiting on a run queue.
+ *     The context switches and the wait are those of the main thread, or of every thread with @threads.
+ * parameters:
+ *     index: the index of the entry.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the index is invalid or its process isn't running.
+ */
+char *sample_metrics_text(int index, int *out_len)
+{
+	if (valid_index(index) == 0)
+		return NULL;
+	struct process_info *info = &PROC_INFO[index];
+	struct proc_counters *counters = &info->counters;
+
+	if (info->state != PROC_RUNNING && info->state != PROC_READY)
+		return NULL;
+	char *text = NULL;
+	size_t len = 0;
+	FILE *file = open_memstream(&text, &len);
+
+	fprintf(file, "index=%d pid=%d cpu=%d mem=%d", index, PIDS[index], info->cpu > 0 ? info->cpu : 0, info->mem);
+	if (SAMPLE_COUNTERS == 1)
+		fprintf(file, " storage_read=%llu storage_write=%llu voluntary=%llu involuntary=%llu wait=%llu",
+			counters->read_bytes, counters->write_bytes, counters->voluntary, counters->involuntary,
+			counters->wait_ns/1000);
+	fprintf(file, "\n");
+	fclose(file);
+	*out_len = len;
+	return text;
+}
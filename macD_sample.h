@@ -0,0 +1,100 @@
+/*
+ * sample_init
+ * description:
+ *     sets what the sampler reads. Every sampled process keeps up to six
+ *     descriptors open, so the limit of open files is raised as far as allowed.
+ * parameters:
+ *     tree: 1 to sample the whole process tree of each child, 0 for only the child.
+ *     counters: 1 to read the io, context switch and run queue counters, 0 to leave them at 0.
+ */
+void sample_init(int tree, int counters);
+
+/*
+ * sample_counters_enabled
+ * description:
+ *     checks if the io, context switch and run queue counters are read.
+ * returns:
+ *     1 if they are read, 0 otherwise.
+ */
+int sample_counters_enabled(void);
+
+/*
+ * sample_process
+ * description:
+ *     samples the process of an entry, and its descendants with -T, through
+ *     descriptors kept open between reports. The threads of an entry with
+ *     @threads are sampled too, its hottest ones are kept in its process_info,
+ *     with the growth of its io, context switch and run queue counters with -I.
+ * parameters:
+ *     index: the index of the entry.
+ *     out_mem: set to the memory usage of the process, or of its tree, in MB.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     the process of the entry is running.
+ * returns:
+ *     the number of ticks the process, or its tree, has been on the cpu for,
+ *     or -1 if the process exited.
+ */
+int sample_process(int index, int *out_mem);
+
+/*
+ * sample_forget
+ * description:
+ *     closes the files of the processes sampled for an entry.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void sample_forget(int index);
+
+/*
+ * sample_size
+ * description:
+ *     the number of processes sampled for an entry in the last pass.
+ * parameters:
+ *     index: the index of the entry.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of processes in the tree of the entry, 0 if it wasn't sampled.
+ */
+int sample_size(int index);
+
+/*
+ * sample_threads_text
+ * description:
+ *     renders the hottest threads of an entry in the last report cycle, a line
+ *         index=[index] pid=[pid] threads=[count]
+ *     followed by a line per thread, hottest first:
+ *         tid=[tid] cpu=[percent] name=[name]
+ * parameters:
+ *     index: the index of the entry.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the index is invalid,
+ *     the entry isn't sampled with @threads or its process isn't running.
+ */
+char *sample_threads_text(int index, int *out_len);
+
+/*
+ * sample_metrics_text
+ * description:
+ *     renders the usage of an entry in the last report cycle, a line
+ *         index=[index] pid=[pid] cpu=[percent] mem=[MB]
+ *     followed with -I by
+ *         storage_read=[bytes] storage_write=[bytes] voluntary=[switches] involuntary=[switches] wait=[us]
+ *     where the counters are their growth in the cycle, storage_read and storage_write are the bytes
+ *     read from and written to the storage, and wait is the time spent waiting on a run queue.
+ *     The context switches and the wait are those of the main thread, or of every thread with @threads.
+ * parameters:
+ *     index: the index of the entry.
+ *     out_len: set to the length of the text.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the text, to be freed with free, or NULL if the index is invalid or its process isn't running.
+ */
+char *sample_metrics_text(int index, int *out_len);
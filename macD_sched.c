@@ -0,0 +1,359 @@
+/*
+ * macD_sched
+ * written by: Nathan Koop
+ *
+ * description:
+ *     places the processes created by macD on cores or NUMA nodes.
+ *     new processes are assigned a unit when they are launched, using
+ *     round robin, the least loaded unit, or packing units in order.
+ *     after every report cycle the measured cpu usage is used to move
+ *     processes off of hot units with sched_setaffinity.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "macD.h"
+#include "macD_sched.h"
+
+#define POLICY_NONE 0
+#define POLICY_RR 1
+#define POLICY_LEAST 2
+#define POLICY_PACK 3
+
+//load charged to a unit for a process that has not been measured yet.
+#define NEW_PROCESS_LOAD 100
+//a unit is saturated once its load reaches this percent of its capacity.
+#define HOT_PERCENT 90
+//the most processes moved in a single report cycle.
+#define MAX_MOVES 8
+
+struct placement_unit {
+	cpu_set_t cpus;
+	int num_cpus;
+	int load; //sum of the cpu usage, as a percent, of processes on this unit
+	int count; //number of processes bound to this unit
+};
+
+int POLICY = POLICY_NONE;
+struct placement_unit *UNITS;
+int NUM_UNITS = 0;
+int NEXT_UNIT = 0;
+
+/*
+ * add_unit
+ * description:
+ *     appends a unit made of the given cpus to UNITS.
+ * parameters:
+ *     cpus: the cpus of the new unit.
+ */
+static void add_unit(cpu_set_t *cpus)
+{
+	UNITS = realloc(UNITS, sizeof(struct placement_unit)*(NUM_UNITS+1));
+	memset(&UNITS[NUM_UNITS], 0, sizeof(struct placement_unit));
+	UNITS[NUM_UNITS].cpus = *cpus;
+	UNITS[NUM_UNITS].num_cpus = CPU_COUNT(cpus);
+	NUM_UNITS++;
+}
+
+/*
+ * read_cpulist
+ * description:
+ *     reads a cpu list such as "0-3,8,10-11" from the given file.
+ * parameters:
+ *     path: path of the file holding the cpu list.
+ *     out: set to store the cpus in.
+ * returns:
+ *     0 if the file was read, -1 if it doesn't exist.
+ */
+static int read_cpulist(char *path, cpu_set_t *out)
+{
+	FILE *fptr = fopen(path, "r");
+	int first, last;
+	char sep;
+
+	if (fptr == NULL)
+		return -1;
+	CPU_ZERO(out);
+	while (fscanf(fptr, "%d", &first) == 1) {
+		last = first;
+		if (fscanf(fptr, "%c", &sep) == 1 && sep == '-') {
+			if (fscanf(fptr, "%d", &last) != 1)
+				break;
+			if (fscanf(fptr, "%c", &sep) != 1)
+				sep = '\n';
+		}
+		for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, out);
+		if (sep != ',')
+			break;
+	}
+	fclose(fptr);
+	return 0;
+}
+
+/*
+ * sched_init
+ * description:
+ *     parses the placement policy and discovers the placement units.
+ *     the policy is one of "rr", "least" or "pack", optionally followed
+ *     by ":node" to place processes on NUMA nodes instead of single cores.
+ *     only cpus this process is allowed to run on are used.
+ * parameters:
+ *     policy: string containing the placement policy.
+ * pre-condition:
+ *     policy is initialized.
+ * returns:
+ *     0 if the policy is valid and at least one unit was found.
+ *     -1 otherwise.
+ */
+int sched_init(char *policy)
+{
+	cpu_set_t allowed;
+	int use_nodes = 0;
+	int len = strlen(policy);
+	char *suffix = strchr(policy, ':');
+
+	if (suffix != NULL) {
+		if (strcmp(suffix, ":node") != 0)
+			return -1;
+		use_nodes = 1;
+		len = suffix - policy;
+	}
+	if (strncmp(policy, "rr", len) == 0 && len == 2)
+		POLICY = POLICY_RR;
+	else if (strncmp(policy, "least", len) == 0 && len == 5)
+		POLICY = POLICY_LEAST;
+	else if (strncmp(policy, "pack", len) == 0 && len == 4)
+		POLICY = POLICY_PACK;
+	else
+		return -1;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+		POLICY = POLICY_NONE;
+		return -1;
+	}
+	if (use_nodes == 1) {
+		for (int node = 0; ; node++) {
+			char path[64];
+			cpu_set_t cpus;
+
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+			if (read_cpulist(path, &cpus) == -1)
+				break;
+			CPU_AND(&cpus, &cpus, &allowed);
+			if (CPU_COUNT(&cpus) > 0)
+				add_unit(&cpus);
+		}
+	}
+	if (NUM_UNITS == 0) { //one unit per cpu, also used when there is no NUMA information
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			cpu_set_t cpus;
+
+			if (!CPU_ISSET(cpu, &allowed))
+				continue;
+			CPU_ZERO(&cpus);
+			CPU_SET(cpu, &cpus);
+			add_unit(&cpus);
+		}
+	}
+	if (NUM_UNITS == 0) {
+		POLICY = POLICY_NONE;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * sched_enabled
+ * description:
+ *     checks if a placement policy is active.
+ * returns:
+ *     1 if sched_init succeeded, 0 otherwise.
+ */
+int sched_enabled(void)
+{
+	return POLICY != POLICY_NONE;
+}
+
+/*
+ * sched_place
+ * description:
+ *     chooses the unit a new process should be bound to according
+ *     to the placement policy and charges the unit for the new process.
+ * returns:
+ *     the index of the chosen unit, or -1 if placement is disabled.
+ */
+int sched_place(void)
+{
+	int unit = 0;
+
+	if (POLICY == POLICY_NONE)
+		return -1;
+	if (POLICY == POLICY_RR) {
+		unit = NEXT_UNIT;
+		NEXT_UNIT = (NEXT_UNIT+1) % NUM_UNITS;
+	} else if (POLICY == POLICY_LEAST) {
+		//compare load per cpu, ties go to the unit with fewer processes.
+		for (int i = 1; i < NUM_UNITS; i++) {
+			long lhs = (long)UNITS[i].load * UNITS[unit].num_cpus;
+			long rhs = (long)UNITS[unit].load * UNITS[i].num_cpus;
+
+			if (lhs < rhs || (lhs == rhs && UNITS[i].count < UNITS[unit].count))
+				unit = i;
+		}
+	} else {
+		//first unit with room left, the least loaded one if every unit is full.
+		int least = 0;
+
+		unit = -1;
+		for (int i = 0; i < NUM_UNITS; i++) {
+			if (UNITS[i].load + NEW_PROCESS_LOAD <= 100*UNITS[i].num_cpus) {
+				unit = i;
+				break;
+			}
+			if (UNITS[i].load*UNITS[least].num_cpus < UNITS[least].load*UNITS[i].num_cpus)
+				least = i;
+		}
+		if (unit == -1)
+			unit = least;
+	}
+	UNITS[unit].load += NEW_PROCESS_LOAD;
+	UNITS[unit].count++;
+	return unit;
+}
+
+/*
+ * sched_unplace
+ * description:
+ *     returns the charge taken by sched_place for a process that failed to start.
+ * parameters:
+ *     unit: the unit returned by sched_place.
+ */
+void sched_unplace(int unit)
+{
+	if (unit < 0 || unit >= NUM_UNITS)
+		return;
+	UNITS[unit].load -= NEW_PROCESS_LOAD;
+	UNITS[unit].count--;
+}
+
+/*
+ * sched_unit_mask
+ * description:
+ *     gives the set of cpus that make up the given unit.
+ * parameters:
+ *     unit: index of the unit.
+ * returns:
+ *     pointer to the cpu set of the unit, or NULL if unit is not valid.
+ */
+cpu_set_t *sched_unit_mask(int unit)
+{
+	if (unit < 0 || unit >= NUM_UNITS)
+		return NULL;
+	return &UNITS[unit].cpus;
+}
+
+/*
+ * sched_bind
+ * description:
+ *     binds the process with the given pid to the cpus of unit.
+ * parameters:
+ *     pid: the process to bind, 0 for the calling process.
+ *     unit: the unit to bind the process to.
+ * returns:
+ *     0 on success, -1 otherwise.
+ */
+int sched_bind(int pid, int unit)
+{
+	cpu_set_t *cpus = sched_unit_mask(unit);
+
+	if (cpus == NULL)
+		return -1;
+	return sched_setaffinity(pid, sizeof(cpu_set_t), cpus);
+}
+
+/*
+ * is_hot
+ * description:
+ *     checks if a unit is saturated while running more processes than it has cpus.
+ * parameters:
+ *     unit: index of the unit to check.
+ * returns:
+ *     1 if the unit is hot, 0 otherwise.
+ */
+static int is_hot(int unit)
+{
+	struct placement_unit *u = &UNITS[unit];
+
+	return u->count > u->num_cpus && u->load >= HOT_PERCENT*u->num_cpus;
+}
+
+/*
+ * sched_rebalance
+ * description:
+ *     recomputes the load of every unit from the cpu usage measured in
+ *     the last report cycle and moves processes away from hot units.
+ *     a unit is hot when it is saturated and runs more processes than it has cpus.
+ * parameters:
+ *     pids: list of process ids.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     pids is terminated by a -1 element.
+ *     PROC_INFO holds the cpu usage measured in this report cycle.
+ */
+void sched_rebalance(int *pids)
+{
+	if (POLICY == POLICY_NONE)
+		return;
+	for (int u = 0; u < NUM_UNITS; u++) {
+		UNITS[u].load = 0;
+		UNITS[u].count = 0;
+	}
+	for (int i = 0; pids[i] != -1; i++) {
+		int unit = PROC_INFO[i].unit;
+
+		if (unit < 0 || PROC_INFO[i].cpu < 0)
+			continue;
+		UNITS[unit].load += PROC_INFO[i].cpu;
+		UNITS[unit].count++;
+	}
+	for (int moves = 0; moves < MAX_MOVES; moves++) {
+		int hot = -1;
+		int cool = 0;
+		int victim = -1;
+
+		for (int u = 0; u < NUM_UNITS; u++) {
+			if (is_hot(u) && (hot == -1 || UNITS[u].load*UNITS[hot].num_cpus > UNITS[hot].load*UNITS[u].num_cpus))
+				hot = u;
+			if (UNITS[u].load*UNITS[cool].num_cpus < UNITS[cool].load*UNITS[u].num_cpus)
+				cool = u;
+		}
+		if (hot == -1 || cool == hot)
+			return;
+		//move the busiest process that leaves the cool unit below the hot one.
+		for (int i = 0; pids[i] != -1; i++) {
+			int cpu = PROC_INFO[i].cpu;
+
+			if (PROC_INFO[i].unit != hot || cpu < 0)
+				continue;
+			if (UNITS[cool].load + cpu >= UNITS[hot].load)
+				continue;
+			if (victim == -1 || cpu > PROC_INFO[victim].cpu)
+				victim = i;
+		}
+		if (victim == -1)
+			return;
+		if (sched_bind(pids[victim], cool) == -1)
+			return;
+		UNITS[hot].load -= PROC_INFO[victim].cpu;
+		UNITS[hot].count--;
+		UNITS[cool].load += PROC_INFO[victim].cpu;
+		UNITS[cool].count++;
+		PROC_INFO[victim].unit = cool;
+	}
+}
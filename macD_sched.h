@@ -0,0 +1,82 @@
+/*
+ * sched_init
+ * description:
+ *     parses the placement policy and discovers the placement units.
+ *     the policy is one of "rr", "least" or "pack", optionally followed
+ *     by ":node" to place processes on NUMA nodes instead of single cores.
+ *     only cpus this process is allowed to run on are used.
+ * parameters:
+ *     policy: string containing the placement policy.
+ * pre-condition:
+ *     policy is initialized.
+ * returns:
+ *     0 if the policy is valid and at least one unit was found.
+ *     -1 otherwise.
+ */
+int sched_init(char *policy);
+
+/*
+ * sched_enabled
+ * description:
+ *     checks if a placement policy is active.
+ * returns:
+ *     1 if sched_init succeeded, 0 otherwise.
+ */
+int sched_enabled(void);
+
+/*
+ * sched_place
+ * description:
+ *     chooses the unit a new process should be bound to according
+ *     to the placement policy and charges the unit for the new process.
+ * returns:
+ *     the index of the chosen unit, or -1 if placement is disabled.
+ */
+int sched_place(void);
+
+/*
+ * sched_unplace
+ * description:
+ *     returns the charge taken by sched_place for a process that failed to start.
+ * parameters:
+ *     unit: the unit returned by sched_place.
+ */
+void sched_unplace(int unit);
+
+/*
+ * sched_bind
+ * description:
+ *     binds the process with the given pid to the cpus of unit.
+ * parameters:
+ *     pid: the process to bind, 0 for the calling process.
+ *     unit: the unit to bind the process to.
+ * returns:
+ *     0 on success, -1 otherwise.
+ */
+int sched_bind(int pid, int unit);
+
+/*
+ * sched_unit_mask
+ * description:
+ *     gives the set of cpus that make up the given unit.
+ * parameters:
+ *     unit: index of the unit.
+ * returns:
+ *     pointer to the cpu set of the unit, or NULL if unit is not valid.
+ */
+cpu_set_t *sched_unit_mask(int unit);
+
+/*
+ * sched_rebalance
+ * description:
+ *     recomputes the load of every unit from the cpu usage measured in
+ *     the last report cycle and moves processes away from hot units.
+ *     a unit is hot when it is saturated and runs more processes than it has cpus.
+ * parameters:
+ *     pids: list of process ids.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     pids is terminated by a -1 element.
+ *     PROC_INFO holds the cpu usage measured in this report cycle.
+ */
+void sched_rebalance(int *pids);
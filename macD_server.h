@@ -25,6 +25,46 @@ void *server_mannager(void *void_client);
  */
 void add_client(int client_sock);
 
+/*
+ * send_text
+ * description:
+ *     sends a variable length reply: its length as an int followed by the text.
+ * parameters:
+ *     client_sock: the socket of the client.
+ *     render: function that renders the text and sets its length.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int send_text(int client_sock, char *(*render)(int *out_len));
+
+/*
+ * recv_all
+ * description:
+ *     receives exactly len bytes from the client.
+ * parameters:
+ *     client_sock: the socket to read from.
+ *     buffer: where to store the bytes read.
+ *     len: the number of bytes to read.
+ * returns:
+ *     0 if len bytes were read, -1 if the client disconnected or an error occured.
+ */
+int recv_all(int client_sock, void *buffer, int len);
+
+/*
+ * spawn_request
+ * description:
+ *     reads a spawn request from the client, creates the process and adds it
+ *     to the process table. The reply is the index of the new process followed
+ *     by its pid, both -1 if the process failed to start.
+ *     a length that is negative or above MAX_SPAWN_LENGTH can't be skipped, the
+ *     connection is closed like for an invalid group command.
+ * parameters:
+ *     client_sock: the socket of the client that sent the spwn command.
+ * returns:
+ *     0 if the reply was sent, -1 if the connection must be closed.
+ */
+int spawn_request(int client_sock);
+
 /*
  * start_server
  * description:
@@ -44,3 +84,50 @@ void start_server();
  *     server socket and all connected client sockets are closed.
  */
 void close_server();
+
+/*
+ * tail_request
+ * description:
+ *     reads the index of a tail command and replies with the output kept
+ *     for that process: its length as an int followed by the output,
+ *     or a length of -1 if output isn't captured or the index is invalid.
+ * parameters:
+ *     client_sock: the socket of the client that sent the tail command.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int tail_request(int client_sock);
+
+/*
+ * process_request
+ * description:
+ *     reads the index of a process command and replies with the length of
+ *     the text as an int followed by the text, or a length of -1 if the index is invalid:
+ *     thrd: the hottest threads of the process in the last report cycle, see sample_threads_text,
+ *     -1 if the process isn't sampled with @threads.
+ *     proc: the usage of the process in the last report cycle, see sample_metrics_text,
+ *     -1 if it isn't running.
+ * parameters:
+ *     client_sock: the socket of the client that sent the command.
+ *     command: the name of the command, thrd or proc.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int process_request(int client_sock, char *command);
+
+/*
+ * group_request
+ * description:
+ *     reads the group name of a group command, the length of the name followed
+ *     by the name, and replies:
+ *     gkil: the number of processes terminated as an int, -1 if the group doesn't exist.
+ *     gsta: the length of the state of the group as an int followed by the text, see group_stat.
+ *     gtal: the length of the output of the group as an int followed by the output, see group_tail.
+ *     the text replies have a length of -1 if the group doesn't exist.
+ * parameters:
+ *     client_sock: the socket of the client that sent the command.
+ *     command: the name of the command, gsta, gkil or gtal.
+ * returns:
+ *     0 if the reply was sent, -1 otherwise.
+ */
+int group_request(int client_sock, char *command);
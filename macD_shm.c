@@ -0,0 +1,224 @@
+/*
+ * macD_shm
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the status page of macD: a copy of the process table in a POSIX
+ *     shared memory segment, refreshed every report cycle. Local readers map
+ *     it read-only and copy it under a seqlock, so reading the status takes no
+ *     system call and no time from macD, unlike polling STAT over the socket.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "macD.h"
+#include "macD_lib.h"
+#include "macD_shm.h"
+
+char SHM_NAME[256] = "";
+int SHM_FD = -1;
+struct macd_status_page *SHM_PAGE = NULL;
+int SHM_CAPACITY = 0;
+
+/*
+ * page_size
+ * description:
+ *     the size of a status page.
+ * parameters:
+ *     capacity: the number of entries of the page.
+ * returns:
+ *     the size in bytes.
+ */
+static long page_size(int capacity)
+{
+	return sizeof(struct macd_status_page) + capacity*sizeof(struct macd_status_process);
+}
+
+/*
+ * resize_page
+ * description:
+ *     grows the segment and maps it again. Readers notice the new capacity and
+ *     map it again themselves, their old mapping stays valid until they do.
+ * parameters:
+ *     capacity: the number of entries the page needs room for.
+ * returns:
+ *     0 if the page was resized, -1 otherwise.
+ */
+static int resize_page(int capacity)
+{
+	if (ftruncate(SHM_FD, page_size(capacity)) == -1)
+		return -1;
+	void *page = mmap(NULL, page_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, SHM_FD, 0);
+
+	if (page == MAP_FAILED)
+		return -1;
+	if (SHM_PAGE != NULL)
+		munmap(SHM_PAGE, page_size(SHM_CAPACITY));
+	SHM_PAGE = page;
+	SHM_CAPACITY = capacity;
+	return 0;
+}
+
+/*
+ * page_owner
+ * description:
+ *     reads the pid of the macD that published the existing segment SHM_NAME.
+ * returns:
+ *     the pid, 0 if there is no segment, or -1 if it isn't a status page.
+ */
+static int page_owner(void)
+{
+	struct macd_status_page page;
+	int fd = shm_open(SHM_NAME, O_RDONLY | O_CLOEXEC, 0);
+
+	if (fd == -1)
+		return errno == ENOENT ? 0 : -1;
+	int len = pread(fd, &page, sizeof(page), 0);
+
+	close(fd);
+	if (len != sizeof(page) || page.magic != MACD_STATUS_MAGIC || page.pid <= 0)
+		return -1;
+	return page.pid;
+}
+
+/*
+ * shm_init
+ * description:
+ *     creates the shared memory status page, readable by local readers
+ *     through macd_status_open of libmacD. A page left by a macD that is no
+ *     longer running is replaced, the page of a running one is left alone.
+ * parameters:
+ *     name: the name of the page, a / is prepended if it doesn't start with one.
+ * returns:
+ *     0 if the page was created, -1 otherwise.
+ */
+int shm_init(char *name)
+{
+	snprintf(SHM_NAME, sizeof(SHM_NAME), "%s%s", name[0] == '/' ? "" : "/", name);
+	int owner = page_owner();
+
+	if (owner == -1) {
+		fprintf(stderr, "couldn't create status page %s: it exists and isn't a macD status page\n", SHM_NAME);
+		return -1;
+	}
+	if (owner > 0 && (kill(owner, 0) == 0 || errno == EPERM)) {
+		fprintf(stderr, "couldn't create status page %s: it is published by macD %d\n", SHM_NAME, owner);
+		return -1;
+	}
+	//a page left by a macD that crashed is replaced, readers still mapping it see no more updates.
+	if (owner > 0)
+		shm_unlink(SHM_NAME);
+	SHM_FD = shm_open(SHM_NAME, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (SHM_FD == -1) {
+		fprintf(stderr, "couldn't create status page %s: %s\n", SHM_NAME, strerror(errno));
+		return -1;
+	}
+	if (resize_page(64) == -1) {
+		fprintf(stderr, "couldn't map status page %s: %s\n", SHM_NAME, strerror(errno));
+		shm_close();
+		return -1;
+	}
+	SHM_PAGE->magic = MACD_STATUS_MAGIC;
+	SHM_PAGE->version = MACD_STATUS_VERSION;
+	SHM_PAGE->capacity = SHM_CAPACITY;
+	SHM_PAGE->pid = getpid();
+	return 0;
+}
+
+/*
+ * shm_publish
+ * description:
+ *     copies the process table into the status page. Readers that copy the
+ *     page while it is written see seq change and retry, so they never block macD.
+ * parameters:
+ *     pids: list of process ids
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     pids is terminated by a -1 element.
+ */
+void shm_publish(int *pids)
+{
+	if (SHM_PAGE == NULL)
+		return;
+	int count = 0;
+
+	while (pids[count] != -1)
+		count++;
+	if (count > SHM_CAPACITY) {
+		int capacity = SHM_CAPACITY;
+
+		while (capacity < count)
+			capacity *= 2;
+		if (resize_page(capacity) == -1) {
+			fprintf(stderr, "couldn't grow status page %s: %s\n", SHM_NAME, strerror(errno));
+			count = SHM_CAPACITY;
+		}
+	}
+	struct timespec real;
+	struct timespec mono;
+
+	clock_gettime(CLOCK_REALTIME, &real);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	unsigned long real_ns = real.tv_sec*1000000000UL + real.tv_nsec;
+	unsigned long mono_ns = mono.tv_sec*1000000000UL + mono.tv_nsec;
+	struct macd_status_page *page = SHM_PAGE;
+	unsigned long seq = page->seq;
+	int running = 0;
+
+	//seqlock: odd while writing, the release fence keeps the writes after the increment.
+	__atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	for (int i = 0; i < count; i++) {
+		struct process_info *info = &PROC_INFO[i];
+		struct macd_status_process *entry = &page->processes[i];
+		unsigned long started = info->started.tv_sec*1000000000UL + info->started.tv_nsec;
+		int live = info->state == PROC_RUNNING || info->state == PROC_READY;
+
+		entry->pid = pids[i];
+		entry->state = info->state;
+		entry->cpu = live ? info->cpu : 0;
+		entry->mem = live ? info->mem : 0;
+		entry->restarts = info->restarts;
+		entry->removed = info->removed;
+		//started is on the monotonic clock, readers get unix time.
+		entry->started = started == 0 ? 0 : real_ns - (mono_ns - started);
+		strncpy(entry->name, info->argv[0], MACD_NAME_LENGTH-1);
+		entry->name[MACD_NAME_LENGTH-1] = '\0';
+		strncpy(entry->group, info->group, MACD_NAME_LENGTH-1);
+		entry->group[MACD_NAME_LENGTH-1] = '\0';
+		running += live;
+	}
+	page->capacity = SHM_CAPACITY;
+	page->count = count;
+	page->running = running;
+	page->updated = real_ns;
+	page->cycles++;
+	__atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * shm_close
+ * description:
+ *     removes the status page, readers that mapped it keep their mapping.
+ */
+void shm_close(void)
+{
+	if (SHM_FD == -1)
+		return;
+	if (SHM_PAGE != NULL)
+		munmap(SHM_PAGE, page_size(SHM_CAPACITY));
+	close(SHM_FD);
+	shm_unlink(SHM_NAME);
+	SHM_PAGE = NULL;
+	SHM_FD = -1;
+}
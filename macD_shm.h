@@ -0,0 +1,32 @@
+/*
+ * shm_init
+ * description:
+ *     creates the shared memory status page, readable by local readers
+ *     through macd_status_open of libmacD. A page left by a macD that is no
+ *     longer running is replaced, the page of a running one is left alone.
+ * parameters:
+ *     name: the name of the page, a / is prepended if it doesn't start with one.
+ * returns:
+ *     0 if the page was created, -1 otherwise.
+ */
+int shm_init(char *name);
+
+/*
+ * shm_publish
+ * description:
+ *     copies the process table into the status page. Readers that copy the
+ *     page while it is written see seq change and retry, so they never block macD.
+ * parameters:
+ *     pids: list of process ids
+ * pre-conditions:
+ *     PIDLOCK is held.
+ *     pids is terminated by a -1 element.
+ */
+void shm_publish(int *pids);
+
+/*
+ * shm_close
+ * description:
+ *     removes the status page, readers that mapped it keep their mapping.
+ */
+void shm_close(void);
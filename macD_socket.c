@@ -0,0 +1,87 @@
+/*
+ * macD_socket
+ * written by: Nathan Koop
+ *
+ * description:
+ *     addresses of the unix sockets macD and its clients talk over.
+ *     shared by the server, the client and the benchmarks so they agree
+ *     on how a socket path is spelled.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "macD_socket.h"
+
+/*
+ * socket_address
+ * description:
+ *     fills the address of a unix socket. A path starting with '@' names a
+ *     socket in the abstract namespace, which is not a file, so it never has
+ *     to be unlinked and doesn't depend on the working directory.
+ * parameters:
+ *     path: the path of the socket, or @name for an abstract socket.
+ *     address: the address to fill.
+ * returns:
+ *     the length of the address, or -1 if the path is too long.
+ */
+int socket_address(char *path, struct sockaddr_un *address)
+{
+	int len = strlen(path);
+
+	memset(address, 0, sizeof(struct sockaddr_un));
+	address->sun_family = AF_UNIX;
+	if (len == 0 || len >= (int)sizeof(address->sun_path))
+		return -1;
+	memcpy(address->sun_path, path, len);
+	if (path[0] != '@')
+		return sizeof(struct sockaddr_un);
+	//abstract names are not terminated, every byte of the length is part of the name.
+	address->sun_path[0] = '\0';
+	return offsetof(struct sockaddr_un, sun_path) + len;
+}
+
+/*
+ * socket_connect
+ * description:
+ *     opens a connection to the server listening on path. The client socket
+ *     is autobound to a unique abstract address, so any number of clients
+ *     can be connected at once without sharing a file.
+ * parameters:
+ *     path: the path of the server socket, or @name for an abstract socket.
+ * returns:
+ *     the connected socket, or -1 if the server couldn't be reached.
+ */
+int socket_connect(char *path)
+{
+	struct sockaddr_un address;
+	int len = socket_address(path, &address);
+
+	if (len == -1) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (sock == -1)
+		return -1;
+	//binding only the family makes the kernel pick an unused abstract name.
+	struct sockaddr_un local = { .sun_family = AF_UNIX };
+
+	if (bind(sock, (struct sockaddr *)&local, sizeof(sa_family_t)) == -1 ||
+	    connect(sock, (struct sockaddr *)&address, len) == -1) {
+		int saved = errno;
+
+		close(sock);
+		errno = saved;
+		return -1;
+	}
+	return sock;
+}
@@ -0,0 +1,29 @@
+//the socket macD listens on when no path is given with -s.
+#define DEFAULT_SOCKET_PATH "macd.socket.server"
+
+/*
+ * socket_address
+ * description:
+ *     fills the address of a unix socket. A path starting with '@' names a
+ *     socket in the abstract namespace, which is not a file, so it never has
+ *     to be unlinked and doesn't depend on the working directory.
+ * parameters:
+ *     path: the path of the socket, or @name for an abstract socket.
+ *     address: the address to fill.
+ * returns:
+ *     the length of the address, or -1 if the path is too long.
+ */
+int socket_address(char *path, struct sockaddr_un *address);
+
+/*
+ * socket_connect
+ * description:
+ *     opens a connection to the server listening on path. The client socket
+ *     is autobound to a unique abstract address, so any number of clients
+ *     can be connected at once without sharing a file.
+ * parameters:
+ *     path: the path of the server socket, or @name for an abstract socket.
+ * returns:
+ *     the connected socket, or -1 if the server couldn't be reached.
+ */
+int socket_connect(char *path);
@@ -0,0 +1,254 @@
+/*
+ * macD_stats
+ * written by: Nathan Koop
+ *
+ * description:
+ *     self instrumentation of macD. Every thread records the duration of
+ *     the phases it runs in its own set of histograms, so recording is a few
+ *     instructions on memory no other thread writes to. The sets are only
+ *     combined when they are dumped, through the perf command or at shutdown.
+ *     when a thread exits its histograms are folded into a shared set.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "macD_hist.h"
+#include "macD_stats.h"
+
+char *PHASE_NAMES[STAT_PHASES] = { "spawn", "sample", "report", "lock_wait", "request", "jitter" };
+
+/*
+ * stats_block
+ * description:
+ *     the histograms of one thread. lock is only contended while the block is dumped.
+ */
+struct stats_block {
+	pthread_mutex_t lock;
+	char *name;
+	int tid;
+	struct histogram hists[STAT_PHASES];
+	struct stats_block *next;
+};
+
+__thread struct stats_block *MY_STATS = NULL;
+__thread char *MY_NAME = "thread";
+struct stats_block *STATS_BLOCKS = NULL; //blocks of the running threads
+struct stats_block *STATS_RETIRED = NULL; //histograms of the threads that exited
+pthread_mutex_t STATSLOCK = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t STATS_KEY;
+pthread_once_t STATS_ONCE = PTHREAD_ONCE_INIT;
+unsigned long STATS_START = 0;
+
+/*
+ * stats_now
+ * description:
+ *     reads the monotonic clock.
+ * returns:
+ *     the current time in ns.
+ */
+unsigned long stats_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000UL + now.tv_nsec;
+}
+
+/*
+ * new_block
+ * description:
+ *     allocates an empty block of histograms.
+ * parameters:
+ *     name: the name of the thread owning the block.
+ * returns:
+ *     the new block.
+ */
+static struct stats_block *new_block(char *name)
+{
+	struct stats_block *block = malloc(sizeof(struct stats_block));
+
+	pthread_mutex_init(&block->lock, NULL);
+	block->name = name;
+	block->tid = gettid();
+	block->next = NULL;
+	for (int i = 0; i < STAT_PHASES; i++)
+		hist_init(&block->hists[i]);
+	return block;
+}
+
+/*
+ * retire_block
+ * description:
+ *     called when a thread that recorded statistics exits.
+ *     folds its histograms into STATS_RETIRED and frees its block.
+ * parameters:
+ *     vargp: the block of the thread.
+ */
+static void retire_block(void *vargp)
+{
+	struct stats_block *block = vargp;
+
+	pthread_mutex_lock(&STATSLOCK);
+	for (struct stats_block **link = &STATS_BLOCKS; *link != NULL; link = &(*link)->next) {
+		if (*link == block) {
+			*link = block->next;
+			break;
+		}
+	}
+	for (int i = 0; i < STAT_PHASES; i++)
+		hist_merge(&STATS_RETIRED->hists[i], &block->hists[i]);
+	pthread_mutex_unlock(&STATSLOCK);
+	pthread_mutex_destroy(&block->lock);
+	free(block);
+}
+
+/*
+ * init_stats
+ * description:
+ *     creates the key used to retire the blocks of exiting threads.
+ */
+static void init_stats(void)
+{
+	pthread_key_create(&STATS_KEY, retire_block);
+	STATS_RETIRED = new_block("exited");
+	STATS_START = stats_now();
+}
+
+/*
+ * my_block
+ * description:
+ *     finds the block of the calling thread, creating it on first use.
+ * returns:
+ *     the block of the calling thread.
+ */
+static struct stats_block *my_block(void)
+{
+	if (MY_STATS != NULL)
+		return MY_STATS;
+	pthread_once(&STATS_ONCE, init_stats);
+	MY_STATS = new_block(MY_NAME);
+	pthread_setspecific(STATS_KEY, MY_STATS);
+	pthread_mutex_lock(&STATSLOCK);
+	MY_STATS->next = STATS_BLOCKS;
+	STATS_BLOCKS = MY_STATS;
+	pthread_mutex_unlock(&STATSLOCK);
+	return MY_STATS;
+}
+
+/*
+ * stats_thread
+ * description:
+ *     names the calling thread in the dumps of the statistics.
+ * parameters:
+ *     name: the name of the thread, must stay valid while the thread runs.
+ */
+void stats_thread(char *name)
+{
+	MY_NAME = name;
+	if (MY_STATS != NULL)
+		MY_STATS->name = name;
+}
+
+/*
+ * stats_record
+ * description:
+ *     records the duration of a phase in the histograms of the calling thread.
+ *     only the calling thread writes to them, so recording never waits on another thread.
+ * parameters:
+ *     phase: the phase, one of the STAT_ defines.
+ *     ns: the duration of the phase in ns.
+ */
+void stats_record(int phase, unsigned long ns)
+{
+	struct stats_block *block = my_block();
+
+	pthread_mutex_lock(&block->lock);
+	hist_record(&block->hists[phase], ns);
+	pthread_mutex_unlock(&block->lock);
+}
+
+/*
+ * stats_lock
+ * description:
+ *     locks lock and records how long the calling thread waited for it.
+ * parameters:
+ *     lock: the mutex to lock.
+ * post-conditions:
+ *     lock is held.
+ */
+void stats_lock(pthread_mutex_t *lock)
+{
+	//an uncontended lock is recorded as a wait of 0 without reading the clock.
+	if (pthread_mutex_trylock(lock) == 0) {
+		stats_record(STAT_LOCK_WAIT, 0);
+		return;
+	}
+	unsigned long before = stats_now();
+
+	pthread_mutex_lock(lock);
+	stats_record(STAT_LOCK_WAIT, stats_now() - before);
+}
+
+/*
+ * stats_dump
+ * description:
+ *     prints the histograms of every thread, then the totals of every phase.
+ *     each line is a set of key=value pairs, times are in us.
+ * parameters:
+ *     file: the file to print to.
+ */
+void stats_dump(FILE *file)
+{
+	struct histogram totals[STAT_PHASES];
+	char prefix[128];
+
+	pthread_once(&STATS_ONCE, init_stats);
+	for (int i = 0; i < STAT_PHASES; i++)
+		hist_init(&totals[i]);
+	fprintf(file, "perf uptime=%.3f unit=us\n", (stats_now() - STATS_START)/1e9);
+	pthread_mutex_lock(&STATSLOCK);
+	for (struct stats_block *block = STATS_BLOCKS; block != NULL; block = block->next) {
+		pthread_mutex_lock(&block->lock);
+		for (int i = 0; i < STAT_PHASES; i++) {
+			if (block->hists[i].count == 0)
+				continue;
+			sprintf(prefix, "thread=%s tid=%d phase=%s", block->name, block->tid, PHASE_NAMES[i]);
+			hist_print(file, prefix, &block->hists[i], 1000);
+			hist_merge(&totals[i], &block->hists[i]);
+		}
+		pthread_mutex_unlock(&block->lock);
+	}
+	for (int i = 0; i < STAT_PHASES; i++)
+		hist_merge(&totals[i], &STATS_RETIRED->hists[i]);
+	pthread_mutex_unlock(&STATSLOCK);
+	for (int i = 0; i < STAT_PHASES; i++) {
+		sprintf(prefix, "thread=all phase=%s", PHASE_NAMES[i]);
+		hist_print(file, prefix, &totals[i], 1000);
+	}
+}
+
+/*
+ * stats_text
+ * description:
+ *     renders stats_dump into a string.
+ * parameters:
+ *     out_len: set to the length of the string.
+ * returns:
+ *     the text of the dump, to be freed with free.
+ */
+char *stats_text(int *out_len)
+{
+	char *text = NULL;
+	size_t len = 0;
+	FILE *file = open_memstream(&text, &len);
+
+	stats_dump(file);
+	fclose(file);
+	*out_len = len;
+	return text;
+}
@@ -0,0 +1,69 @@
+//phases of macD that are timed.
+#define STAT_SPAWN 0 //creating a process, in start_process
+#define STAT_SAMPLE 1 //reading the cpu and memory usage of one process
+#define STAT_REPORT 2 //a whole report cycle, sampling included
+#define STAT_LOCK_WAIT 3 //waiting for PIDLOCK
+#define STAT_REQUEST 4 //handling a client command, from receiving it to replying
+#define STAT_JITTER 5 //how late a report cycle started compared to its schedule
+#define STAT_PHASES 6
+
+/*
+ * stats_now
+ * description:
+ *     reads the monotonic clock.
+ * returns:
+ *     the current time in ns.
+ */
+unsigned long stats_now(void);
+
+/*
+ * stats_thread
+ * description:
+ *     names the calling thread in the dumps of the statistics.
+ * parameters:
+ *     name: the name of the thread, must stay valid while the thread runs.
+ */
+void stats_thread(char *name);
+
+/*
+ * stats_record
+ * description:
+ *     records the duration of a phase in the histograms of the calling thread.
+ *     only the calling thread writes to them, so recording never waits on another thread.
+ * parameters:
+ *     phase: the phase, one of the STAT_ defines.
+ *     ns: the duration of the phase in ns.
+ */
+void stats_record(int phase, unsigned long ns);
+
+/*
+ * stats_lock
+ * description:
+ *     locks lock and records how long the calling thread waited for it.
+ * parameters:
+ *     lock: the mutex to lock.
+ * post-conditions:
+ *     lock is held.
+ */
+void stats_lock(pthread_mutex_t *lock);
+
+/*
+ * stats_dump
+ * description:
+ *     prints the histograms of every thread, then the totals of every phase.
+ *     each line is a set of key=value pairs, times are in us.
+ * parameters:
+ *     file: the file to print to.
+ */
+void stats_dump(FILE *file);
+
+/*
+ * stats_text
+ * description:
+ *     renders stats_dump into a string.
+ * parameters:
+ *     out_len: set to the length of the string.
+ * returns:
+ *     the text of the dump, to be freed with free.
+ */
+char *stats_text(int *out_len);
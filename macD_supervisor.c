@@ -0,0 +1,475 @@
+/*
+ * macD_supervisor
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the supervisor thread reaps every child of macD as soon as it exits.
+ *     SIGCHLD is blocked in every thread and read from a signalfd, so an
+ *     exit is noticed within milliseconds instead of at the next report.
+ *     processes that exit are restarted in the same slot of PIDS according
+ *     to their restart policy, with an exponential backoff for crash loops.
+ *     processes adopted from the journal aren't children, their pidfds are polled instead.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include "macD.h"
+#include "macD_stats.h"
+#include "macD_supervisor.h"
+#include "macD_reload.h"
+#include "macD_deps.h"
+#include "macD_probe.h"
+#include "macD_journal.h"
+#include "macD_sample.h"
+
+//a process that ran for this long before exiting resets its backoff.
+#define STABLE_MS 10000
+//longest delay between two restarts.
+#define MAX_BACKOFF_MS 30000
+
+/*
+ * stopping
+ * description:
+ *     a process sent its stop signal outside of shutdown, killed if it outlives GRACE_MS.
+ */
+struct stopping {
+	int index; //index of its entry, -1 if it isn't in the process table
+	int pid;
+	int pidfd; //pins the process, so a reused pid isn't killed
+	struct timespec deadline; //when it is killed
+};
+
+int SIGNAL_FD = -1;
+int WAKE_FD = -1;
+int PROBE_FD = -1;
+int ADOPTED_FD = -1;
+struct stopping *STOPPING = NULL;
+int STOPPING_COUNT = 0;
+int STOPPING_CAPACITY = 0;
+
+/*
+ * supervisor_block_signals
+ * description:
+ *     blocks SIGCHLD and SIGHUP in the calling thread so that they are only
+ *     received through the supervisor's signalfd. Threads created afterwards inherit the mask.
+ * pre-conditions:
+ *     called by the main thread before any other thread is started.
+ */
+void supervisor_block_signals(void)
+{
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+
+/*
+ * supervisor_start
+ * description:
+ *     starts the supervisor thread. The supervisor is the only thread that
+ *     waits on children, it records their exit, restarts them according to their
+ *     restart policy, and completes the start check of new processes.
+ *     it also reloads the process list file on SIGHUP or when it changes.
+ * post-condition:
+ *     the supervisor thread is running.
+ */
+void supervisor_start(void)
+{
+	sigset_t mask;
+	pthread_t thread;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGHUP);
+	SIGNAL_FD = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	WAKE_FD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	PROBE_FD = probe_init();
+	ADOPTED_FD = journal_watch_fd();
+	if (SIGNAL_FD == -1 || WAKE_FD == -1) {
+		fprintf(stderr, "supervisor error %s\n", strerror(errno));
+		exit(1);
+	}
+	pthread_create(&thread, NULL, supervisor_loop, NULL);
+}
+
+/*
+ * supervisor_wake
+ * description:
+ *     wakes the supervisor so that it picks up a new deadline.
+ */
+void supervisor_wake(void)
+{
+	uint64_t one = 1;
+
+	if (WAKE_FD != -1)
+		write(WAKE_FD, &one, sizeof(one));
+}
+
+/*
+ * ms_since
+ * description:
+ *     computes the number of ms elapsed since the given time.
+ * parameters:
+ *     since: a time read from CLOCK_MONOTONIC.
+ * returns:
+ *     the number of ms elapsed, negative if since is in the future.
+ */
+long ms_since(struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec)*1000 + (now.tv_nsec - since->tv_nsec)/1000000;
+}
+
+/*
+ * set_deadline
+ * description:
+ *     sets out to the time ms milliseconds from now.
+ * parameters:
+ *     out: the time to set.
+ *     ms: the number of ms from now.
+ */
+void set_deadline(struct timespec *out, long ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, out);
+	out->tv_sec += ms / 1000;
+	out->tv_nsec += (ms % 1000) * 1000000;
+	if (out->tv_nsec >= 1000000000) {
+		out->tv_sec++;
+		out->tv_nsec -= 1000000000;
+	}
+}
+
+/*
+ * describe_status
+ * description:
+ *     writes a short description of a wait status, ie "status 1" or "signal 9".
+ * parameters:
+ *     status: the wait status, or STATUS_UNKNOWN.
+ *     out: buffer of at least 32 characters.
+ */
+void describe_status(int status, char *out)
+{
+	if (status == STATUS_UNKNOWN)
+		sprintf(out, "status unknown");
+	else if (WIFSIGNALED(status))
+		sprintf(out, "signal %d", WTERMSIG(status));
+	else
+		sprintf(out, "status %d", WEXITSTATUS(status));
+}
+
+/*
+ * handle_exit
+ * description:
+ *     records the exit of the process at index and decides if it is restarted.
+ *     quick exits in a row are restarted after a delay that doubles every time,
+ *     once there are more than max_restarts of them the process is given up on.
+ *     a process killed by a restart rule is restarted whatever its restart policy.
+ * parameters:
+ *     index: the index of the process in PIDS.
+ *     status: the wait status of the process, STATUS_UNKNOWN if it was adopted.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void handle_exit(int index, int status)
+{
+	struct process_info *info = &PROC_INFO[index];
+	int failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	int first_start = info->state == PROC_STARTING && info->restarting == 0;
+	int forced = info->forced;
+	char description[32];
+
+	probe_cancel(index);
+	info->state = PROC_EXITED;
+	journal_exited(index);
+	sample_forget(index);
+	info->status = status;
+	info->cpu = -1;
+	info->forced = 0;
+	pthread_cond_broadcast(&STATECOND);
+	//a process that doesn't survive its first start check is reported as failed to start.
+	if (first_start && info->announce == 1)
+		fprintf(OUTPUT_FILE, "[%d] badprogram %s, failed to start\n", index, info->argv[0]);
+	if (first_start || info->stopped == 1 || SHUTTING_DOWN == 1)
+		return;
+	if (!forced && (info->restart == RESTART_NEVER || (info->restart == RESTART_ON_FAILURE && !failed)))
+		return;
+	//a restart forced by a rule isn't a crash, it doesn't count towards a crash loop.
+	if (forced || ms_since(&info->started) >= STABLE_MS)
+		info->failures = 0;
+	else
+		info->failures++;
+	describe_status(status, description);
+	if (info->failures > info->max_restarts) {
+		fprintf(OUTPUT_FILE, "[%d] exited (%s), crash loop, giving up after %d restarts\n",
+			index, description, info->restarts);
+		info->restarting = 0;
+		return;
+	}
+	long delay = 0;
+
+	if (info->failures > 0) {
+		delay = info->backoff;
+		for (int i = 1; i < info->failures && delay < MAX_BACKOFF_MS; i++)
+			delay *= 2;
+		if (delay > MAX_BACKOFF_MS)
+			delay = MAX_BACKOFF_MS;
+	}
+	fprintf(OUTPUT_FILE, "[%d] exited (%s), restarting in %ld ms\n", index, description, delay);
+	info->state = PROC_BACKOFF;
+	info->restarting = 1;
+	set_deadline(&info->deadline, delay);
+}
+
+/*
+ * mark_started
+ * description:
+ *     records that the process at index passed its start check or its readiness probe.
+ * parameters:
+ *     index: the index of the process in PIDS.
+ *     state: PROC_RUNNING, or PROC_READY if it passed its readiness probe.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void mark_started(int index, int state)
+{
+	struct process_info *info = &PROC_INFO[index];
+
+	info->state = state;
+	if (info->restarting == 1) {
+		info->restarting = 0;
+		info->restarts++;
+		fprintf(OUTPUT_FILE, "[%d] %s, restarted (pid: %d)\n", index, info->argv[0], PIDS[index]);
+	} else if (info->announce == 1) {
+		fprintf(OUTPUT_FILE, "[%d] %s, started successfully (pid: %d)\n", index, info->argv[0], PIDS[index]);
+	}
+	journal_state(index);
+	pthread_cond_broadcast(&STATECOND);
+}
+
+/*
+ * stop_with_grace
+ * description:
+ *     sends a process its stop signal, and SIGKILL if it is still alive GRACE_MS
+ *     later, the same sequence as at shutdown but without waiting for it.
+ * parameters:
+ *     index: the index of its entry, -1 if it isn't in the process table.
+ *     pid: the pid of the process.
+ *     sig: its stop signal.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void stop_with_grace(int index, int pid, int sig)
+{
+	int pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+	kill(pid, sig);
+	kill(pid, SIGCONT); //a throttled process only handles the signal once continued
+	if (pidfd == -1)
+		return; //already gone
+	if (STOPPING_COUNT == STOPPING_CAPACITY) {
+		STOPPING_CAPACITY = STOPPING_CAPACITY == 0 ? 8 : STOPPING_CAPACITY*2;
+		STOPPING = realloc(STOPPING, sizeof(struct stopping)*STOPPING_CAPACITY);
+	}
+	struct stopping *stopping = &STOPPING[STOPPING_COUNT++];
+
+	stopping->index = index;
+	stopping->pid = pid;
+	stopping->pidfd = pidfd;
+	set_deadline(&stopping->deadline, GRACE_MS);
+	supervisor_wake();
+}
+
+/*
+ * stop_timers
+ * description:
+ *     kills the processes given to stop_with_grace whose grace period is over.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of ms until the next one is due, or -1 if there is none.
+ */
+static long stop_timers(void)
+{
+	long next = -1;
+
+	for (int i = 0; i < STOPPING_COUNT; i++) {
+		struct stopping *stopping = &STOPPING[i];
+		long remaining = -ms_since(&stopping->deadline);
+
+		if (remaining > 0) {
+			if (next == -1 || remaining < next)
+				next = remaining;
+			continue;
+		}
+		//fails once the process exited and was reaped.
+		if (syscall(SYS_pidfd_send_signal, stopping->pidfd, SIGKILL, NULL, 0) == 0) {
+			if (stopping->index == -1)
+				fprintf(OUTPUT_FILE, "[-] pid %d killed after %d ms\n", stopping->pid, GRACE_MS);
+			else
+				fprintf(OUTPUT_FILE, "[%d] killed after %d ms\n", stopping->index, GRACE_MS);
+		}
+		close(stopping->pidfd);
+		STOPPING[i--] = STOPPING[--STOPPING_COUNT];
+	}
+	return next;
+}
+
+/*
+ * run_timers
+ * description:
+ *     completes the start check of processes that survived it, runs the
+ *     readiness probes, restarts the processes whose restart delay is over,
+ *     kills the stopped processes that outlived their grace period,
+ *     and creates the waiting processes whose dependencies came up.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of ms until the next deadline, or -1 if there is none.
+ */
+int run_timers(void)
+{
+	long next = -1;
+
+	for (int i = 0; PIDS[i] != -1; i++) {
+		struct process_info *info = &PROC_INFO[i];
+
+		if (info->state != PROC_STARTING && info->state != PROC_BACKOFF)
+			continue;
+		if (info->state == PROC_STARTING && info->probe != NULL)
+			continue; //started by its probe, see probe_timers
+		long remaining = -ms_since(&info->deadline);
+
+		if (remaining <= 0 && info->state == PROC_STARTING) {
+			mark_started(i, PROC_RUNNING);
+			continue;
+		}
+		if (remaining <= 0) {
+			if (start_process(i) == -1) {
+				handle_exit(i, 127 << 8); //could not be spawned, counts as a failed run
+				if (info->state != PROC_BACKOFF)
+					continue;
+			}
+			remaining = -ms_since(&info->deadline);
+		}
+		if (remaining < 0)
+			remaining = 0;
+		if (next == -1 || remaining < next)
+			next = remaining;
+	}
+	long probes = probe_timers();
+	long stops = stop_timers();
+
+	if (probes != -1 && (next == -1 || probes < next))
+		next = probes;
+	if (stops != -1 && (next == -1 || stops < next))
+		next = stops;
+	//processes created here wake the supervisor, so their start check is timed by the next call.
+	deps_start_ready();
+	return next;
+}
+
+/*
+ * reap_children
+ * description:
+ *     waits on every child that has exited and records its exit.
+ *     children that aren't in the process table are the commands of the probes.
+ */
+static void reap_children(void)
+{
+	int status;
+	int pid;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		int found = 0;
+
+		stats_lock(&PIDLOCK);
+		for (int i = 0; PIDS != NULL && PIDS[i] != -1; i++) {
+			int state = PROC_INFO[i].state;
+
+			if (PIDS[i] == pid && (state == PROC_STARTING || state == PROC_RUNNING || state == PROC_READY)) {
+				handle_exit(i, status);
+				found = 1;
+				break;
+			}
+		}
+		if (found == 0)
+			probe_reaped(pid, status);
+		pthread_mutex_unlock(&PIDLOCK);
+	}
+}
+
+/*
+ * supervisor_loop
+ * description:
+ *     the thread function of the supervisor.
+ */
+void *supervisor_loop(void *vargp)
+{
+	struct pollfd fds[5];
+
+	stats_thread("supervisor");
+	fds[0].fd = SIGNAL_FD;
+	fds[0].events = POLLIN;
+	fds[1].fd = WAKE_FD;
+	fds[1].events = POLLIN;
+	fds[2].fd = PROBE_FD;
+	fds[2].events = POLLIN;
+	fds[3].fd = reload_watch_fd();
+	fds[3].events = POLLIN;
+	fds[4].fd = ADOPTED_FD;
+	fds[4].events = POLLIN;
+	while (1) {
+		struct signalfd_siginfo siginfo;
+		uint64_t count;
+		int reload = 0;
+
+		stats_lock(&PIDLOCK);
+		int timeout = PIDS == NULL ? -1 : run_timers();
+
+		pthread_mutex_unlock(&PIDLOCK);
+		//poll ignores the descriptors that are -1, without a file to watch or a journal.
+		if (poll(fds, 5, timeout) == -1 && errno != EINTR) {
+			fprintf(stderr, "supervisor error %s\n", strerror(errno));
+			exit(1);
+		}
+		while (read(SIGNAL_FD, &siginfo, sizeof(siginfo)) == sizeof(siginfo)) {
+			if (siginfo.ssi_signo == SIGHUP)
+				reload = 1;
+		}
+		read(WAKE_FD, &count, sizeof(count));
+		if (fds[3].fd != -1 && (fds[3].revents & POLLIN) && reload_watch_event() == 1)
+			reload = 1;
+		if (fds[2].revents & POLLIN) {
+			stats_lock(&PIDLOCK);
+			probe_events();
+			pthread_mutex_unlock(&PIDLOCK);
+		}
+		if (fds[4].revents & POLLIN) {
+			stats_lock(&PIDLOCK);
+			journal_events();
+			pthread_mutex_unlock(&PIDLOCK);
+		}
+		reap_children();
+		if (reload == 1 && PIDS != NULL && SHUTTING_DOWN == 0)
+			reload_file();
+	}
+	return NULL;
+}
@@ -0,0 +1,119 @@
+/*
+ * supervisor_block_signals
+ * description:
+ *     blocks SIGCHLD and SIGHUP in the calling thread so that they are only
+ *     received through the supervisor's signalfd. Threads created afterwards inherit the mask.
+ * pre-conditions:
+ *     called by the main thread before any other thread is started.
+ */
+void supervisor_block_signals(void);
+
+/*
+ * supervisor_start
+ * description:
+ *     starts the supervisor thread. The supervisor is the only thread that
+ *     waits on children, it records their exit, restarts them according to their
+ *     restart policy, and completes the start check of new processes.
+ *     it also reloads the process list file on SIGHUP or when it changes.
+ * post-condition:
+ *     the supervisor thread is running.
+ */
+void supervisor_start(void);
+
+/*
+ * supervisor_wake
+ * description:
+ *     wakes the supervisor so that it picks up a new deadline.
+ */
+void supervisor_wake(void);
+
+/*
+ * supervisor_loop
+ * description:
+ *     the thread function of the supervisor.
+ */
+void *supervisor_loop(void *vargp);
+
+/*
+ * handle_exit
+ * description:
+ *     records the exit of the process at index and decides if it is restarted.
+ *     quick exits in a row are restarted after a delay that doubles every time,
+ *     once there are more than max_restarts of them the process is given up on.
+ * parameters:
+ *     index: the index of the process in PIDS.
+ *     status: the wait status of the process, STATUS_UNKNOWN if it was adopted.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void handle_exit(int index, int status);
+
+/*
+ * describe_status
+ * description:
+ *     writes a short description of a wait status, ie "status 1" or "signal 9".
+ * parameters:
+ *     status: the wait status, or STATUS_UNKNOWN.
+ *     out: buffer of at least 32 characters.
+ */
+void describe_status(int status, char *out);
+
+/*
+ * mark_started
+ * description:
+ *     records that the process at index passed its start check or its readiness probe.
+ * parameters:
+ *     index: the index of the process in PIDS.
+ *     state: PROC_RUNNING, or PROC_READY if it passed its readiness probe.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void mark_started(int index, int state);
+
+/*
+ * stop_with_grace
+ * description:
+ *     sends a process its stop signal, and SIGKILL if it is still alive GRACE_MS
+ *     later, the same sequence as at shutdown but without waiting for it.
+ * parameters:
+ *     index: the index of its entry, -1 if it isn't in the process table.
+ *     pid: the pid of the process.
+ *     sig: its stop signal.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ */
+void stop_with_grace(int index, int pid, int sig);
+
+/*
+ * run_timers
+ * description:
+ *     completes the start check of processes that survived it, restarts
+ *     the processes whose restart delay is over and kills the stopped
+ *     processes that outlived their grace period.
+ * pre-conditions:
+ *     PIDLOCK is held.
+ * returns:
+ *     the number of ms until the next deadline, or -1 if there is none.
+ */
+int run_timers(void);
+
+/*
+ * ms_since
+ * description:
+ *     computes the number of ms elapsed since the given time.
+ * parameters:
+ *     since: a time read from CLOCK_MONOTONIC.
+ * returns:
+ *     the number of ms elapsed, negative if since is in the future.
+ */
+long ms_since(struct timespec *since);
+
+/*
+ * set_deadline
+ * description:
+ *     sets out to the time ms milliseconds from now.
+ * parameters:
+ *     out: the time to set.
+ *     ms: the number of ms from now.
+ */
+void set_deadline(struct timespec *out, long ms);
@@ -0,0 +1,274 @@
+/*
+ * macD_top
+ * written by: Nathan Koop
+ *
+ * description:
+ *     fleet aggregates and the heaviest consumers of cpu and memory.
+ *     they are built while render_report samples the processes: every sample
+ *     updates the totals and two bounded min heaps, so finding the top K of
+ *     thousands of processes costs no more than the sampling itself.
+ *     at the end of a cycle the result is published under its own lock, so
+ *     the top command is answered in O(K) without waiting on PIDLOCK.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "macD.h"
+#include "macD_top.h"
+
+/*
+ * top_heap
+ * description:
+ *     a ranking being built, the least ranked entry at the root.
+ */
+struct top_heap {
+	struct top_entry entries[TOP_K];
+	int len;
+};
+
+//built by the report thread during a cycle.
+struct fleet_totals CYCLE_TOTALS;
+struct top_heap CPU_HEAP;
+struct top_heap MEM_HEAP;
+unsigned long CYCLES = 0;
+//published by top_commit, read by the top command and the report.
+struct fleet_totals TOTALS;
+struct top_entry TOP_CPU[TOP_K];
+struct top_entry TOP_MEM[TOP_K];
+int TOP_CPU_LEN = 0;
+int TOP_MEM_LEN = 0;
+pthread_mutex_t TOPLOCK = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * ranks_below
+ * description:
+ *     compares two entries of a ranking, ties go to the lowest index.
+ * returns:
+ *     1 if a ranks below b, 0 otherwise.
+ */
+static int ranks_below(struct top_entry *a, struct top_entry *b)
+{
+	if (a->value != b->value)
+		return a->value < b->value;
+	return a->index > b->index;
+}
+
+/*
+ * swap_entries
+ * description:
+ *     swaps two entries of a heap.
+ */
+static void swap_entries(struct top_entry *a, struct top_entry *b)
+{
+	struct top_entry tmp = *a;
+
+	*a = *b;
+	*b = tmp;
+}
+
+/*
+ * sift_down
+ * description:
+ *     moves the entry at i down until neither of its children ranks below it.
+ * parameters:
+ *     heap: the heap.
+ *     i: the position of the entry.
+ */
+static void sift_down(struct top_heap *heap, int i)
+{
+	while (1) {
+		int least = i;
+		int left = 2*i + 1;
+		int right = left + 1;
+
+		if (left < heap->len && ranks_below(&heap->entries[left], &heap->entries[least]))
+			least = left;
+		if (right < heap->len && ranks_below(&heap->entries[right], &heap->entries[least]))
+			least = right;
+		if (least == i)
+			return;
+		swap_entries(&heap->entries[i], &heap->entries[least]);
+		i = least;
+	}
+}
+
+/*
+ * heap_offer
+ * description:
+ *     adds an entry to a ranking if it has room or the entry ranks above its least entry.
+ * parameters:
+ *     heap: the ranking.
+ *     entry: the entry to add.
+ */
+static void heap_offer(struct top_heap *heap, struct top_entry *entry)
+{
+	if (heap->len < TOP_K) {
+		int i = heap->len++;
+
+		heap->entries[i] = *entry;
+		while (i > 0 && ranks_below(&heap->entries[i], &heap->entries[(i-1)/2])) {
+			swap_entries(&heap->entries[i], &heap->entries[(i-1)/2]);
+			i = (i-1)/2;
+		}
+	} else if (ranks_below(&heap->entries[0], entry)) {
+		heap->entries[0] = *entry;
+		sift_down(heap, 0);
+	}
+}
+
+/*
+ * heap_sort
+ * description:
+ *     empties a ranking into out, largest first.
+ * parameters:
+ *     heap: the ranking, empty afterwards.
+ *     out: room for TOP_K entries.
+ * returns:
+ *     the number of entries in out.
+ */
+static int heap_sort(struct top_heap *heap, struct top_entry *out)
+{
+	int len = heap->len;
+
+	while (heap->len > 0) {
+		out[heap->len-1] = heap->entries[0];
+		heap->entries[0] = heap->entries[--heap->len];
+		sift_down(heap, 0);
+	}
+	return len;
+}
+
+/*
+ * top_begin
+ * description:
+ *     starts a report cycle: clears the totals and rankings being built.
+ * pre-conditions:
+ *     only called by the thread that renders the reports.
+ */
+void top_begin(void)
+{
+	memset(&CYCLE_TOTALS, 0, sizeof(CYCLE_TOTALS));
+	CYCLE_TOTALS.cycle = ++CYCLES;
+	CPU_HEAP.len = 0;
+	MEM_HEAP.len = 0;
+}
+
+/*
+ * top_add
+ * description:
+ *     counts an entry of the process table in the totals and, if it is
+ *     running, offers it to the rankings by cpu and by memory. A ranking is a
+ *     min heap of TOP_K entries so this costs O(log K) whatever the fleet size.
+ * parameters:
+ *     index: the index of the entry.
+ *     pid: the pid of the process.
+ *     state: one of the PROC_ states.
+ *     cpu: the cpu usage of the process in this cycle, as a percent.
+ *     mem: the memory usage of the process in this cycle, in MB.
+ * pre-conditions:
+ *     top_begin was called for this cycle.
+ */
+void top_add(int index, int pid, int state, int cpu, int mem)
+{
+	CYCLE_TOTALS.processes++;
+	if (state == PROC_STARTING || state == PROC_WAITING) {
+		CYCLE_TOTALS.starting++;
+	} else if (state == PROC_BACKOFF) {
+		CYCLE_TOTALS.backoff++;
+	} else if (state == PROC_EXITED) {
+		CYCLE_TOTALS.exited++;
+	} else {
+		struct top_entry entry = { index, pid, cpu };
+
+		CYCLE_TOTALS.running++;
+		//a process that exited while it was sampled reads as -1
+		if (cpu > 0)
+			CYCLE_TOTALS.cpu += cpu;
+		if (mem > 0)
+			CYCLE_TOTALS.mem += mem;
+		heap_offer(&CPU_HEAP, &entry);
+		entry.value = mem;
+		heap_offer(&MEM_HEAP, &entry);
+	}
+}
+
+/*
+ * top_commit
+ * description:
+ *     ends a report cycle: sorts the rankings, largest first, and publishes
+ *     them with the totals for top_text and top_report.
+ */
+void top_commit(void)
+{
+	struct top_entry cpu[TOP_K];
+	struct top_entry mem[TOP_K];
+	int cpu_len = heap_sort(&CPU_HEAP, cpu);
+	int mem_len = heap_sort(&MEM_HEAP, mem);
+
+	pthread_mutex_lock(&TOPLOCK);
+	TOTALS = CYCLE_TOTALS;
+	memcpy(TOP_CPU, cpu, sizeof(cpu));
+	memcpy(TOP_MEM, mem, sizeof(mem));
+	TOP_CPU_LEN = cpu_len;
+	TOP_MEM_LEN = mem_len;
+	pthread_mutex_unlock(&TOPLOCK);
+}
+
+/*
+ * top_report
+ * description:
+ *     displays the totals and rankings of the last cycle in a report.
+ * parameters:
+ *     file: where to display them.
+ */
+void top_report(FILE *file)
+{
+	pthread_mutex_lock(&TOPLOCK);
+	fprintf(file, "Fleet: %d processes, %d running, %d starting, %d restarting, %d exited,",
+		TOTALS.processes, TOTALS.running, TOTALS.starting, TOTALS.backoff, TOTALS.exited);
+	fprintf(file, " cpu usage: %ld%%, mem usage: %ld MB\n", TOTALS.cpu, TOTALS.mem);
+	if (TOP_CPU_LEN > 0) {
+		fprintf(file, "Top cpu:");
+		for (int i = 0; i < TOP_CPU_LEN; i++)
+			fprintf(file, " [%d] %d%%", TOP_CPU[i].index, TOP_CPU[i].value);
+		fprintf(file, "\nTop mem:");
+		for (int i = 0; i < TOP_MEM_LEN; i++)
+			fprintf(file, " [%d] %d MB", TOP_MEM[i].index, TOP_MEM[i].value);
+		fprintf(file, "\n");
+	}
+	pthread_mutex_unlock(&TOPLOCK);
+}
+
+/*
+ * top_text
+ * description:
+ *     renders the totals and rankings of the last cycle for the top command,
+ *     in O(K): a line of totals then one line per ranked process,
+ *     "cpu index=[i] pid=[p] value=[percent]" then "mem index=[i] pid=[p] value=[MB]".
+ * parameters:
+ *     out_len: set to the length of the text.
+ * returns:
+ *     the text, to be freed with free.
+ */
+char *top_text(int *out_len)
+{
+	char *text = NULL;
+	size_t len = 0;
+	FILE *file = open_memstream(&text, &len);
+
+	pthread_mutex_lock(&TOPLOCK);
+	fprintf(file, "cycle=%lu processes=%d running=%d starting=%d backoff=%d exited=%d cpu=%ld mem=%ld\n",
+		TOTALS.cycle, TOTALS.processes, TOTALS.running, TOTALS.starting,
+		TOTALS.backoff, TOTALS.exited, TOTALS.cpu, TOTALS.mem);
+	for (int i = 0; i < TOP_CPU_LEN; i++)
+		fprintf(file, "cpu index=%d pid=%d value=%d\n", TOP_CPU[i].index, TOP_CPU[i].pid, TOP_CPU[i].value);
+	for (int i = 0; i < TOP_MEM_LEN; i++)
+		fprintf(file, "mem index=%d pid=%d value=%d\n", TOP_MEM[i].index, TOP_MEM[i].pid, TOP_MEM[i].value);
+	pthread_mutex_unlock(&TOPLOCK);
+	fclose(file);
+	*out_len = len;
+	return text;
+}
@@ -0,0 +1,85 @@
+//number of processes kept in each ranking.
+#define TOP_K 10
+
+/*
+ * top_entry
+ * description:
+ *     a process of a ranking, with the value it is ranked by.
+ */
+struct top_entry {
+	int index; //index of the process in the process table
+	int pid;
+	int value; //cpu usage as a percent, or memory usage in MB
+};
+
+/*
+ * fleet_totals
+ * description:
+ *     the aggregates of the whole process table in one report cycle.
+ */
+struct fleet_totals {
+	unsigned long cycle; //number of the report cycle
+	int processes; //entries in the process table
+	int running;
+	int starting; //waiting for their start check or their dependencies
+	int backoff; //waiting to be restarted
+	int exited; //removed processes included
+	long cpu; //sum of the cpu usage of the running processes, as a percent
+	long mem; //sum of the memory usage of the running processes, in MB
+};
+
+/*
+ * top_begin
+ * description:
+ *     starts a report cycle: clears the totals and rankings being built.
+ * pre-conditions:
+ *     only called by the thread that renders the reports.
+ */
+void top_begin(void);
+
+/*
+ * top_add
+ * description:
+ *     counts an entry of the process table in the totals and, if it is
+ *     running, offers it to the rankings by cpu and by memory. A ranking is a
+ *     min heap of TOP_K entries so this costs O(log K) whatever the fleet size.
+ * parameters:
+ *     index: the index of the entry.
+ *     pid: the pid of the process.
+ *     state: one of the PROC_ states.
+ *     cpu: the cpu usage of the process in this cycle, as a percent.
+ *     mem: the memory usage of the process in this cycle, in MB.
+ * pre-conditions:
+ *     top_begin was called for this cycle.
+ */
+void top_add(int index, int pid, int state, int cpu, int mem);
+
+/*
+ * top_commit
+ * description:
+ *     ends a report cycle: sorts the rankings, largest first, and publishes
+ *     them with the totals for top_text and top_report.
+ */
+void top_commit(void);
+
+/*
+ * top_report
+ * description:
+ *     displays the totals and rankings of the last cycle in a report.
+ * parameters:
+ *     file: where to display them.
+ */
+void top_report(FILE *file);
+
+/*
+ * top_text
+ * description:
+ *     renders the totals and rankings of the last cycle for the top command,
+ *     in O(K): a line of totals then one line per ranked process,
+ *     "cpu index=[i] pid=[p] value=[percent]" then "mem index=[i] pid=[p] value=[MB]".
+ * parameters:
+ *     out_len: set to the length of the text.
+ * returns:
+ *     the text, to be freed with free.
+ */
+char *top_text(int *out_len);
@@ -0,0 +1,301 @@
+/*
+ * macD_zygote
+ * written by: Nathan Koop
+ *
+ * description:
+ *     the zygote is forked when macD starts, before any threads exist.
+ *     macD sends it spawn requests over a socket pair and the zygote
+ *     forks and execs the children so that macD, with its server threads,
+ *     never has to fork itself. Each child is created through an intermediate
+ *     process that exits right away, so the child is reparented to macD,
+ *     which is a child subreaper, and macD can wait on it like any other child.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <sys/uio.h>
+#include "macD.h"
+#include "macD_zygote.h"
+#include "macD_parse.h"
+
+struct zygote_request {
+	int quite_mode;
+	int unit;
+	int out_fd; //descriptor of the output, passed as ancillary data, -1 if none
+	int notify_fd; //descriptor of the readiness probe, passed after out_fd, -1 if none
+	int argc; //number of arguments that follow the request
+};
+
+struct zygote_reply {
+	int pid;
+	int error;
+};
+
+int ZYGOTE_SOCK = -1;
+int ZYGOTE_PID = -1;
+pthread_mutex_t ZYGOTELOCK = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * zygote_start
+ * description:
+ *     forks the zygote, a small helper process that creates child processes
+ *     on behalf of macD. Children are forked from the zygote and reparented to
+ *     macD so that they can still be waited on by macD.
+ * pre-conditions:
+ *     no threads have been started yet.
+ * post-conditions:
+ *     macD is a child subreaper.
+ *     ZYGOTE_SOCK is connected to the zygote.
+ * returns:
+ *     0 if the zygote was started, -1 otherwise.
+ */
+int zygote_start(void)
+{
+	int socks[2];
+
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1)
+		return -1;
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, socks) == -1)
+		return -1;
+	fflush(NULL);
+	int pid = fork();
+
+	if (pid == -1) {
+		close(socks[0]);
+		close(socks[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		close(socks[0]);
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		zygote_loop(socks[1]);
+	}
+	close(socks[1]);
+	ZYGOTE_SOCK = socks[0];
+	ZYGOTE_PID = pid;
+	return 0;
+}
+
+/*
+ * zygote_enabled
+ * description:
+ *     checks if spawn requests should be sent to the zygote.
+ * returns:
+ *     1 if the zygote is running, 0 otherwise.
+ */
+int zygote_enabled(void)
+{
+	return ZYGOTE_SOCK != -1;
+}
+
+/*
+ * zygote_spawn
+ * description:
+ *     asks the zygote to create the process described by argv.
+ *     safe to call from several threads at once.
+ * parameters:
+ *     argv: arguments of the process to create, packed with pack_args.
+ *     quite_mode: 1 if the output of the process should be muted.
+ *     unit: placement unit to bind the process to, -1 to leave it unbound.
+ *     out_fd: file descriptor to use as stdout and stderr, -1 to keep macD's.
+ *             it is passed to the zygote along with the request.
+ *     notify_fd: file descriptor to hand to the process as PROBE_NOTIFY_FD, -1 for none.
+ *             it is passed to the zygote like out_fd.
+ *     out_error: set to the errno of a failed exec, 0 if exec succeeded.
+ * returns:
+ *     the pid of the new process, which is a child of macD,
+ *     or -1 if the zygote could not be reached.
+ */
+int zygote_spawn(char **argv, int quite_mode, int unit, int out_fd, int notify_fd, int *out_error)
+{
+	struct zygote_request request;
+	struct zygote_reply reply;
+	struct iovec iov[2];
+	struct msghdr msg;
+	char control[CMSG_SPACE(2*sizeof(int))];
+	int fds[2];
+	int num_fds = 0;
+
+	request.quite_mode = quite_mode;
+	request.unit = unit;
+	request.out_fd = out_fd;
+	request.notify_fd = notify_fd;
+	request.argc = 0;
+	while (argv[request.argc] != NULL)
+		request.argc++;
+	//packed arguments are stored one after the other, so they are sent as one block.
+	iov[0].iov_base = &request;
+	iov[0].iov_len = sizeof(request);
+	iov[1].iov_base = argv[0];
+	iov[1].iov_len = args_length(argv, request.argc);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	if (out_fd >= 0)
+		fds[num_fds++] = out_fd;
+	if (notify_fd >= 0)
+		fds[num_fds++] = notify_fd;
+	if (num_fds > 0) {
+		memset(control, 0, sizeof(control));
+		msg.msg_control = control;
+		msg.msg_controllen = CMSG_SPACE(num_fds*sizeof(int));
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(num_fds*sizeof(int));
+		memcpy(CMSG_DATA(cmsg), fds, num_fds*sizeof(int));
+	}
+	pthread_mutex_lock(&ZYGOTELOCK);
+	if (ZYGOTE_SOCK == -1 || sendmsg(ZYGOTE_SOCK, &msg, MSG_NOSIGNAL) == -1 ||
+	    recv(ZYGOTE_SOCK, &reply, sizeof(reply), 0) != sizeof(reply)) {
+		//the zygote is gone, callers fall back to forking macD itself.
+		if (ZYGOTE_SOCK != -1) {
+			fprintf(stderr, "zygote lost, spawning from macD\n");
+			close(ZYGOTE_SOCK);
+			ZYGOTE_SOCK = -1;
+		}
+		pthread_mutex_unlock(&ZYGOTELOCK);
+		return -1;
+	}
+	pthread_mutex_unlock(&ZYGOTELOCK);
+	*out_error = reply.error;
+	return reply.pid;
+}
+
+/*
+ * zygote_fork
+ * description:
+ *     creates the process described by argv as a grandchild of the zygote.
+ *     the intermediate process sends the pid of the grandchild through pid_pipe
+ *     and exits, and the grandchild sends errno through err_pipe if exec fails.
+ * parameters:
+ *     argv: arguments of the process to create, terminated by NULL.
+ *     request: the options of the process to create.
+ * returns:
+ *     the reply to send back to macD.
+ */
+static struct zygote_reply zygote_fork(char **argv, struct zygote_request *request)
+{
+	struct zygote_reply reply = { -1, 0 };
+	int pid_pipe[2];
+	int err_pipe[2];
+
+	if (pipe2(pid_pipe, O_CLOEXEC) == -1) {
+		reply.error = errno;
+		return reply;
+	}
+	if (pipe2(err_pipe, O_CLOEXEC) == -1) {
+		reply.error = errno;
+		close(pid_pipe[0]);
+		close(pid_pipe[1]);
+		return reply;
+	}
+	int middle = fork();
+
+	if (middle == 0) {
+		int pid = fork();
+
+		if (pid == 0)
+			exec_process(argv, request->quite_mode, request->unit, err_pipe[1], request->out_fd, request->notify_fd);
+		write(pid_pipe[1], &pid, sizeof(int));
+		_exit(0);
+	}
+	close(pid_pipe[1]);
+	close(err_pipe[1]);
+	if (middle == -1) {
+		reply.error = errno;
+	} else {
+		waitpid(middle, NULL, 0);
+		if (read(pid_pipe[0], &reply.pid, sizeof(int)) != sizeof(int))
+			reply.pid = -1;
+		//reaches EOF once the grandchild has called exec successfully.
+		if (read(err_pipe[0], &reply.error, sizeof(int)) != sizeof(int))
+			reply.error = 0;
+	}
+	if (reply.pid == -1 && reply.error == 0)
+		reply.error = EAGAIN;
+	close(pid_pipe[0]);
+	close(err_pipe[0]);
+	return reply;
+}
+
+/*
+ * zygote_loop
+ * description:
+ *     the body of the zygote process. Serves spawn requests read from sock
+ *     until macD closes its end of the socket.
+ * parameters:
+ *     sock: the zygote's end of the socket pair.
+ * post-condition:
+ *     the zygote exits.
+ */
+void zygote_loop(int sock)
+{
+	while (1) {
+		//peek to learn the size of the request before reading it.
+		int size = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC);
+
+		if (size <= 0)
+			_exit(0);
+		char *buffer = malloc(size+1);
+		char control[CMSG_SPACE(2*sizeof(int))];
+		struct iovec iov = { .iov_base = buffer, .iov_len = size };
+		struct msghdr msg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != size || size <= (int)sizeof(struct zygote_request))
+			_exit(1);
+		buffer[size] = '\0';
+		struct zygote_request request;
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+		memcpy(&request, buffer, sizeof(request));
+		if (request.argc <= 0)
+			_exit(1);
+		//the descriptor numbers in the request are macD's, the zygote got its own copies in the same order.
+		int fds[2] = { -1, -1 };
+		int num_fds = 0;
+
+		if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+			memcpy(fds, CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
+		request.out_fd = request.out_fd >= 0 ? fds[num_fds++] : -1;
+		request.notify_fd = request.notify_fd >= 0 ? fds[num_fds++] : -1;
+		char **argv = malloc(sizeof(char *)*(request.argc+1));
+		char *arg = buffer+sizeof(request);
+
+		for (int i = 0; i < request.argc; i++) {
+			if (arg >= buffer+size)
+				_exit(1);
+			argv[i] = arg;
+			arg += strlen(arg)+1;
+		}
+		argv[request.argc] = NULL;
+		struct zygote_reply reply = zygote_fork(argv, &request);
+
+		if (request.out_fd != -1)
+			close(request.out_fd);
+		if (request.notify_fd != -1)
+			close(request.notify_fd);
+		free(argv);
+		free(buffer);
+		if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+			_exit(1);
+	}
+}
@@ -0,0 +1,56 @@
+/*
+ * zygote_start
+ * description:
+ *     forks the zygote, a small helper process that creates child processes
+ *     on behalf of macD. Children are forked from the zygote and reparented to
+ *     macD so that they can still be waited on by macD.
+ * pre-conditions:
+ *     no threads have been started yet.
+ * post-conditions:
+ *     macD is a child subreaper.
+ *     ZYGOTE_SOCK is connected to the zygote.
+ * returns:
+ *     0 if the zygote was started, -1 otherwise.
+ */
+int zygote_start(void);
+
+/*
+ * zygote_enabled
+ * description:
+ *     checks if spawn requests should be sent to the zygote.
+ * returns:
+ *     1 if the zygote is running, 0 otherwise.
+ */
+int zygote_enabled(void);
+
+/*
+ * zygote_spawn
+ * description:
+ *     asks the zygote to create the process described by argv.
+ *     safe to call from several threads at once.
+ * parameters:
+ *     argv: arguments of the process to create, packed with pack_args.
+ *     quite_mode: 1 if the output of the process should be muted.
+ *     unit: placement unit to bind the process to, -1 to leave it unbound.
+ *     out_fd: file descriptor to use as stdout and stderr, -1 to keep macD's.
+ *             it is passed to the zygote along with the request.
+ *     notify_fd: file descriptor to hand to the process as PROBE_NOTIFY_FD, -1 for none.
+ *             it is passed to the zygote like out_fd.
+ *     out_error: set to the errno of a failed exec, 0 if exec succeeded.
+ * returns:
+ *     the pid of the new process, which is a child of macD,
+ *     or -1 if the zygote could not be reached.
+ */
+int zygote_spawn(char **argv, int quite_mode, int unit, int out_fd, int notify_fd, int *out_error);
+
+/*
+ * zygote_loop
+ * description:
+ *     the body of the zygote process. Serves spawn requests read from sock
+ *     until macD closes its end of the socket.
+ * parameters:
+ *     sock: the zygote's end of the socket pair.
+ * post-condition:
+ *     the zygote exits.
+ */
+void zygote_loop(int sock);